@@ -6,9 +6,21 @@
 #include <linux/uaccess.h>
 #include <linux/dmaengine.h>
 #include <linux/dma-buf.h>
+#include <linux/dma-fence.h>
+#include <linux/file.h>
 #include <linux/scatterlist.h>
 #include <linux/mutex.h>
 #include <linux/completion.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/poll.h>
+#include <linux/eventfd.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/sync_file.h>
 
 #include "rdma_stub_uapi.h"
 
@@ -17,11 +29,54 @@ static struct cdev rdma_cdev;
 static struct class *rdma_class;
 static DEFINE_MUTEX(rdma_lock);
 
-static struct dma_chan *chan;
+/*
+ * DMA channels. Up to rdma_channels memcpy channels are taken at load, all
+ * on the DMA device of the first one: buffers are mapped once, for that
+ * device, and the addresses are valid on every channel. Large copies are
+ * striped across the channels in use; other copies go to the least loaded.
+ */
+struct rdma_chan {
+    struct dma_chan *ch;
+    spinlock_t lock;              /* fields below; taken from DMA callbacks */
+    unsigned int inflight;        /* stripes submitted, not completed */
+    u64 inflight_bytes;
+    u64 copies;                   /* stripes completed without error */
+    u64 bytes;
+    u64 busy_ns;                  /* closed periods with inflight > 0 */
+    u64 busy_since;               /* ktime_get_ns() when inflight left 0 */
+};
+
+static struct rdma_chan rdma_chans[RDMA_MAX_CHANNELS];
+static unsigned int rdma_nchans;
+static atomic_t rdma_rr = ATOMIC_INIT(0);
+
+static unsigned int rdma_channels = 1;
+module_param(rdma_channels, uint, 0444);
+MODULE_PARM_DESC(rdma_channels, "DMA_MEMCPY channels to take at load (1..8, same DMA device)");
+
+static unsigned int rdma_active_channels;
+module_param(rdma_active_channels, uint, 0644);
+MODULE_PARM_DESC(rdma_active_channels, "Channels copies are spread and striped over (0 = all)");
+
+static unsigned int rdma_stripe_min = 512 * 1024;
+module_param(rdma_stripe_min, uint, 0644);
+MODULE_PARM_DESC(rdma_stripe_min, "Copies of at least this many bytes are striped across channels");
+
+static unsigned int rdma_max_xfer;
+module_param(rdma_max_xfer, uint, 0644);
+MODULE_PARM_DESC(rdma_max_xfer, "Max bytes per DMA descriptor (0 = channel limit)");
+
+/* Device buffers are mapped for; shared by every channel. */
+static struct device *rdma_dma_dev(void)
+{
+    return rdma_chans[0].ch->device->dev;
+}
 
-static void rdma_dma_cb(void *param)
+static unsigned int rdma_nchans_active(void)
 {
-    complete(param);
+    unsigned int n = READ_ONCE(rdma_active_channels);
+
+    return n && n < rdma_nchans ? n : rdma_nchans;
 }
 
 static int map_dmabuf_sg(struct device *dev,
@@ -57,116 +112,1528 @@ static void unmap_dmabuf_sg(struct dma_buf *dbuf,
     dma_buf_detach(dbuf, att);
 }
 
-static long rdma_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
+/*
+ * Scatter-gather copy planning.
+ *
+ * A copy is split into chunks that are physically contiguous on both sides:
+ * each SG table is walked from its offset, DMA-adjacent entries are merged
+ * into one run, and a chunk ends wherever either run ends or the per
+ * descriptor limit is hit. The chunks are submitted back to back and only
+ * the last descriptor raises an interrupt, so the whole copy has a single
+ * completion.
+ */
+struct rdma_sg_cursor {
+    struct scatterlist *sg;
+    unsigned int nents_left;   /* entries from sg to the end of the table */
+    dma_addr_t addr;           /* current position */
+    size_t left;               /* contiguous bytes from addr */
+};
+
+struct rdma_chunk {
+    dma_addr_t dst;
+    dma_addr_t src;
+    size_t len;
+};
+
+struct rdma_chunks {
+    struct rdma_chunk *v;
+    unsigned int n;
+    unsigned int cap;
+};
+
+static void rdma_cursor_merge(struct rdma_sg_cursor *c)
 {
-    struct rdma_copy_req req;
-    struct dma_buf *src = NULL, *dst = NULL;
-    struct dma_buf_attachment *src_att = NULL, *dst_att = NULL;
-    struct sg_table *src_sgt = NULL, *dst_sgt = NULL;
-    dma_addr_t src_dma, dst_dma;
-    struct dma_async_tx_descriptor *tx;
-    dma_cookie_t cookie;
-    DECLARE_COMPLETION_ONSTACK(done);
-    int ret = 0;
+    while (c->nents_left > 1) {
+        struct scatterlist *next = sg_next(c->sg);
 
-    (void)f;
+        if (sg_dma_address(next) != c->addr + c->left)
+            break;
+        c->left += sg_dma_len(next);
+        c->sg = next;
+        c->nents_left--;
+    }
+}
 
-    if (_IOC_TYPE(cmd) != RDMA_IOC_MAGIC)
-        return -ENOTTY;
-    if (cmd != RDMA_IOC_COPY)
-        return -ENOTTY;
+static int rdma_cursor_init(struct rdma_sg_cursor *c, struct sg_table *sgt, u64 offset)
+{
+    struct scatterlist *sg = sgt->sgl;
+    unsigned int n = sgt->nents;
 
-    if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
-        return -EFAULT;
+    while (n && offset >= sg_dma_len(sg)) {
+        offset -= sg_dma_len(sg);
+        sg = sg_next(sg);
+        n--;
+    }
+    if (!n)
+        return -EINVAL;
+
+    c->sg = sg;
+    c->nents_left = n;
+    c->addr = sg_dma_address(sg) + offset;
+    c->left = sg_dma_len(sg) - offset;
+    rdma_cursor_merge(c);
+    return 0;
+}
 
-    if (req.size == 0)
+static int rdma_cursor_advance(struct rdma_sg_cursor *c, size_t len)
+{
+    c->addr += len;
+    c->left -= len;
+    if (c->left)
+        return 0;
+    if (c->nents_left <= 1)
         return -EINVAL;
 
-    mutex_lock(&rdma_lock);
+    c->sg = sg_next(c->sg);
+    c->nents_left--;
+    c->addr = sg_dma_address(c->sg);
+    c->left = sg_dma_len(c->sg);
+    rdma_cursor_merge(c);
+    return 0;
+}
+
+static int rdma_chunks_push(struct rdma_chunks *ck, dma_addr_t dst, dma_addr_t src, size_t len)
+{
+    if (ck->n == ck->cap) {
+        unsigned int cap = ck->cap ? ck->cap * 2 : 16;
+        struct rdma_chunk *v = krealloc(ck->v, cap * sizeof(*v), GFP_KERNEL);
+
+        if (!v)
+            return -ENOMEM;
+        ck->v = v;
+        ck->cap = cap;
+    }
+    ck->v[ck->n].dst = dst;
+    ck->v[ck->n].src = src;
+    ck->v[ck->n].len = len;
+    ck->n++;
+    return 0;
+}
+
+static void rdma_chunks_free(struct rdma_chunks *ck)
+{
+    kfree(ck->v);
+    ck->v = NULL;
+    ck->n = ck->cap = 0;
+}
+
+/* Bytes one memcpy descriptor may carry on this channel. */
+static size_t rdma_max_chunk(struct dma_chan *ch)
+{
+    struct device *dev = ch->device->dev;
+    size_t max = SIZE_MAX;
+
+    if (dev->dma_parms)
+        max = dma_get_max_seg_size(dev);
+    if (rdma_max_xfer && rdma_max_xfer < max)
+        max = rdma_max_xfer;
+    return max;
+}
+
+static int rdma_plan_copy(struct rdma_chunks *ck, struct dma_chan *ch,
+                          struct sg_table *dst, u64 dst_off,
+                          struct sg_table *src, u64 src_off, size_t size)
+{
+    struct rdma_sg_cursor d, s;
+    size_t max = rdma_max_chunk(ch);
+    int ret;
+
+    ret = rdma_cursor_init(&d, dst, dst_off);
+    if (ret)
+        return ret;
+    ret = rdma_cursor_init(&s, src, src_off);
+    if (ret)
+        return ret;
+
+    while (size) {
+        size_t len = min3(size, d.left, s.left);
+
+        len = min(len, max);
+        if (!is_dma_copy_aligned(ch->device, s.addr, d.addr, len))
+            return -EINVAL;
+
+        ret = rdma_chunks_push(ck, d.addr, s.addr, len);
+        if (ret)
+            return ret;
+
+        size -= len;
+        if (!size)
+            break;
+        ret = rdma_cursor_advance(&d, len);
+        if (ret)
+            return ret;
+        ret = rdma_cursor_advance(&s, len);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+/*
+ * Submits n chunks as one chain; cb(param) runs once the last descriptor
+ * completes. If the channel runs out of descriptors mid-chain, the part
+ * already queued is drained synchronously and preparation is retried.
+ * *last is the cookie of the last descriptor queued, 0 if none was; on
+ * failure that part of the chain has no callback and is the caller's to
+ * drain. Caller holds rdma_lock.
+ */
+static int rdma_submit_chunks(struct dma_chan *ch, const struct rdma_chunk *v, unsigned int n,
+                              dma_async_tx_callback_result cb, void *param,
+                              dma_cookie_t *last)
+{
+    unsigned int i;
+    int ret;
+
+    *last = 0;
+
+    for (i = 0; i < n; i++) {
+        bool tail = (i == n - 1);
+        unsigned long flags = DMA_CTRL_ACK | (tail ? DMA_PREP_INTERRUPT : 0);
+        struct dma_async_tx_descriptor *tx;
+        dma_cookie_t cookie;
+
+        tx = dmaengine_prep_dma_memcpy(ch, v[i].dst, v[i].src, v[i].len, flags);
+        if (!tx && *last) {
+            dma_async_issue_pending(ch);
+            if (dma_sync_wait(ch, *last) != DMA_COMPLETE)
+                return -EIO;
+            tx = dmaengine_prep_dma_memcpy(ch, v[i].dst, v[i].src, v[i].len, flags);
+        }
+        if (!tx)
+            return -ENOMEM;
+
+        if (tail) {
+            tx->callback_result = cb;
+            tx->callback_param = param;
+        }
+
+        cookie = dmaengine_submit(tx);
+        ret = dma_submit_error(cookie);
+        if (ret)
+            return ret;
+        *last = cookie;
+    }
+
+    dma_async_issue_pending(ch);
+    return 0;
+}
+
+/*
+ * Registered buffers.
+ *
+ * Mapping a dma-buf (attach + map_attachment: IOMMU programming and cache
+ * maintenance) can cost more than a small copy. RDMA_IOC_REGISTER_BUF maps
+ * a buffer once, bidirectionally, and keeps it mapped until unregistered
+ * or the file is released; copies then name it by handle. Registrations
+ * are refcounted so an in-flight copy keeps its mapping alive across an
+ * unregister.
+ */
+struct rdma_reg {
+    struct kref ref;
+    struct dma_buf *dbuf;
+    struct dma_buf_attachment *att;
+    struct sg_table *sgt;
+};
+
+/* One side of a copy: either a registered mapping or a per-copy one. */
+struct rdma_xbuf {
+    struct rdma_reg *reg;
+    struct dma_buf *dbuf;
+    struct dma_buf_attachment *att;
+    struct sg_table *sgt;
+    enum dma_data_direction dir;
+};
+
+static void rdma_reg_release(struct kref *ref)
+{
+    struct rdma_reg *reg = container_of(ref, struct rdma_reg, ref);
+
+    unmap_dmabuf_sg(reg->dbuf, reg->att, reg->sgt, DMA_BIDIRECTIONAL);
+    dma_buf_put(reg->dbuf);
+    kfree(reg);
+}
+
+static struct rdma_reg *rdma_reg_create(int fd)
+{
+    struct rdma_reg *reg;
+    int ret;
+
+    if (!rdma_nchans)
+        return ERR_PTR(-ENODEV);
+
+    reg = kzalloc(sizeof(*reg), GFP_KERNEL);
+    if (!reg)
+        return ERR_PTR(-ENOMEM);
+    kref_init(&reg->ref);
+
+    reg->dbuf = dma_buf_get(fd);
+    if (IS_ERR(reg->dbuf)) {
+        ret = PTR_ERR(reg->dbuf);
+        kfree(reg);
+        return ERR_PTR(ret);
+    }
+
+    ret = map_dmabuf_sg(rdma_dma_dev(), reg->dbuf, &reg->att, &reg->sgt, DMA_BIDIRECTIONAL);
+    if (ret) {
+        dma_buf_put(reg->dbuf);
+        kfree(reg);
+        return ERR_PTR(ret);
+    }
+    return reg;
+}
+
+/*
+ * Copy jobs.
+ *
+ * A job owns the dma-buf mappings of one copy. It sits on rdma_active from
+ * the moment its descriptors are on the channels until its completion has
+ * been processed; both that and rdma_terminate_chans() run under rdma_lock,
+ * so a listed job is always one the terminated channels were working on.
+ * Completion comes from the DMA callback or, if the channel had to be
+ * terminated, from rdma_abort_chans(); RDMA_JOB_FINISHED makes sure only
+ * one of them wins.
+ *
+ * Synchronous jobs (RDMA_IOC_COPY) wake the ioctl, which unmaps inline.
+ * Asynchronous jobs (RDMA_IOC_SUBMIT) are unmapped from a work item and
+ * then queued on their file for read()/poll(), with an optional eventfd
+ * signal.
+ * Fenced jobs (RDMA_IOC_COPY_FENCED) are unmapped from a work item too,
+ * then signal their dma-fence instead; one with an in-fence waits on
+ * owner->waiting until a fence callback queues start_work, which submits
+ * it or fails it with the in-fence's error.
+ *
+ * A job runs as one or more stripes, each a chain on its own channel; the
+ * job completes when the last stripe does. Terminating a channel ends only
+ * the stripes that were on it.
+ */
+#define RDMA_JOB_FINISHED 0
+
+struct rdma_file;
+struct rdma_job;
+
+struct rdma_stripe {
+    struct rdma_job *job;
+    struct rdma_chan *rc;
+    unsigned int first, n;        /* job->ck.v[first .. first + n) */
+    size_t bytes;
+};
+
+struct rdma_job {
+    struct list_head node;        /* owner->waiting, rdma_active, then owner->done */
+    struct rdma_file *owner;      /* NULL for synchronous copies */
+    struct dma_fence *fence;      /* fenced copies: signalled instead of owner->done */
+    struct dma_fence *in_fence;   /* must signal before submission */
+    struct dma_fence_cb in_cb;    /* queues start_work once it has */
+    struct work_struct start_work;
+    unsigned long state;
+    u64 cookie;
+    int status;
+    struct completion done;
+    struct work_struct work;
+
+    struct rdma_xbuf *xb;         /* buffers the chunks point into, deduplicated */
+    unsigned int nxb, xb_cap;
+    struct rdma_chunks ck;
+
+    struct rdma_stripe stripes[RDMA_MAX_CHANNELS];
+    unsigned int nstripes;
+    atomic_t stripes_left;        /* chains still in flight */
+    unsigned long stripes_done;   /* bit per stripe, set once it is accounted for */
+    int stripe_err;
+};
+
+struct rdma_file {
+    spinlock_t lock;              /* done, waiting, pending, queued */
+    struct list_head done;        /* finished jobs awaiting read() */
+    struct list_head waiting;     /* fenced jobs whose in-fence is pending */
+    wait_queue_head_t wq;
+    unsigned int pending;         /* submitted, completion not processed */
+    unsigned int queued;          /* submitted, not yet reaped by read() */
+    unsigned int fenced;          /* fenced copies not yet signalled */
+    u64 next_cookie;
+    struct mutex efd_lock;
+    struct eventfd_ctx *efd;
+    struct mutex regs_lock;
+    struct idr regs;              /* handle -> struct rdma_reg */
+};
+
+static LIST_HEAD(rdma_active);
+static DEFINE_SPINLOCK(rdma_active_lock);
+
+static unsigned int rdma_max_inflight = 16;
+module_param(rdma_max_inflight, uint, 0644);
+MODULE_PARM_DESC(rdma_max_inflight, "Max async copies queued per open file");
+
+/*
+ * Resolves one side of a copy into job->xb and returns its index. by_handle
+ * selects a registered buffer of rf, otherwise id is a dma-buf fd that gets
+ * mapped for this job only. A buffer already used by the job in the same
+ * direction is reused, so vectored copies map each buffer once.
+ */
+static int rdma_job_buf(struct rdma_file *rf, struct rdma_job *job, s32 id, bool by_handle,
+                        enum dma_data_direction dir, unsigned int *out_idx)
+{
+    struct rdma_reg *reg = NULL;
+    struct dma_buf *dbuf = NULL;
+    struct rdma_xbuf *xb;
+    unsigned int i;
+    int ret;
+
+    if (by_handle) {
+        if (!rf)
+            return -EINVAL;
+        mutex_lock(&rf->regs_lock);
+        reg = idr_find(&rf->regs, id);
+        if (reg)
+            kref_get(&reg->ref);
+        mutex_unlock(&rf->regs_lock);
+        if (!reg)
+            return -ENOENT;
+    } else {
+        dbuf = dma_buf_get(id);
+        if (IS_ERR(dbuf))
+            return PTR_ERR(dbuf);
+    }
+
+    for (i = 0; i < job->nxb; i++) {
+        xb = &job->xb[i];
+        if (reg ? xb->reg == reg : (!xb->reg && xb->dbuf == dbuf && xb->dir == dir)) {
+            if (reg)
+                kref_put(&reg->ref, rdma_reg_release);
+            else
+                dma_buf_put(dbuf);
+            *out_idx = i;
+            return 0;
+        }
+    }
+
+    if (job->nxb == job->xb_cap) {
+        unsigned int cap = job->xb_cap ? job->xb_cap * 2 : 2;
+        struct rdma_xbuf *v = krealloc(job->xb, cap * sizeof(*v), GFP_KERNEL);
+
+        if (!v) {
+            ret = -ENOMEM;
+            goto err;
+        }
+        job->xb = v;
+        job->xb_cap = cap;
+    }
+
+    xb = &job->xb[job->nxb];
+    memset(xb, 0, sizeof(*xb));
+    xb->dir = dir;
+    if (reg) {
+        xb->reg = reg;
+        xb->dbuf = reg->dbuf;
+        xb->sgt = reg->sgt;
+    } else {
+        ret = map_dmabuf_sg(rdma_dma_dev(), dbuf, &xb->att, &xb->sgt, dir);
+        if (ret)
+            goto err;
+        xb->dbuf = dbuf;
+    }
+    *out_idx = job->nxb++;
+    return 0;
+
+err:
+    if (reg)
+        kref_put(&reg->ref, rdma_reg_release);
+    else
+        dma_buf_put(dbuf);
+    return ret;
+}
+
+/* Process context only. */
+static void rdma_xbuf_put(struct rdma_xbuf *xb)
+{
+    if (xb->reg) {
+        kref_put(&xb->reg->ref, rdma_reg_release);
+    } else if (xb->dbuf) {
+        unmap_dmabuf_sg(xb->dbuf, xb->att, xb->sgt, xb->dir);
+        dma_buf_put(xb->dbuf);
+    }
+}
+
+static void rdma_job_unmap(struct rdma_job *job)
+{
+    unsigned int i;
+
+    rdma_chunks_free(&job->ck);
+    for (i = 0; i < job->nxb; i++)
+        rdma_xbuf_put(&job->xb[i]);
+    kfree(job->xb);
+    job->xb = NULL;
+    job->nxb = job->xb_cap = 0;
+}
+
+static struct rdma_job *rdma_job_alloc(void)
+{
+    struct rdma_job *job;
+
+    if (!rdma_nchans)
+        return ERR_PTR(-ENODEV);
+
+    job = kzalloc(sizeof(*job), GFP_KERNEL);
+    if (!job)
+        return ERR_PTR(-ENOMEM);
+    INIT_LIST_HEAD(&job->node);
+    init_completion(&job->done);
+    return job;
+}
 
-    if (!chan) { ret = -ENODEV; goto out; }
+#define RDMA_COPY_F_KNOWN (RDMA_COPY_F_SECURE | RDMA_COPY_F_SRC_HANDLE | RDMA_COPY_F_DST_HANDLE)
+
+/*
+ * Appends one copy to the job's chunk list. On failure the chunk list is
+ * left as it was; buffers resolved so far stay with the job until it ends.
+ * Unknown flag bits are rejected so they stay free for later meanings.
+ */
+static int rdma_job_add_copy(struct rdma_file *rf, struct rdma_job *job,
+                             const struct rdma_copy_req *req)
+{
+    unsigned int si, di, n0 = job->ck.n;
+    struct rdma_xbuf *src, *dst;
+    int ret;
+
+    if (req->size == 0 || (req->flags & ~RDMA_COPY_F_KNOWN))
+        return -EINVAL;
 
     /*
      * Secure-policy hook:
      * For true secure-copy you typically need vendor secure DMA channel / secure IOMMU domain.
      * Add vendor integration here if required.
      */
-    if (req.flags & 0x1) {
+    if (req->flags & RDMA_COPY_F_SECURE) {
         /* TODO: vendor_secure_dma_prepare(chan, ...); */
     }
 
-    src = dma_buf_get(req.src_dmabuf_fd);
-    if (IS_ERR(src)) { ret = PTR_ERR(src); src = NULL; goto out; }
+    ret = rdma_job_buf(rf, job, req->src_dmabuf_fd, req->flags & RDMA_COPY_F_SRC_HANDLE,
+                       DMA_TO_DEVICE, &si);
+    if (ret)
+        return ret;
+
+    ret = rdma_job_buf(rf, job, req->dst_dmabuf_fd, req->flags & RDMA_COPY_F_DST_HANDLE,
+                       DMA_FROM_DEVICE, &di);
+    if (ret)
+        return ret;
+
+    src = &job->xb[si];
+    dst = &job->xb[di];
+    if ((u64)req->src_offset + req->size > src->dbuf->size ||
+        (u64)req->dst_offset + req->size > dst->dbuf->size)
+        return -EINVAL;
+
+    ret = rdma_plan_copy(&job->ck, rdma_chans[0].ch, dst->sgt, req->dst_offset,
+                         src->sgt, req->src_offset, req->size);
+    if (ret)
+        job->ck.n = n0;
+    return ret;
+}
+
+static struct rdma_job *rdma_job_create(struct rdma_file *rf, const struct rdma_copy_req *req)
+{
+    struct rdma_job *job = rdma_job_alloc();
+    int ret;
+
+    if (IS_ERR(job))
+        return job;
+
+    ret = rdma_job_add_copy(rf, job, req);
+    if (ret) {
+        rdma_job_unmap(job);
+        kfree(job);
+        return ERR_PTR(ret);
+    }
+    return job;
+}
+
+static void rdma_job_work(struct work_struct *w)
+{
+    struct rdma_job *job = container_of(w, struct rdma_job, work);
+    struct rdma_file *rf = job->owner;
+    unsigned long irqf;
+
+    rdma_job_unmap(job);
+
+    spin_lock_irqsave(&rdma_active_lock, irqf);
+    list_del_init(&job->node);
+    spin_unlock_irqrestore(&rdma_active_lock, irqf);
+
+    spin_lock_irqsave(&rf->lock, irqf);
+    list_add_tail(&job->node, &rf->done);
+    spin_unlock_irqrestore(&rf->lock, irqf);
+    wake_up_all(&rf->wq);
+
+    mutex_lock(&rf->efd_lock);
+    if (rf->efd)
+        eventfd_signal(rf->efd, 1);
+    mutex_unlock(&rf->efd_lock);
+
+    /*
+     * Last touch of rf: release() may free it as soon as it observes
+     * pending == 0, which it can only do after this unlock.
+     */
+    spin_lock_irqsave(&rf->lock, irqf);
+    rf->pending--;
+    wake_up_all(&rf->wq);
+    spin_unlock_irqrestore(&rf->lock, irqf);
+}
+
+/* Any context. First caller wins; later calls for the same job are ignored. */
+static void rdma_job_finish(struct rdma_job *job, int status)
+{
+    if (test_and_set_bit(RDMA_JOB_FINISHED, &job->state))
+        return;
+    job->status = status;
+    if (job->owner)
+        schedule_work(&job->work);
+    else
+        complete(&job->done);
+}
+
+/* Channel accounting, any context. */
+static void rdma_chan_start(struct rdma_chan *rc, size_t bytes)
+{
+    unsigned long irqf;
+
+    spin_lock_irqsave(&rc->lock, irqf);
+    if (!rc->inflight++)
+        rc->busy_since = ktime_get_ns();
+    rc->inflight_bytes += bytes;
+    spin_unlock_irqrestore(&rc->lock, irqf);
+}
+
+static void rdma_chan_end(struct rdma_chan *rc, size_t bytes, bool ok)
+{
+    unsigned long irqf;
+
+    spin_lock_irqsave(&rc->lock, irqf);
+    rc->inflight_bytes -= bytes;
+    if (!--rc->inflight)
+        rc->busy_ns += ktime_get_ns() - rc->busy_since;
+    if (ok) {
+        rc->copies++;
+        rc->bytes += bytes;
+    }
+    spin_unlock_irqrestore(&rc->lock, irqf);
+}
+
+/* After dmaengine_terminate_sync(): the dropped stripes never call back. */
+static void rdma_chan_reset(struct rdma_chan *rc)
+{
+    unsigned long irqf;
+
+    spin_lock_irqsave(&rc->lock, irqf);
+    if (rc->inflight)
+        rc->busy_ns += ktime_get_ns() - rc->busy_since;
+    rc->inflight = 0;
+    rc->inflight_bytes = 0;
+    spin_unlock_irqrestore(&rc->lock, irqf);
+}
+
+/* Any context. Each stripe ends once, from its callback or from an abort. */
+static void rdma_stripe_end(struct rdma_stripe *st, int err)
+{
+    struct rdma_job *job = st->job;
+
+    if (test_and_set_bit(st - job->stripes, &job->stripes_done))
+        return;
+    if (err)
+        WRITE_ONCE(job->stripe_err, err);
+    if (atomic_dec_and_test(&job->stripes_left))
+        rdma_job_finish(job, READ_ONCE(job->stripe_err));
+}
+
+static void rdma_stripe_dma_cb(void *param, const struct dmaengine_result *res)
+{
+    struct rdma_stripe *st = param;
+    bool ok = !res || res->result == DMA_TRANS_NOERROR;
+
+    rdma_chan_end(st->rc, st->bytes, ok);
+    rdma_stripe_end(st, ok ? 0 : -EIO);
+}
+
+/*
+ * dmaengine_terminate_sync() drops every descriptor on the channel without
+ * running callbacks, so every stripe a listed job still had on one of the
+ * channels in chans (bit per rdma_chans index) is ended with status here.
+ * Jobs with stripes on other channels finish when those complete.
+ */
+static void rdma_abort_chans(unsigned long chans, int status)
+{
+    struct rdma_job *job;
+    unsigned long irqf;
+    unsigned int i;
+
+    spin_lock_irqsave(&rdma_active_lock, irqf);
+    list_for_each_entry(job, &rdma_active, node) {
+        for (i = 0; i < job->nstripes; i++)
+            if (chans & BIT(job->stripes[i].rc - rdma_chans))
+                rdma_stripe_end(&job->stripes[i], status);
+    }
+    spin_unlock_irqrestore(&rdma_active_lock, irqf);
+}
+
+/* Called with rdma_lock held. */
+static void rdma_terminate_chans(unsigned long chans, int status)
+{
+    unsigned int i;
+
+    BUILD_BUG_ON(RDMA_MAX_CHANNELS > BITS_PER_LONG);
+    for (i = 0; i < rdma_nchans; i++) {
+        if (!(chans & BIT(i)))
+            continue;
+        dmaengine_terminate_sync(rdma_chans[i].ch);
+        rdma_chan_reset(&rdma_chans[i]);
+    }
+    rdma_abort_chans(chans, status);
+}
+
+/* Channels the job still has a stripe in flight on. */
+static unsigned long rdma_job_chans(struct rdma_job *job)
+{
+    unsigned long chans = 0;
+    unsigned int i;
+
+    for (i = 0; i < job->nstripes; i++)
+        if (job->stripes[i].rc && !test_bit(i, &job->stripes_done))
+            chans |= BIT(job->stripes[i].rc - rdma_chans);
+    return chans;
+}
+
+/*
+ * Timeouts stop only the channels the stuck job has stripes on, so one
+ * client cannot fail every other process's queued copies. Jobs of others
+ * sharing those channels are still failed: terminating drops them too.
+ */
+static void rdma_terminate_job(struct rdma_job *job, int status)
+{
+    mutex_lock(&rdma_lock);
+    rdma_terminate_chans(rdma_job_chans(job), status);
+    mutex_unlock(&rdma_lock);
+}
+
+/* As rdma_terminate_job(), for every listed job of rf (async and fenced). */
+static void rdma_terminate_file(struct rdma_file *rf, int status)
+{
+    unsigned long chans = 0, irqf;
+    struct rdma_job *job;
+
+    mutex_lock(&rdma_lock);
+    spin_lock_irqsave(&rdma_active_lock, irqf);
+    list_for_each_entry(job, &rdma_active, node)
+        if (job->owner == rf)
+            chans |= rdma_job_chans(job);
+    spin_unlock_irqrestore(&rdma_active_lock, irqf);
+    rdma_terminate_chans(chans, status);
+    mutex_unlock(&rdma_lock);
+}
+
+/*
+ * A stripe whose chain failed part-way has no completion callback: what it
+ * did queue is waited for, so nothing targets the job's mappings once the
+ * stripe ends. Only if that wait fails is the channel terminated, failing
+ * whatever else it held. Caller holds rdma_lock.
+ */
+static void rdma_stripe_drain(struct rdma_stripe *st, dma_cookie_t last, int err)
+{
+    if (last && dma_sync_wait(st->rc->ch, last) != DMA_COMPLETE)
+        rdma_terminate_chans(BIT(st->rc - rdma_chans), err);
+    else
+        rdma_chan_end(st->rc, st->bytes, false);
+    rdma_stripe_end(st, err);
+}
+
+/*
+ * Cuts the job's chunk list into `want` stripes of about equal size. Cuts
+ * fall on page multiples of the copy offset, which keeps the pieces of a
+ * chunk as aligned as the chunk was (copy_align is at most a page).
+ */
+static int rdma_job_stripe(struct rdma_job *job, size_t total, unsigned int want)
+{
+    struct rdma_chunks out = { 0 };
+    size_t per = ALIGN(DIV_ROUND_UP(total, want), PAGE_SIZE);
+    size_t pos = 0, cut = per;
+    unsigned int i, s = 0;
+    int ret;
+
+    for (i = 0; i < job->ck.n; i++) {
+        struct rdma_chunk c = job->ck.v[i];
+
+        while (c.len) {
+            size_t len = c.len;
+
+            if (s + 1 < want && pos + len > cut)
+                len = cut - pos;
+            ret = rdma_chunks_push(&out, c.dst, c.src, len);
+            if (ret) {
+                rdma_chunks_free(&out);
+                return ret;
+            }
+            job->stripes[s].bytes += len;
+            c.dst += len;
+            c.src += len;
+            c.len -= len;
+            pos += len;
+            if (pos == cut && pos < total && s + 1 < want) {
+                job->stripes[s].n = out.n - job->stripes[s].first;
+                job->stripes[++s].first = out.n;
+                cut += per;
+            }
+        }
+    }
+    job->stripes[s].n = out.n - job->stripes[s].first;
+    job->nstripes = s + 1;
+
+    rdma_chunks_free(&job->ck);
+    job->ck = out;
+    return 0;
+}
+
+/* Least bytes in flight, ties broken round-robin. */
+static unsigned int rdma_pick_chan(unsigned int nch)
+{
+    unsigned int start = (unsigned int)atomic_inc_return(&rdma_rr) % nch;
+    unsigned int i, best = start;
+    u64 best_load = U64_MAX;
+
+    for (i = 0; i < nch; i++) {
+        unsigned int c = (start + i) % nch;
+        u64 load = READ_ONCE(rdma_chans[c].inflight_bytes);
 
-    dst = dma_buf_get(req.dst_dmabuf_fd);
-    if (IS_ERR(dst)) { ret = PTR_ERR(dst); dst = NULL; goto out; }
+        if (load < best_load) {
+            best_load = load;
+            best = c;
+        }
+    }
+    return best;
+}
 
-    ret = map_dmabuf_sg(chan->device->dev, src, &src_att, &src_sgt, DMA_TO_DEVICE);
-    if (ret) goto out;
+/*
+ * Puts the job in flight. Submission errors are reported through its
+ * completion. Striping replaces job->ck, so it is done before the job is
+ * listed and visible to rdma_abort_chans().
+ */
+static void rdma_job_submit(struct rdma_job *job)
+{
+    unsigned int nch = rdma_nchans_active(), want = 1, first, i;
+    unsigned long irqf;
+    size_t total = 0;
+    int ret = 0;
 
-    ret = map_dmabuf_sg(chan->device->dev, dst, &dst_att, &dst_sgt, DMA_FROM_DEVICE);
-    if (ret) goto out;
+    for (i = 0; i < job->ck.n; i++)
+        total += job->ck.v[i].len;
+    if (total >= READ_ONCE(rdma_stripe_min) && rdma_chans[0].ch->device->copy_align <= PAGE_SHIFT)
+        want = min_t(size_t, nch, total / PAGE_SIZE);
+    if (want > 1) {
+        ret = rdma_job_stripe(job, total, want);
+        if (ret) {
+            rdma_job_finish(job, ret);
+            return;
+        }
+    } else {
+        job->stripes[0].first = 0;
+        job->stripes[0].n = job->ck.n;
+        job->stripes[0].bytes = total;
+        job->nstripes = 1;
+    }
 
-    if (!src_sgt->sgl || !dst_sgt->sgl) { ret = -EINVAL; goto out; }
+    /*
+     * The extra count keeps a fast stripe callback from finishing the job
+     * before it is on rdma_active; it is dropped once the job is listed.
+     */
+    first = rdma_pick_chan(nch);
+    atomic_set(&job->stripes_left, job->nstripes + 1);
+    for (i = 0; i < job->nstripes; i++) {
+        job->stripes[i].job = job;
+        job->stripes[i].rc = &rdma_chans[(first + i) % nch];
+    }
 
     /*
-     * Simplification: use first SG entry only.
-     * Production: walk SG and handle offsets / chunking properly.
+     * A failed submission fails this job only: stripes already queued run
+     * to their callbacks, the failed one is drained, the rest end unsent,
+     * all with the error. The job is listed either way and finishes once
+     * its last queued stripe has.
      */
-    src_dma = sg_dma_address(src_sgt->sgl) + req.src_offset;
-    dst_dma = sg_dma_address(dst_sgt->sgl) + req.dst_offset;
+    mutex_lock(&rdma_lock);
+    for (i = 0; i < job->nstripes && !ret; i++) {
+        struct rdma_stripe *st = &job->stripes[i];
+        dma_cookie_t last;
+
+        rdma_chan_start(st->rc, st->bytes);
+        ret = rdma_submit_chunks(st->rc->ch, job->ck.v + st->first, st->n,
+                                 rdma_stripe_dma_cb, st, &last);
+        if (ret)
+            rdma_stripe_drain(st, last, ret);
+    }
+    for (; ret && i < job->nstripes; i++)
+        rdma_stripe_end(&job->stripes[i], ret);
+    spin_lock_irqsave(&rdma_active_lock, irqf);
+    list_add_tail(&job->node, &rdma_active);
+    spin_unlock_irqrestore(&rdma_active_lock, irqf);
+    mutex_unlock(&rdma_lock);
+
+    if (atomic_dec_and_test(&job->stripes_left))
+        rdma_job_finish(job, READ_ONCE(job->stripe_err));
+}
 
-    tx = dmaengine_prep_dma_memcpy(chan, dst_dma, src_dma, req.size,
-                                   DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
-    if (!tx) { ret = -EIO; goto out; }
+/* Submits a job, waits for it and frees it. Returns the job status. */
+static int rdma_job_run_sync(struct rdma_job *job)
+{
+    unsigned long irqf;
+    int ret;
 
-    tx->callback = rdma_dma_cb;
-    tx->callback_param = &done;
+    rdma_job_submit(job);
+    if (!wait_for_completion_timeout(&job->done, msecs_to_jiffies(2000))) {
+        rdma_terminate_job(job, -ETIMEDOUT);
+        wait_for_completion(&job->done);
+    }
 
-    cookie = dmaengine_submit(tx);
-    ret = dma_submit_error(cookie);
-    if (ret) goto out;
+    spin_lock_irqsave(&rdma_active_lock, irqf);
+    list_del_init(&job->node);
+    spin_unlock_irqrestore(&rdma_active_lock, irqf);
 
-    dma_async_issue_pending(chan);
+    ret = job->status;
+    rdma_job_unmap(job);
+    kfree(job);
+    return ret;
+}
 
-    if (!wait_for_completion_timeout(&done, msecs_to_jiffies(2000))) {
-        dmaengine_terminate_sync(chan);
-        ret = -ETIMEDOUT;
+static int rdma_copy_sync(struct rdma_file *rf, void __user *uarg)
+{
+    struct rdma_copy_req req;
+    struct rdma_job *job;
+
+    if (copy_from_user(&req, uarg, sizeof(req)))
+        return -EFAULT;
+
+    job = rdma_job_create(rf, &req);
+    if (IS_ERR(job))
+        return PTR_ERR(job);
+
+    return rdma_job_run_sync(job);
+}
+
+/*
+ * Vectored copy: every valid entry goes into one job, i.e. one descriptor
+ * chain with a single completion. Entries that fail validation get their
+ * errno in the status array and are skipped; the others get the outcome of
+ * the chain. Returns 0 only if every entry succeeded.
+ */
+static int rdma_copy_vec(struct rdma_file *rf, void __user *uarg)
+{
+    struct rdma_copy_vec v;
+    struct rdma_copy_req *reqs;
+    struct rdma_job *job;
+    s32 *status;
+    u32 i, ok = 0;
+    int ret;
+
+    if (copy_from_user(&v, uarg, sizeof(v)))
+        return -EFAULT;
+    if (v.count == 0 || v.count > RDMA_MAX_VEC || v.flags)
+        return -EINVAL;
+
+    reqs = kcalloc(v.count, sizeof(*reqs), GFP_KERNEL);
+    status = kcalloc(v.count, sizeof(*status), GFP_KERNEL);
+    if (!reqs || !status) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (copy_from_user(reqs, u64_to_user_ptr(v.reqs_ptr), v.count * sizeof(*reqs))) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    job = rdma_job_alloc();
+    if (IS_ERR(job)) {
+        ret = PTR_ERR(job);
         goto out;
     }
 
+    for (i = 0; i < v.count; i++) {
+        status[i] = rdma_job_add_copy(rf, job, &reqs[i]);
+        ok += status[i] == 0;
+    }
+
+    if (ok) {
+        ret = rdma_job_run_sync(job);
+        for (i = 0; i < v.count; i++)
+            if (status[i] == 0)
+                status[i] = ret;
+    } else {
+        rdma_job_unmap(job);
+        kfree(job);
+    }
+
+    ret = 0;
+    for (i = 0; i < v.count; i++)
+        if (status[i])
+            ret = -EIO;
+
+    if (copy_to_user(u64_to_user_ptr(v.status_ptr), status, v.count * sizeof(*status)))
+        ret = -EFAULT;
 out:
-    if (src_sgt && src_att) unmap_dmabuf_sg(src, src_att, src_sgt, DMA_TO_DEVICE);
-    if (dst_sgt && dst_att) unmap_dmabuf_sg(dst, dst_att, dst_sgt, DMA_FROM_DEVICE);
-    if (src) dma_buf_put(src);
-    if (dst) dma_buf_put(dst);
+    kfree(status);
+    kfree(reqs);
+    return ret;
+}
 
-    mutex_unlock(&rdma_lock);
+static int rdma_copy_submit(struct rdma_file *rf, void __user *uarg)
+{
+    struct rdma_submit_req req;
+    struct rdma_job *job;
+    unsigned long irqf;
+    bool full;
+
+    if (copy_from_user(&req, uarg, sizeof(req)))
+        return -EFAULT;
+
+    spin_lock_irqsave(&rf->lock, irqf);
+    full = rf->queued >= rdma_max_inflight;
+    if (!full) {
+        rf->queued++;
+        rf->pending++;
+        req.out_cookie = ++rf->next_cookie;
+    }
+    spin_unlock_irqrestore(&rf->lock, irqf);
+    if (full)
+        return -EBUSY;
+
+    job = rdma_job_create(rf, &req.copy);
+    if (IS_ERR(job)) {
+        spin_lock_irqsave(&rf->lock, irqf);
+        rf->queued--;
+        rf->pending--;
+        spin_unlock_irqrestore(&rf->lock, irqf);
+        return PTR_ERR(job);
+    }
+    job->owner = rf;
+    job->cookie = req.out_cookie;
+    INIT_WORK(&job->work, rdma_job_work);
+
+    /*
+     * Report the cookie before the job can complete so userspace never
+     * reads a completion it has no cookie for yet.
+     */
+    if (copy_to_user(uarg, &req, sizeof(req))) {
+        rdma_job_unmap(job);
+        kfree(job);
+        spin_lock_irqsave(&rf->lock, irqf);
+        rf->queued--;
+        rf->pending--;
+        spin_unlock_irqrestore(&rf->lock, irqf);
+        return -EFAULT;
+    }
+
+    rdma_job_submit(job);
+    return 0;
+}
+
+/*
+ * Every fenced copy gets a fence context of its own: copies striped over
+ * several channels finish out of order, which a shared timeline would not
+ * allow.
+ */
+static DEFINE_SPINLOCK(rdma_fence_lock);
+
+static const char *rdma_fence_driver_name(struct dma_fence *f)
+{
+    (void)f;
+    return "rdma_stub";
+}
+
+static const char *rdma_fence_timeline_name(struct dma_fence *f)
+{
+    (void)f;
+    return "copy";
+}
+
+static const struct dma_fence_ops rdma_fence_ops = {
+    .get_driver_name   = rdma_fence_driver_name,
+    .get_timeline_name = rdma_fence_timeline_name,
+};
+
+/* Completion of a fenced copy: the counterpart of rdma_job_work(). */
+static void rdma_fence_job_work(struct work_struct *w)
+{
+    struct rdma_job *job = container_of(w, struct rdma_job, work);
+    struct rdma_file *rf = job->owner;
+    unsigned long irqf;
+
+    /* Unmapped first: the unmap is what makes the data visible to the CPU. */
+    rdma_job_unmap(job);
+
+    spin_lock_irqsave(&rdma_active_lock, irqf);
+    list_del_init(&job->node);
+    spin_unlock_irqrestore(&rdma_active_lock, irqf);
+
+    if (job->status)
+        dma_fence_set_error(job->fence, job->status);
+    dma_fence_signal(job->fence);
+    dma_fence_put(job->fence);
+    kfree(job);
+
+    /* Last touch of rf, as in rdma_job_work(). */
+    spin_lock_irqsave(&rf->lock, irqf);
+    rf->fenced--;
+    rf->pending--;
+    wake_up_all(&rf->wq);
+    spin_unlock_irqrestore(&rf->lock, irqf);
+}
+
+/*
+ * Runs once the in-fence has signalled; nothing sleeps on it, so a fence
+ * that takes long (a static frame's display release) costs no kworker. A
+ * failed in-fence fails the copy with the same error: whatever wrote the
+ * source did not complete.
+ */
+static void rdma_job_start_work(struct work_struct *w)
+{
+    struct rdma_job *job = container_of(w, struct rdma_job, start_work);
+    struct rdma_file *rf = job->owner;
+    unsigned long irqf;
+    int err;
+
+    spin_lock_irqsave(&rf->lock, irqf);
+    list_del_init(&job->node);
+    spin_unlock_irqrestore(&rf->lock, irqf);
+
+    err = job->in_fence->error;
+    dma_fence_put(job->in_fence);
+    job->in_fence = NULL;
+    if (err) {
+        rdma_job_finish(job, err);
+        return;
+    }
+    rdma_job_submit(job);
+}
+
+/* Fence callback, any context (often under the signalling driver's lock). */
+static void rdma_job_in_fence_cb(struct dma_fence *f, struct dma_fence_cb *cb)
+{
+    struct rdma_job *job = container_of(cb, struct rdma_job, in_cb);
+
+    (void)f;
+    schedule_work(&job->start_work);
+}
+
+/*
+ * Fails the fenced jobs of rf still waiting on their in-fence, so one that
+ * never signals cannot hold up release(). Jobs whose callback has already
+ * run are on their way to submission and are left alone.
+ */
+static void rdma_cancel_waiting(struct rdma_file *rf, int status)
+{
+    struct rdma_job *job, *tmp;
+    unsigned long irqf;
+
+    spin_lock_irqsave(&rf->lock, irqf);
+    list_for_each_entry_safe(job, tmp, &rf->waiting, node) {
+        if (!dma_fence_remove_callback(job->in_fence, &job->in_cb))
+            continue;
+        list_del_init(&job->node);
+        dma_fence_put(job->in_fence);
+        job->in_fence = NULL;
+        rdma_job_finish(job, status);
+    }
+    spin_unlock_irqrestore(&rf->lock, irqf);
+}
+
+static int rdma_copy_fenced(struct rdma_file *rf, void __user *uarg)
+{
+    struct rdma_fence_req req;
+    struct dma_fence *in = NULL;
+    struct sync_file *sync;
+    struct rdma_job *job;
+    unsigned long irqf;
+    bool full;
+    int fd, ret;
+
+    if (copy_from_user(&req, uarg, sizeof(req)))
+        return -EFAULT;
+    if (req.in_fence_fd >= 0) {
+        in = sync_file_get_fence(req.in_fence_fd);
+        if (!in)
+            return -EINVAL;
+    }
+
+    spin_lock_irqsave(&rf->lock, irqf);
+    full = rf->fenced >= rdma_max_inflight;
+    if (!full) {
+        rf->fenced++;
+        rf->pending++;
+    }
+    spin_unlock_irqrestore(&rf->lock, irqf);
+    if (full) {
+        ret = -EBUSY;
+        goto err_in;
+    }
+
+    job = rdma_job_create(rf, &req.copy);
+    if (IS_ERR(job)) {
+        ret = PTR_ERR(job);
+        goto err_count;
+    }
+
+    job->fence = kzalloc(sizeof(*job->fence), GFP_KERNEL);
+    if (!job->fence) {
+        ret = -ENOMEM;
+        goto err_job;
+    }
+    dma_fence_init(job->fence, &rdma_fence_ops, &rdma_fence_lock, dma_fence_context_alloc(1), 1);
+
+    sync = sync_file_create(job->fence);
+    if (!sync) {
+        ret = -ENOMEM;
+        goto err_job;
+    }
+    fd = get_unused_fd_flags(O_CLOEXEC);
+    if (fd < 0) {
+        ret = fd;
+        goto err_sync;
+    }
+    req.out_fence_fd = fd;
+    if (copy_to_user(uarg, &req, sizeof(req))) {
+        put_unused_fd(fd);
+        ret = -EFAULT;
+        goto err_sync;
+    }
+    fd_install(fd, sync->file);
+
+    job->owner = rf;
+    INIT_WORK(&job->work, rdma_fence_job_work);
+    if (in) {
+        job->in_fence = in;
+        INIT_WORK(&job->start_work, rdma_job_start_work);
+        spin_lock_irqsave(&rf->lock, irqf);
+        list_add_tail(&job->node, &rf->waiting);
+        spin_unlock_irqrestore(&rf->lock, irqf);
+        /* -ENOENT: already signalled, start (or fail) it right here. */
+        if (dma_fence_add_callback(in, &job->in_cb, rdma_job_in_fence_cb))
+            rdma_job_start_work(&job->start_work);
+        return 0;
+    }
+    rdma_job_submit(job);
+    return 0;
+
+err_sync:
+    fput(sync->file);
+err_job:
+    if (job->fence)
+        dma_fence_put(job->fence); /* never published, so never signalled */
+    rdma_job_unmap(job);
+    kfree(job);
+err_count:
+    spin_lock_irqsave(&rf->lock, irqf);
+    rf->fenced--;
+    rf->pending--;
+    spin_unlock_irqrestore(&rf->lock, irqf);
+err_in:
+    dma_fence_put(in);
     return ret;
 }
 
+static int rdma_set_eventfd(struct rdma_file *rf, void __user *uarg)
+{
+    struct eventfd_ctx *ctx = NULL, *old;
+    __s32 fd;
+
+    if (copy_from_user(&fd, uarg, sizeof(fd)))
+        return -EFAULT;
+
+    if (fd >= 0) {
+        ctx = eventfd_ctx_fdget(fd);
+        if (IS_ERR(ctx))
+            return PTR_ERR(ctx);
+    }
+
+    mutex_lock(&rf->efd_lock);
+    old = rf->efd;
+    rf->efd = ctx;
+    mutex_unlock(&rf->efd_lock);
+
+    if (old)
+        eventfd_ctx_put(old);
+    return 0;
+}
+
+static int rdma_register_buf(struct rdma_file *rf, void __user *uarg)
+{
+    struct rdma_register_req req;
+    struct rdma_reg *reg;
+    int id;
+
+    if (copy_from_user(&req, uarg, sizeof(req)))
+        return -EFAULT;
+
+    reg = rdma_reg_create(req.dmabuf_fd);
+    if (IS_ERR(reg))
+        return PTR_ERR(reg);
+
+    mutex_lock(&rf->regs_lock);
+    id = idr_alloc(&rf->regs, reg, 1, 0, GFP_KERNEL);
+    mutex_unlock(&rf->regs_lock);
+    if (id < 0) {
+        kref_put(&reg->ref, rdma_reg_release);
+        return id;
+    }
+
+    req.out_handle = id;
+    if (copy_to_user(uarg, &req, sizeof(req))) {
+        mutex_lock(&rf->regs_lock);
+        idr_remove(&rf->regs, id);
+        mutex_unlock(&rf->regs_lock);
+        kref_put(&reg->ref, rdma_reg_release);
+        return -EFAULT;
+    }
+    return 0;
+}
+
+static int rdma_unregister_buf(struct rdma_file *rf, void __user *uarg)
+{
+    struct rdma_reg *reg;
+    __u32 handle;
+
+    if (copy_from_user(&handle, uarg, sizeof(handle)))
+        return -EFAULT;
+
+    mutex_lock(&rf->regs_lock);
+    reg = idr_remove(&rf->regs, handle);
+    mutex_unlock(&rf->regs_lock);
+    if (!reg)
+        return -ENOENT;
+
+    kref_put(&reg->ref, rdma_reg_release);
+    return 0;
+}
+
+static int rdma_get_stats(void __user *uarg)
+{
+    struct rdma_stats *st = kzalloc(sizeof(*st), GFP_KERNEL);
+    unsigned long irqf;
+    unsigned int i;
+    int ret = 0;
+
+    if (!st)
+        return -ENOMEM;
+    st->num_channels = rdma_nchans;
+    st->active_channels = rdma_nchans_active();
+    st->now_ns = ktime_get_ns();
+    for (i = 0; i < rdma_nchans; i++) {
+        struct rdma_chan *rc = &rdma_chans[i];
+        struct rdma_chan_stats *cs = &st->chans[i];
+
+        spin_lock_irqsave(&rc->lock, irqf);
+        cs->copies = rc->copies;
+        cs->bytes = rc->bytes;
+        cs->busy_ns = rc->busy_ns;
+        if (rc->inflight && st->now_ns > rc->busy_since)
+            cs->busy_ns += st->now_ns - rc->busy_since;
+        cs->inflight = rc->inflight;
+        spin_unlock_irqrestore(&rc->lock, irqf);
+    }
+    if (copy_to_user(uarg, st, sizeof(*st)))
+        ret = -EFAULT;
+    kfree(st);
+    return ret;
+}
+
+static long rdma_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
+{
+    struct rdma_file *rf = f->private_data;
+    void __user *uarg = (void __user *)arg;
+
+    if (_IOC_TYPE(cmd) != RDMA_IOC_MAGIC)
+        return -ENOTTY;
+
+    switch (cmd) {
+    case RDMA_IOC_COPY:
+        return rdma_copy_sync(rf, uarg);
+    case RDMA_IOC_COPY_V:
+        return rdma_copy_vec(rf, uarg);
+    case RDMA_IOC_SUBMIT:
+        return rdma_copy_submit(rf, uarg);
+    case RDMA_IOC_COPY_FENCED:
+        return rdma_copy_fenced(rf, uarg);
+    case RDMA_IOC_SET_EVENTFD:
+        return rdma_set_eventfd(rf, uarg);
+    case RDMA_IOC_REGISTER_BUF:
+        return rdma_register_buf(rf, uarg);
+    case RDMA_IOC_UNREGISTER_BUF:
+        return rdma_unregister_buf(rf, uarg);
+    case RDMA_IOC_GET_STATS:
+        return rdma_get_stats(uarg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* read(): drains finished jobs as struct rdma_completion records. */
+static ssize_t rdma_read(struct file *f, char __user *buf, size_t len, loff_t *ppos)
+{
+    struct rdma_file *rf = f->private_data;
+    struct rdma_completion c;
+    struct rdma_job *job;
+    unsigned long irqf;
+    ssize_t n = 0;
+    int ret;
+
+    (void)ppos;
+    if (len < sizeof(c))
+        return -EINVAL;
+
+    if (!(f->f_flags & O_NONBLOCK)) {
+        ret = wait_event_interruptible(rf->wq, !list_empty_careful(&rf->done));
+        if (ret)
+            return ret;
+    }
+
+    while (n + sizeof(c) <= len) {
+        spin_lock_irqsave(&rf->lock, irqf);
+        job = list_first_entry_or_null(&rf->done, struct rdma_job, node);
+        if (job) {
+            list_del(&job->node);
+            rf->queued--;
+        }
+        spin_unlock_irqrestore(&rf->lock, irqf);
+        if (!job)
+            break;
+
+        memset(&c, 0, sizeof(c));
+        c.cookie = job->cookie;
+        c.status = job->status;
+        kfree(job);
+
+        if (copy_to_user(buf + n, &c, sizeof(c)))
+            return n ? n : -EFAULT;
+        n += sizeof(c);
+    }
+
+    return n ? n : -EAGAIN;
+}
+
+static __poll_t rdma_poll(struct file *f, poll_table *pt)
+{
+    struct rdma_file *rf = f->private_data;
+
+    poll_wait(f, &rf->wq, pt);
+    return list_empty_careful(&rf->done) ? 0 : (EPOLLIN | EPOLLRDNORM);
+}
+
+static int rdma_open(struct inode *inode, struct file *f)
+{
+    struct rdma_file *rf = kzalloc(sizeof(*rf), GFP_KERNEL);
+
+    (void)inode;
+    if (!rf)
+        return -ENOMEM;
+    spin_lock_init(&rf->lock);
+    INIT_LIST_HEAD(&rf->done);
+    INIT_LIST_HEAD(&rf->waiting);
+    init_waitqueue_head(&rf->wq);
+    mutex_init(&rf->efd_lock);
+    mutex_init(&rf->regs_lock);
+    idr_init(&rf->regs);
+    f->private_data = rf;
+    return 0;
+}
+
+static bool rdma_file_idle(struct rdma_file *rf)
+{
+    unsigned long irqf;
+    bool idle;
+
+    spin_lock_irqsave(&rf->lock, irqf);
+    idle = rf->pending == 0;
+    spin_unlock_irqrestore(&rf->lock, irqf);
+    return idle;
+}
+
+static int rdma_release(struct inode *inode, struct file *f)
+{
+    struct rdma_file *rf = f->private_data;
+    struct rdma_job *job, *tmp;
+    struct rdma_reg *reg;
+    int id;
+
+    (void)inode;
+    /* Jobs reference rf until their work has run. */
+    if (!wait_event_timeout(rf->wq, rdma_file_idle(rf), msecs_to_jiffies(2000))) {
+        rdma_cancel_waiting(rf, -ETIMEDOUT);
+        rdma_terminate_file(rf, -ETIMEDOUT);
+    }
+    wait_event(rf->wq, rdma_file_idle(rf));
+
+    list_for_each_entry_safe(job, tmp, &rf->done, node)
+        kfree(job);
+    idr_for_each_entry(&rf->regs, reg, id)
+        kref_put(&reg->ref, rdma_reg_release);
+    idr_destroy(&rf->regs);
+    mutex_destroy(&rf->regs_lock);
+    if (rf->efd)
+        eventfd_ctx_put(rf->efd);
+    mutex_destroy(&rf->efd_lock);
+    kfree(rf);
+    return 0;
+}
+
 static const struct file_operations rdma_fops = {
     .owner          = THIS_MODULE,
+    .open           = rdma_open,
+    .release        = rdma_release,
+    .read           = rdma_read,
+    .poll           = rdma_poll,
     .unlocked_ioctl = rdma_ioctl,
 #ifdef CONFIG_COMPAT
     .compat_ioctl   = rdma_ioctl,
 #endif
 };
 
-static int __init rdma_init(void)
+static bool rdma_same_device(struct dma_chan *ch, void *param)
 {
-    int ret;
+    return ch->device == param;
+}
+
+static void rdma_release_channels(void)
+{
+    while (rdma_nchans)
+        dma_release_channel(rdma_chans[--rdma_nchans].ch);
+}
+
+static void rdma_request_channels(void)
+{
+    unsigned int want = clamp_t(unsigned int, rdma_channels, 1, RDMA_MAX_CHANNELS);
+    struct dma_chan *ch;
     dma_cap_mask_t mask;
 
     dma_cap_zero(mask);
     dma_cap_set(DMA_MEMCPY, mask);
 
-    chan = dma_request_channel(mask, NULL, NULL);
-    if (!chan)
+    ch = dma_request_channel(mask, NULL, NULL);
+    while (ch) {
+        spin_lock_init(&rdma_chans[rdma_nchans].lock);
+        rdma_chans[rdma_nchans++].ch = ch;
+        if (rdma_nchans == want)
+            break;
+        ch = dma_request_channel(mask, rdma_same_device, rdma_chans[0].ch->device);
+    }
+
+    if (!rdma_nchans)
         pr_warn("rdma_stub: no DMA_MEMCPY channel; /dev/rdma_stub0 will exist but COPY will fail\n");
+    else if (rdma_nchans < want)
+        pr_info("rdma_stub: %u of %u DMA_MEMCPY channels on %s\n", rdma_nchans, want,
+                dev_name(rdma_dma_dev()));
+}
+
+static int __init rdma_init(void)
+{
+    int ret;
+
+    rdma_request_channels();
 
     ret = alloc_chrdev_region(&rdma_dev, 0, 1, "rdma_stub");
-    if (ret) return ret;
+    if (ret) goto err_chan;
 
     cdev_init(&rdma_cdev, &rdma_fops);
     ret = cdev_add(&rdma_cdev, rdma_dev, 1);
@@ -183,12 +1650,14 @@ err_cdev:
     cdev_del(&rdma_cdev);
 err_chr:
     unregister_chrdev_region(rdma_dev, 1);
+err_chan:
+    rdma_release_channels();
     return ret;
 }
 
 static void __exit rdma_exit(void)
 {
-    if (chan) dma_release_channel(chan);
+    rdma_release_channels();
     device_destroy(rdma_class, rdma_dev);
     class_destroy(rdma_class);
     cdev_del(&rdma_cdev);
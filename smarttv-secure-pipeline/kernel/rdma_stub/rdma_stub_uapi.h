@@ -4,13 +4,108 @@
 
 #define RDMA_IOC_MAGIC 'R'
 
+enum rdma_copy_flags {
+    RDMA_COPY_F_SECURE     = 1u << 0,  /* secure-policy */
+    RDMA_COPY_F_SRC_HANDLE = 1u << 1,  /* src_dmabuf_fd is a registered handle */
+    RDMA_COPY_F_DST_HANDLE = 1u << 2,  /* dst_dmabuf_fd is a registered handle */
+};
+
 struct rdma_copy_req {
     __s32 src_dmabuf_fd;
     __s32 dst_dmabuf_fd;
     __u32 src_offset;
     __u32 dst_offset;
     __u32 size;
-    __u32 flags; /* bit0: secure-policy */
+    __u32 flags; /* rdma_copy_flags; other bits: EINVAL */
+};
+
+/*
+ * Vectored copy: up to RDMA_MAX_VEC requests run as one DMA chain with a
+ * single completion. status_ptr receives one status per entry (0 or a
+ * negative errno); invalid entries are skipped without failing the rest.
+ */
+#define RDMA_MAX_VEC 64
+
+struct rdma_copy_vec {
+    __u64 reqs_ptr;       /* user pointer to struct rdma_copy_req[count] */
+    __u64 status_ptr;     /* user pointer to __s32[count], written back */
+    __u32 count;
+    __u32 flags;          /* reserved, must be 0 (EINVAL otherwise) */
+};
+
+/*
+ * Keeps a dma-buf attached and mapped for this fd until unregistered or
+ * the fd is closed, so copies that name it by handle skip per-copy
+ * map/unmap. CPU writers still bracket access with DMA_BUF_IOCTL_SYNC.
+ */
+struct rdma_register_req {
+    __s32 dmabuf_fd;
+    __u32 out_handle;     /* returned, nonzero */
+};
+
+/*
+ * Asynchronous copies: RDMA_IOC_SUBMIT queues a copy and returns a cookie.
+ * Completions are read() from the device fd as struct rdma_completion
+ * records; the fd polls readable while any are pending, and an eventfd
+ * registered with RDMA_IOC_SET_EVENTFD is signalled once per completion.
+ * Submit fails with EBUSY while rdma_max_inflight copies are unreaped.
+ */
+struct rdma_submit_req {
+    struct rdma_copy_req copy;
+    __u64 out_cookie;     /* returned; matches rdma_completion.cookie */
+};
+
+struct rdma_completion {
+    __u64 cookie;
+    __s32 status;         /* 0 or negative errno */
+    __u32 reserved;
+};
+
+/*
+ * Fenced copies (explicit sync): RDMA_IOC_COPY_FENCED queues a copy and
+ * returns at once with a sync_file fd whose fence signals when the copy is
+ * done, with the fence error set if it failed. in_fence_fd (-1 for none) is
+ * a sync_file the copy waits for before it starts, e.g. the release fence
+ * of a display still reading the destination; it is not consumed. There
+ * is no limit on how long it may take; if it signals with an error, the
+ * copy is not run and fails with that error. No completion record is
+ * queued for read(). At most rdma_max_inflight fenced copies per open file
+ * may be unfinished (EBUSY beyond that).
+ */
+struct rdma_fence_req {
+    struct rdma_copy_req copy;
+    __s32 in_fence_fd;
+    __s32 out_fence_fd;   /* returned, O_CLOEXEC */
+};
+
+/*
+ * Per-channel counters (RDMA_IOC_GET_STATS). The module takes up to
+ * rdma_channels DMA channels; copies of rdma_stripe_min bytes or more are
+ * split into stripes that run on several channels at once. Utilization of
+ * a channel between two snapshots is delta busy_ns / delta now_ns.
+ */
+#define RDMA_MAX_CHANNELS 8
+
+struct rdma_chan_stats {
+    __u64 copies;         /* stripes (or unstriped copies) completed */
+    __u64 bytes;
+    __u64 busy_ns;        /* time with at least one stripe in flight */
+    __u32 inflight;
+    __u32 reserved;
+};
+
+struct rdma_stats {
+    __u32 num_channels;   /* channels taken at load */
+    __u32 active_channels; /* channels in use (rdma_active_channels) */
+    __u64 now_ns;         /* CLOCK_MONOTONIC of the snapshot */
+    struct rdma_chan_stats chans[RDMA_MAX_CHANNELS];
 };
 
-#define RDMA_IOC_COPY _IOW(RDMA_IOC_MAGIC, 1, struct rdma_copy_req)
+#define RDMA_IOC_COPY         _IOW(RDMA_IOC_MAGIC, 1, struct rdma_copy_req)
+#define RDMA_IOC_SUBMIT       _IOWR(RDMA_IOC_MAGIC, 2, struct rdma_submit_req)
+#define RDMA_IOC_SET_EVENTFD  _IOW(RDMA_IOC_MAGIC, 3, __s32)  /* -1 clears */
+#define RDMA_IOC_REGISTER_BUF _IOWR(RDMA_IOC_MAGIC, 4, struct rdma_register_req)
+#define RDMA_IOC_UNREGISTER_BUF _IOW(RDMA_IOC_MAGIC, 5, __u32)
+#define RDMA_IOC_COPY_V       _IOW(RDMA_IOC_MAGIC, 6, struct rdma_copy_vec)
+#define RDMA_IOC_GET_STATS    _IOR(RDMA_IOC_MAGIC, 7, struct rdma_stats)
+#define RDMA_IOC_COPY_FENCED  _IOWR(RDMA_IOC_MAGIC, 8, struct rdma_fence_req)
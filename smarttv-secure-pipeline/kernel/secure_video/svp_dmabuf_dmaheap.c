@@ -3,8 +3,12 @@
 #include <linux/dma-buf.h>
 #include <linux/dma-heap.h>
 #include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
 
 #include "svp_uapi.h"
+#include "svp_internal.h"
 
 /*
  * Vendor heap names vary. Common examples:
@@ -15,41 +19,183 @@
  */
 static char *svp_heap_name = "secure";
 module_param(svp_heap_name, charp, 0444);
-MODULE_PARM_DESC(svp_heap_name, "DMA-HEAP name used for secure video buffers");
+MODULE_PARM_DESC(svp_heap_name, "Default DMA-HEAP, for requests that name no heap");
 
-static size_t svp_calc_size(u32 w, u32 h, u32 fourcc)
+/*
+ * Defaults for requests that leave the alignment at 0. Set them to what the
+ * decoder and display engine need (e.g. 256-byte pitch, 32-row height).
+ */
+static uint svp_pitch_align = SVP_FMT_DEFAULT_PITCH_ALIGN;
+module_param(svp_pitch_align, uint, 0644);
+MODULE_PARM_DESC(svp_pitch_align, "Default plane pitch alignment in bytes (power of two)");
+
+static uint svp_height_align = SVP_FMT_DEFAULT_HEIGHT_ALIGN;
+module_param(svp_height_align, uint, 0644);
+MODULE_PARM_DESC(svp_height_align, "Default luma height alignment in rows (power of two)");
+
+int svp_dmabuf_layout(struct svp_alloc_req *req)
 {
-    (void)fourcc;
-    /* Demo: NV12 size approximation. Production: align stride/height to HW constraints. */
-    return (size_t)w * (size_t)h * 3 / 2;
+    u32 pitch_align = req->pitch_align ? req->pitch_align : READ_ONCE(svp_pitch_align);
+    u32 height_align = req->height_align ? req->height_align : READ_ONCE(svp_height_align);
+    int ret;
+
+    ret = svp_fmt_layout(req->fourcc, req->width, req->height, pitch_align, height_align,
+                         &req->out_layout);
+    if (ret)
+        pr_debug("svp: no layout for %ux%u fourcc 0x%08x align %u/%u\n",
+                 req->width, req->height, req->fourcc, pitch_align, height_align);
+    return ret;
 }
 
-int svp_dmabuf_alloc_export_fd(u32 w, u32 h, u32 fourcc, u32 flags, int *out_fd)
-{
+/*
+ * Heap handles are resolved once per name and held for the module lifetime,
+ * so the allocation path does not repeat dma_heap_find()/dma_heap_put().
+ * The svp_heap_name heap is resolved at load; other names on their first
+ * allocation, as is the default heap if the vendor heap registers after
+ * svp.ko loads. A name that is not found is not cached and is looked up
+ * again next time.
+ *
+ * Entries are only ever appended, under svp_heap_lock, and are immutable
+ * once svp_nheaps covers them, so lookups of a known name take no lock.
+ * The entry index is also the heap's slot in the per-heap statistics.
+ */
+struct svp_heap_entry {
+    char name[SVP_HEAP_NAME_LEN];
     struct dma_heap *heap;
-    struct dma_buf *dbuf;
-    size_t size;
-    int fd;
+};
 
-    if (!out_fd || w == 0 || h == 0)
-        return -EINVAL;
+static struct svp_heap_entry svp_heaps[SVP_STATS_MAX_HEAPS];
+static unsigned int svp_nheaps;
+static DEFINE_MUTEX(svp_heap_lock);
 
-    size = svp_calc_size(w, h, fourcc);
+static int svp_heap_find_cached(const char *name, unsigned int n)
+{
+    unsigned int i;
 
-    heap = dma_heap_find(svp_heap_name);
+    for (i = 0; i < n; i++)
+        if (!strcmp(svp_heaps[i].name, name))
+            return i;
+    return -ENOENT;
+}
+
+/*
+ * Returns the heap's entry index, or a negative errno. Misses are not
+ * cached and any opener of /dev/svp0 can name a heap, so lookups of a
+ * request's own heap_name only log at debug level; the module's default
+ * heap is configuration and is reported, rate limited.
+ */
+static int svp_heap_get(const char *name)
+{
+    bool dflt = !name || !name[0];
+    struct dma_heap *heap;
+    unsigned int n;
+    int idx;
+
+    if (dflt)
+        name = svp_heap_name;
+    idx = svp_heap_find_cached(name, smp_load_acquire(&svp_nheaps));
+    if (idx >= 0)
+        return idx;
+
+    mutex_lock(&svp_heap_lock);
+    n = svp_nheaps;
+    idx = svp_heap_find_cached(name, n);
+    if (idx >= 0)
+        goto out;
+    if (strlen(name) >= SVP_HEAP_NAME_LEN) {
+        idx = -EINVAL;
+        goto out;
+    }
+    if (n == SVP_STATS_MAX_HEAPS) {
+        pr_debug("svp: dma_heap '%s': already using %u heaps\n", name, n);
+        idx = -ENOSPC;
+        goto out;
+    }
+    heap = dma_heap_find(name);
     if (!heap) {
-        pr_err("svp: dma_heap '%s' not found\n", svp_heap_name);
-        return -ENODEV;
+        if (dflt)
+            pr_err_ratelimited("svp: dma_heap '%s' not found\n", name);
+        else
+            pr_debug("svp: dma_heap '%s' not found\n", name);
+        idx = -ENODEV;
+        goto out;
     }
+    strscpy(svp_heaps[n].name, name, sizeof(svp_heaps[n].name));
+    svp_heaps[n].heap = heap;
+    svp_stats_heap_add(n, name);
+    smp_store_release(&svp_nheaps, n + 1);
+    idx = n;
+out:
+    mutex_unlock(&svp_heap_lock);
+    return idx;
+}
+
+int svp_heap_init(void)
+{
+    if (svp_heap_get(NULL) < 0)
+        pr_warn("svp: heap '%s' not available yet; will retry on first alloc\n",
+                svp_heap_name);
+    return 0;
+}
+
+void svp_heap_exit(void)
+{
+    unsigned int i;
+
+    mutex_lock(&svp_heap_lock);
+    for (i = 0; i < svp_nheaps; i++) {
+        dma_heap_put(svp_heaps[i].heap);
+        svp_heaps[i].heap = NULL;
+    }
+    svp_nheaps = 0;
+    mutex_unlock(&svp_heap_lock);
+}
+
+struct dma_buf *svp_dmabuf_alloc(const struct svp_alloc_req *req)
+{
+    struct dma_buf *dbuf;
+    u64 t0;
+    int idx;
+
+    if (req->out_layout.size == 0)
+        return ERR_PTR(-EINVAL);
+    if (strnlen(req->heap_name, sizeof(req->heap_name)) == sizeof(req->heap_name))
+        return ERR_PTR(-EINVAL);
+
+    idx = svp_heap_get(req->heap_name);
+    if (idx < 0)
+        return ERR_PTR(idx);
 
     /* heap_flags is vendor-defined; 0 is typically OK */
-    dbuf = dma_heap_buffer_alloc(heap, size, O_RDWR | O_CLOEXEC, 0);
-    dma_heap_put(heap);
+    t0 = ktime_get_ns();
+    dbuf = dma_heap_buffer_alloc(svp_heaps[idx].heap, req->out_layout.size,
+                                 O_RDWR | O_CLOEXEC, 0);
+    svp_stats_heap_alloc(idx, ktime_get_ns() - t0, req->out_layout.size,
+                         PTR_ERR_OR_ZERO(dbuf));
+    if (IS_ERR(dbuf))
+        pr_err_ratelimited("svp: dma_heap '%s' alloc failed (%ld)\n", svp_heaps[idx].name,
+                           PTR_ERR(dbuf));
 
-    if (IS_ERR(dbuf)) {
-        pr_err("svp: dma_heap alloc failed (%ld)\n", PTR_ERR(dbuf));
+    /* flags are policy hints; secure enforcement is heap/platform-level. */
+    return dbuf;
+}
+
+int svp_dmabuf_alloc_export_fd(u32 w, u32 h, u32 fourcc, u32 flags, int *out_fd)
+{
+    struct svp_alloc_req req = { .width = w, .height = h, .fourcc = fourcc, .flags = flags };
+    struct dma_buf *dbuf;
+    int fd, ret;
+
+    if (!out_fd)
+        return -EINVAL;
+
+    ret = svp_dmabuf_layout(&req);
+    if (ret)
+        return ret;
+
+    dbuf = svp_dmabuf_alloc(&req);
+    if (IS_ERR(dbuf))
         return PTR_ERR(dbuf);
-    }
 
     fd = dma_buf_fd(dbuf, O_CLOEXEC);
     if (fd < 0) {
@@ -57,8 +203,6 @@ int svp_dmabuf_alloc_export_fd(u32 w, u32 h, u32 fourcc, u32 flags, int *out_fd)
         return fd;
     }
 
-    /* flags are policy hints; secure enforcement is heap/platform-level. */
-    (void)flags;
     *out_fd = fd;
     return 0;
 }
@@ -6,75 +6,563 @@
 #include <linux/uaccess.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/file.h>
+#include <linux/dma-buf.h>
+#include <linux/list.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include "svp_uapi.h"
-
-/* Alloc+export implemented in svp_dmabuf_dmaheap.c */
-extern int svp_dmabuf_alloc_export_fd(u32 w, u32 h, u32 fourcc, u32 flags, int *out_fd);
+#include "svp_internal.h"
 
 static dev_t svp_dev;
 static struct cdev svp_cdev;
 static struct class *svp_class;
-static DEFINE_MUTEX(svp_lock);
+/*
+ * Per-open state. Every allocation is tracked by a session of the file that
+ * made it; the session holds a dma-buf reference until the buffer is
+ * released, the session is closed or the file goes away. Session handle 0
+ * is the file's default session and exists for the file's lifetime.
+ *
+ * Locking: svp_file.lock only guards the session/buffer lists and the
+ * session counters. The heap allocation itself runs unlocked, so opens
+ * allocate in parallel. svp_files_lock guards the list of open files, which
+ * only the debugfs stats walk.
+ */
+struct svp_buf {
+    struct list_head node;
+    struct dma_buf *dbuf;
+};
 
-static long svp_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
+struct svp_session {
+    struct list_head node;
+    struct list_head bufs;
+    u32 handle;
+    u8 id[16];
+    u32 held_bufs, held_bufs_peak;
+    u64 held_bytes, held_bytes_peak;
+};
+
+struct svp_file {
+    struct list_head node;  /* in svp_files */
+    struct mutex lock;
+    struct list_head sessions;
+    u32 next_handle;
+    pid_t pid;
+    char comm[TASK_COMM_LEN];
+};
+
+static LIST_HEAD(svp_files);
+static DEFINE_MUTEX(svp_files_lock);
+
+static struct svp_session *svp_session_new(u32 handle)
 {
-    (void)f;
-    if (_IOC_TYPE(cmd) != SVP_IOC_MAGIC)
-        return -ENOTTY;
+    struct svp_session *sess = kzalloc(sizeof(*sess), GFP_KERNEL);
 
-    mutex_lock(&svp_lock);
+    if (!sess)
+        return NULL;
+    INIT_LIST_HEAD(&sess->bufs);
+    sess->handle = handle;
+    /* In production: tie this to OP-TEE session authorization (policy gate). */
+    get_random_bytes(sess->id, sizeof(sess->id));
+    svp_stats_session(1);
+    return sess;
+}
 
-    switch (cmd) {
-    case SVP_IOC_ALLOC_BUF: {
-        struct svp_alloc_req req;
-        int fd = -1, ret;
+/* Caller holds sf->lock, or owns the session exclusively. */
+static void svp_session_account(struct svp_session *sess, int bufs, s64 bytes)
+{
+    sess->held_bufs += bufs;
+    sess->held_bytes += bytes;
+    sess->held_bufs_peak = max(sess->held_bufs_peak, sess->held_bufs);
+    sess->held_bytes_peak = max(sess->held_bytes_peak, sess->held_bytes);
+    svp_stats_hold(bufs, bytes);
+}
+
+static void svp_session_free(struct svp_session *sess)
+{
+    struct svp_buf *b, *tmp;
+
+    list_for_each_entry_safe(b, tmp, &sess->bufs, node) {
+        list_del(&b->node);
+        svp_session_account(sess, -1, -(s64)b->dbuf->size);
+        dma_buf_put(b->dbuf);
+        kfree(b);
+    }
+    svp_stats_session(-1);
+    kfree(sess);
+}
 
-        if (copy_from_user(&req, (void __user *)arg, sizeof(req))) {
-            mutex_unlock(&svp_lock);
-            return -EFAULT;
+/* Caller holds sf->lock. */
+static struct svp_session *svp_session_find(struct svp_file *sf, u32 handle)
+{
+    struct svp_session *sess;
+
+    list_for_each_entry(sess, &sf->sessions, node)
+        if (sess->handle == handle)
+            return sess;
+    return NULL;
+}
+
+/*
+ * Takes a tracking reference on each buffer and links it to the session.
+ * Must run before the buffers' fds are installed. All-or-nothing.
+ */
+static int svp_track(struct svp_file *sf, u32 handle, struct dma_buf **bufs, u32 n)
+{
+    struct svp_session *sess;
+    struct svp_buf *b, *tmp;
+    LIST_HEAD(staged);
+    u64 bytes = 0;
+    u32 i;
+
+    for (i = 0; i < n; i++) {
+        b = kzalloc(sizeof(*b), GFP_KERNEL);
+        if (!b)
+            goto err;
+        b->dbuf = bufs[i];
+        bytes += bufs[i]->size;
+        list_add_tail(&b->node, &staged);
+    }
+
+    mutex_lock(&sf->lock);
+    sess = svp_session_find(sf, handle);
+    if (!sess) {
+        mutex_unlock(&sf->lock);
+        goto err_noent;
+    }
+    list_for_each_entry(b, &staged, node)
+        get_dma_buf(b->dbuf);
+    list_splice_tail(&staged, &sess->bufs);
+    svp_session_account(sess, n, bytes);
+    mutex_unlock(&sf->lock);
+    return 0;
+
+err_noent:
+    list_for_each_entry_safe(b, tmp, &staged, node)
+        kfree(b);
+    return -ENOENT;
+err:
+    list_for_each_entry_safe(b, tmp, &staged, node)
+        kfree(b);
+    return -ENOMEM;
+}
+
+/*
+ * Drops the tracking references taken by svp_track(). Returns how many of
+ * the n buffers were tracked by the session.
+ */
+static u32 svp_untrack(struct svp_file *sf, u32 handle, struct dma_buf **bufs, u32 n)
+{
+    struct svp_session *sess;
+    struct svp_buf *b, *tmp;
+    u32 i, found = 0;
+
+    mutex_lock(&sf->lock);
+    sess = svp_session_find(sf, handle);
+    for (i = 0; sess && i < n; i++) {
+        list_for_each_entry_safe(b, tmp, &sess->bufs, node) {
+            if (b->dbuf != bufs[i])
+                continue;
+            list_del(&b->node);
+            svp_session_account(sess, -1, -(s64)b->dbuf->size);
+            dma_buf_put(b->dbuf);
+            kfree(b);
+            found++;
+            break;
         }
+    }
+    mutex_unlock(&sf->lock);
+    return found;
+}
+
+/*
+ * struct svp_alloc_req has grown; callers built against an older uapi pass
+ * a shorter struct (usize, from the ioctl number or the batch entry_size).
+ * Missing input fields read as zero and only usize bytes are written back.
+ */
+static int svp_req_size_ok(u32 usize)
+{
+    BUILD_BUG_ON(offsetof(struct svp_alloc_req, heap_name) != SVP_ALLOC_REQ_SIZE_V2);
+    return usize >= SVP_ALLOC_REQ_SIZE_V1 && usize <= sizeof(struct svp_alloc_req);
+}
+
+static int svp_alloc_one(struct svp_file *sf, void __user *uarg, u32 usize)
+{
+    struct svp_alloc_req req = {};
+    struct dma_buf *dbuf;
+    int fd, ret;
+
+    if (!svp_req_size_ok(usize))
+        return -EINVAL;
+    if (copy_from_user(&req, uarg, usize))
+        return -EFAULT;
+
+    ret = svp_dmabuf_layout(&req);
+    if (ret)
+        return ret;
+
+    dbuf = svp_dmabuf_alloc(&req);
+    if (IS_ERR(dbuf))
+        return PTR_ERR(dbuf);
+
+    ret = svp_track(sf, req.session, &dbuf, 1);
+    if (ret)
+        goto err_put;
+
+    fd = get_unused_fd_flags(O_CLOEXEC);
+    if (fd < 0) {
+        ret = fd;
+        goto err_untrack;
+    }
+
+    req.out_dmabuf_fd = fd;
+    if (copy_to_user(uarg, &req, usize)) {
+        put_unused_fd(fd);
+        ret = -EFAULT;
+        goto err_untrack;
+    }
+
+    fd_install(fd, dbuf->file);
+    return 0;
+
+err_untrack:
+    svp_untrack(sf, req.session, &dbuf, 1);
+err_put:
+    dma_buf_put(dbuf);
+    return ret;
+}
 
-        ret = svp_dmabuf_alloc_export_fd(req.width, req.height, req.fourcc, req.flags, &fd);
-        if (ret) {
-            mutex_unlock(&svp_lock);
-            return ret;
+/*
+ * Batch allocation runs in phases so a failure leaves nothing behind:
+ * allocate every dma-buf, track them, reserve every fd and report them,
+ * then publish. fd_install() cannot be undone, so it only runs once
+ * nothing can fail. All entries must name the same session.
+ */
+static int svp_alloc_batch(struct svp_file *sf, void __user *uarg)
+{
+    struct svp_alloc_batch_req b;
+    struct svp_alloc_req *reqs = NULL;
+    struct dma_buf **bufs = NULL;
+    u8 __user *ureqs;
+    u32 i, esize, n_alloc = 0, n_fds = 0;
+    int ret;
+
+    if (copy_from_user(&b, uarg, sizeof(b)))
+        return -EFAULT;
+    esize = b.entry_size ? b.entry_size : SVP_ALLOC_REQ_SIZE_V1;
+    if (b.count == 0 || b.count > SVP_MAX_BATCH || !svp_req_size_ok(esize))
+        return -EINVAL;
+    ureqs = u64_to_user_ptr(b.reqs_ptr);
+
+    reqs = kcalloc(b.count, sizeof(*reqs), GFP_KERNEL);
+    bufs = kcalloc(b.count, sizeof(*bufs), GFP_KERNEL);
+    if (!reqs || !bufs) {
+        ret = -ENOMEM;
+        goto out_free;
+    }
+
+    for (i = 0; i < b.count; i++) {
+        if (copy_from_user(&reqs[i], ureqs + (size_t)i * esize, esize)) {
+            ret = -EFAULT;
+            goto out_free;
         }
+        if (reqs[i].session != reqs[0].session) {
+            ret = -EINVAL;
+            goto out_free;
+        }
+    }
 
-        req.out_dmabuf_fd = fd;
-        if (copy_to_user((void __user *)arg, &req, sizeof(req))) {
-            mutex_unlock(&svp_lock);
-            return -EFAULT;
+    for (i = 0; i < b.count; i++) {
+        ret = svp_dmabuf_layout(&reqs[i]);
+        if (ret)
+            goto out_put;
+        bufs[i] = svp_dmabuf_alloc(&reqs[i]);
+        if (IS_ERR(bufs[i])) {
+            ret = PTR_ERR(bufs[i]);
+            goto out_put;
         }
-        break;
-    }
-    case SVP_IOC_OPEN_SESSION: {
-        /* In production: tie this to OP-TEE session authorization (policy gate). */
-        struct svp_session_req s;
-        if (copy_from_user(&s, (void __user *)arg, sizeof(s))) {
-            mutex_unlock(&svp_lock);
-            return -EFAULT;
+        n_alloc++;
+    }
+
+    ret = svp_track(sf, reqs[0].session, bufs, b.count);
+    if (ret)
+        goto out_put;
+
+    for (i = 0; i < b.count; i++) {
+        ret = get_unused_fd_flags(O_CLOEXEC);
+        if (ret < 0)
+            goto out_fds;
+        reqs[i].out_dmabuf_fd = ret;
+        n_fds++;
+    }
+
+    for (i = 0; i < b.count; i++) {
+        if (copy_to_user(ureqs + (size_t)i * esize, &reqs[i], esize)) {
+            ret = -EFAULT;
+            goto out_fds;
         }
-        memset(s.session_id, 0xAB, sizeof(s.session_id)); /* demo token */
-        if (copy_to_user((void __user *)arg, &s, sizeof(s))) {
-            mutex_unlock(&svp_lock);
-            return -EFAULT;
+    }
+
+    /* Point of no return: each fd takes over the buffer's file reference. */
+    for (i = 0; i < b.count; i++)
+        fd_install(reqs[i].out_dmabuf_fd, bufs[i]->file);
+    ret = 0;
+    goto out_free;
+
+out_fds:
+    for (i = 0; i < n_fds; i++)
+        put_unused_fd(reqs[i].out_dmabuf_fd);
+    svp_untrack(sf, reqs[0].session, bufs, b.count);
+out_put:
+    for (i = 0; i < n_alloc; i++)
+        dma_buf_put(bufs[i]);
+out_free:
+    kfree(bufs);
+    kfree(reqs);
+    return ret;
+}
+
+static int svp_release_buf(struct svp_file *sf, void __user *uarg)
+{
+    struct svp_release_req req;
+    struct dma_buf *dbuf;
+    u32 found;
+
+    if (copy_from_user(&req, uarg, sizeof(req)))
+        return -EFAULT;
+
+    dbuf = dma_buf_get(req.dmabuf_fd);
+    if (IS_ERR(dbuf))
+        return PTR_ERR(dbuf);
+
+    found = svp_untrack(sf, req.session, &dbuf, 1);
+    dma_buf_put(dbuf);
+    return found ? 0 : -ENOENT;
+}
+
+static int svp_open_session(struct svp_file *sf, void __user *uarg)
+{
+    struct svp_session_req s;
+    struct svp_session *sess;
+
+    if (copy_from_user(&s, uarg, sizeof(s)))
+        return -EFAULT;
+
+    mutex_lock(&sf->lock);
+    sess = svp_session_new(++sf->next_handle);
+    if (sess)
+        list_add_tail(&sess->node, &sf->sessions);
+    mutex_unlock(&sf->lock);
+    if (!sess)
+        return -ENOMEM;
+
+    memcpy(s.session_id, sess->id, sizeof(s.session_id));
+    s.handle = sess->handle;
+    if (copy_to_user(uarg, &s, sizeof(s)))
+        return -EFAULT; /* session stays open; released with the file */
+    return 0;
+}
+
+static int svp_close_session(struct svp_file *sf, void __user *uarg)
+{
+    struct svp_session_req s;
+    struct svp_session *sess;
+
+    if (copy_from_user(&s, uarg, sizeof(s)))
+        return -EFAULT;
+    if (s.handle == 0)
+        return -EINVAL; /* default session lives as long as the file */
+
+    mutex_lock(&sf->lock);
+    sess = svp_session_find(sf, s.handle);
+    if (sess && memcmp(sess->id, s.session_id, sizeof(sess->id)) == 0)
+        list_del(&sess->node);
+    else
+        sess = NULL;
+    mutex_unlock(&sf->lock);
+
+    if (!sess)
+        return -ENOENT;
+    svp_session_free(sess);
+    return 0;
+}
+
+static int svp_get_stats(struct svp_file *sf, void __user *uarg)
+{
+    struct svp_stats_req *req;
+    struct svp_session_stats *ss = NULL;
+    struct svp_session *sess;
+    u32 n = 0, max;
+    int ret = 0;
+
+    req = kzalloc(sizeof(*req), GFP_KERNEL);
+    if (!req)
+        return -ENOMEM;
+    if (copy_from_user(req, uarg, sizeof(*req))) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    max = req->sessions_ptr ? min_t(u32, req->max_sessions, SVP_STATS_MAX_SESSIONS) : 0;
+    if (max) {
+        ss = kcalloc(max, sizeof(*ss), GFP_KERNEL);
+        if (!ss) {
+            ret = -ENOMEM;
+            goto out;
         }
-        break;
     }
+
+    mutex_lock(&sf->lock);
+    list_for_each_entry(sess, &sf->sessions, node) {
+        if (n < max) {
+            ss[n].handle = sess->handle;
+            ss[n].held_bufs = sess->held_bufs;
+            ss[n].held_bytes = sess->held_bytes;
+            ss[n].held_bufs_peak = sess->held_bufs_peak;
+            ss[n].held_bytes_peak = sess->held_bytes_peak;
+        }
+        n++;
+    }
+    mutex_unlock(&sf->lock);
+
+    svp_stats_get(&req->stats);
+    req->num_sessions = n;
+    if (max && copy_to_user(u64_to_user_ptr(req->sessions_ptr), ss,
+                            min(n, max) * sizeof(*ss))) {
+        ret = -EFAULT;
+        goto out;
+    }
+    if (copy_to_user(uarg, req, sizeof(*req)))
+        ret = -EFAULT;
+out:
+    kfree(ss);
+    kfree(req);
+    return ret;
+}
+
+static int svp_get_heap_stats(void __user *uarg)
+{
+    struct svp_heap_stats_req *req;
+    int ret = 0;
+
+    req = kzalloc(sizeof(*req), GFP_KERNEL);
+    if (!req)
+        return -ENOMEM;
+    svp_stats_get_heaps(req);
+    if (copy_to_user(uarg, req, sizeof(*req)))
+        ret = -EFAULT;
+    kfree(req);
+    return ret;
+}
+
+void svp_show_sessions(struct seq_file *m)
+{
+    struct svp_session *sess;
+    struct svp_file *sf;
+
+    mutex_lock(&svp_files_lock);
+    list_for_each_entry(sf, &svp_files, node) {
+        mutex_lock(&sf->lock);
+        list_for_each_entry(sess, &sf->sessions, node)
+            seq_printf(m, "  %d %s %u %u %llu %u %llu\n", sf->pid, sf->comm, sess->handle,
+                       sess->held_bufs, sess->held_bytes, sess->held_bufs_peak,
+                       sess->held_bytes_peak);
+        mutex_unlock(&sf->lock);
+    }
+    mutex_unlock(&svp_files_lock);
+}
+
+static int svp_open(struct inode *inode, struct file *f)
+{
+    struct svp_file *sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+    struct svp_session *def;
+
+    (void)inode;
+    if (!sf)
+        return -ENOMEM;
+
+    mutex_init(&sf->lock);
+    INIT_LIST_HEAD(&sf->sessions);
+
+    def = svp_session_new(0);
+    if (!def) {
+        kfree(sf);
+        return -ENOMEM;
+    }
+    list_add_tail(&def->node, &sf->sessions);
+
+    sf->pid = task_tgid_nr(current);
+    get_task_comm(sf->comm, current);
+    mutex_lock(&svp_files_lock);
+    list_add_tail(&sf->node, &svp_files);
+    mutex_unlock(&svp_files_lock);
+
+    f->private_data = sf;
+    return 0;
+}
+
+static int svp_release(struct inode *inode, struct file *f)
+{
+    struct svp_file *sf = f->private_data;
+    struct svp_session *sess, *tmp;
+
+    (void)inode;
+    mutex_lock(&svp_files_lock);
+    list_del(&sf->node);
+    mutex_unlock(&svp_files_lock);
+
+    list_for_each_entry_safe(sess, tmp, &sf->sessions, node) {
+        list_del(&sess->node);
+        svp_session_free(sess);
+    }
+    mutex_destroy(&sf->lock);
+    kfree(sf);
+    return 0;
+}
+
+static int svp_alloc_counted(int ret)
+{
+    if (ret)
+        svp_stats_alloc_failed(ret);
+    return ret;
+}
+
+static long svp_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
+{
+    struct svp_file *sf = f->private_data;
+    void __user *uarg = (void __user *)arg;
+
+    if (_IOC_TYPE(cmd) != SVP_IOC_MAGIC)
+        return -ENOTTY;
+
+    /* Any size of struct svp_alloc_req a caller may have been built with. */
+    if (_IOC_NR(cmd) == _IOC_NR(SVP_IOC_ALLOC_BUF) &&
+        _IOC_DIR(cmd) == (_IOC_READ | _IOC_WRITE))
+        return svp_alloc_counted(svp_alloc_one(sf, uarg, _IOC_SIZE(cmd)));
+
+    switch (cmd) {
+    case SVP_IOC_ALLOC_BUF_BATCH:
+        return svp_alloc_counted(svp_alloc_batch(sf, uarg));
+    case SVP_IOC_GET_STATS:
+        return svp_get_stats(sf, uarg);
+    case SVP_IOC_GET_HEAP_STATS:
+        return svp_get_heap_stats(uarg);
+    case SVP_IOC_RELEASE_BUF:
+        return svp_release_buf(sf, uarg);
+    case SVP_IOC_OPEN_SESSION:
+        return svp_open_session(sf, uarg);
     case SVP_IOC_CLOSE_SESSION:
-        /* no-op in scaffold */
-        break;
+        return svp_close_session(sf, uarg);
     default:
-        mutex_unlock(&svp_lock);
         return -ENOTTY;
     }
-
-    mutex_unlock(&svp_lock);
-    return 0;
 }
 
 static const struct file_operations svp_fops = {
     .owner          = THIS_MODULE,
+    .open           = svp_open,
+    .release        = svp_release,
     .unlocked_ioctl = svp_ioctl,
 #ifdef CONFIG_COMPAT
     .compat_ioctl   = svp_ioctl,
@@ -87,6 +575,9 @@ static int __init svp_init(void)
     if (ret)
         return ret;
 
+    svp_heap_init();
+    svp_stats_init();
+
     cdev_init(&svp_cdev, &svp_fops);
     ret = cdev_add(&svp_cdev, svp_dev, 1);
     if (ret)
@@ -106,6 +597,8 @@ err_cdev:
     cdev_del(&svp_cdev);
 err_chr:
     unregister_chrdev_region(svp_dev, 1);
+    svp_stats_exit();
+    svp_heap_exit();
     return ret;
 }
 
@@ -115,6 +608,8 @@ static void __exit svp_exit(void)
     class_destroy(svp_class);
     cdev_del(&svp_cdev);
     unregister_chrdev_region(svp_dev, 1);
+    svp_stats_exit();
+    svp_heap_exit();
     pr_info("svp: unloaded\n");
 }
 
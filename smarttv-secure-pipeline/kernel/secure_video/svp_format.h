@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#pragma once
+/*
+ * Plane layout of SVP buffers, shared by svp.ko and userspace so both agree
+ * byte for byte on what an allocation of a given format looks like. Plain
+ * C for the kernel; in C++ the table and helpers are constexpr.
+ *
+ * Every plane's pitch is rounded up to pitch_align bytes and the luma
+ * height to height_align rows (and to the chroma subsampling), then the
+ * planes are laid out back to back. Both alignments must be powers of two.
+ */
+#include <linux/errno.h>
+#include <linux/types.h>
+
+#ifdef __cplusplus
+#define SVP_FMT_CONST static constexpr
+#define SVP_FMT_FN    static constexpr inline
+#else
+#define SVP_FMT_CONST static const
+#define SVP_FMT_FN    static inline
+#endif
+
+#define SVP_MAX_PLANES 3
+
+#define SVP_FMT_MAX_DIM          16384
+#define SVP_FMT_MAX_PITCH_ALIGN  4096
+#define SVP_FMT_MAX_HEIGHT_ALIGN 256
+
+/* svp.ko module parameter defaults; also what userspace backends use. */
+#define SVP_FMT_DEFAULT_PITCH_ALIGN  64
+#define SVP_FMT_DEFAULT_HEIGHT_ALIGN 16
+
+/* Same values as DRM_FORMAT_* (drm_fourcc.h). */
+#define SVP_FOURCC(a, b, c, d) \
+    ((__u32)(a) | ((__u32)(b) << 8) | ((__u32)(c) << 16) | ((__u32)(d) << 24))
+#define SVP_FMT_NV12     SVP_FOURCC('N', 'V', '1', '2')
+#define SVP_FMT_NV21     SVP_FOURCC('N', 'V', '2', '1')
+#define SVP_FMT_P010     SVP_FOURCC('P', '0', '1', '0')
+#define SVP_FMT_YUV420   SVP_FOURCC('Y', 'U', '1', '2')
+#define SVP_FMT_ARGB8888 SVP_FOURCC('A', 'R', '2', '4')
+#define SVP_FMT_XRGB8888 SVP_FOURCC('X', 'R', '2', '4')
+
+struct svp_format_info {
+    __u32 fourcc;
+    __u8  num_planes;
+    __u8  hsub;                 /* horizontal subsampling of planes 1.. */
+    __u8  vsub;                 /* vertical subsampling of planes 1.. */
+    __u8  cpp[SVP_MAX_PLANES];  /* bytes per (subsampled) pixel, per plane */
+};
+
+SVP_FMT_CONST struct svp_format_info svp_formats[] = {
+    { SVP_FMT_NV12,     2, 2, 2, { 1, 2, 0 } },  /* Y, interleaved CbCr */
+    { SVP_FMT_NV21,     2, 2, 2, { 1, 2, 0 } },  /* Y, interleaved CrCb */
+    { SVP_FMT_P010,     2, 2, 2, { 2, 4, 0 } },  /* 10 bits in 16, MSB aligned */
+    { SVP_FMT_YUV420,   3, 2, 2, { 1, 1, 1 } },  /* Y, Cb, Cr */
+    { SVP_FMT_ARGB8888, 1, 1, 1, { 4, 0, 0 } },
+    { SVP_FMT_XRGB8888, 1, 1, 1, { 4, 0, 0 } },
+};
+
+/* Where each plane of a buffer starts and how far apart its rows are. */
+struct svp_layout {
+    __u32 num_planes;
+    __u32 pitches[SVP_MAX_PLANES];  /* bytes per row; 0 for unused planes */
+    __u32 offsets[SVP_MAX_PLANES];  /* from the start of the buffer */
+    __u32 reserved;
+    __u64 size;                     /* bytes the planes span */
+};
+
+SVP_FMT_FN const struct svp_format_info *svp_format_find(__u32 fourcc)
+{
+    unsigned int i = 0;
+
+    for (; i < sizeof(svp_formats) / sizeof(svp_formats[0]); i++)
+        if (svp_formats[i].fourcc == fourcc)
+            return &svp_formats[i];
+    return 0;
+}
+
+SVP_FMT_FN int svp_fmt_valid_align(__u32 align, __u32 max)
+{
+    return align != 0 && align <= max && (align & (align - 1)) == 0;
+}
+
+SVP_FMT_FN __u64 svp_fmt_align(__u64 v, __u32 align)
+{
+    return (v + align - 1) & ~(__u64)(align - 1);
+}
+
+/*
+ * Fills *out for a width x height buffer of fourcc. Returns 0, or -EINVAL
+ * for an unknown format, a zero or oversized dimension, or an alignment that
+ * is not a power of two within its limit.
+ */
+SVP_FMT_FN int svp_fmt_layout(__u32 fourcc, __u32 width, __u32 height, __u32 pitch_align,
+                              __u32 height_align, struct svp_layout *out)
+{
+    const struct svp_format_info *fi = svp_format_find(fourcc);
+    __u64 offset = 0;
+    __u32 w = 0, h = 0;
+    unsigned int p = 0;
+
+    if (!fi || width == 0 || height == 0 ||
+        width > SVP_FMT_MAX_DIM || height > SVP_FMT_MAX_DIM ||
+        !svp_fmt_valid_align(pitch_align, SVP_FMT_MAX_PITCH_ALIGN) ||
+        !svp_fmt_valid_align(height_align, SVP_FMT_MAX_HEIGHT_ALIGN))
+        return -EINVAL;
+
+    /* Chroma planes cover whole luma pixel pairs. 32-bit math: no do_div(). */
+    w = (__u32)svp_fmt_align(width, fi->hsub);
+    h = (__u32)svp_fmt_align(svp_fmt_align(height, height_align), fi->vsub);
+
+    out->num_planes = fi->num_planes;
+    out->reserved = 0;
+    for (p = 0; p < SVP_MAX_PLANES; p++) {
+        out->pitches[p] = 0;
+        out->offsets[p] = 0;
+    }
+    for (p = 0; p < fi->num_planes; p++) {
+        __u32 cols = p ? w / fi->hsub : w;
+        __u32 rows = p ? h / fi->vsub : h;
+        __u32 pitch = (__u32)svp_fmt_align((__u64)cols * fi->cpp[p], pitch_align);
+
+        out->pitches[p] = pitch;
+        out->offsets[p] = (__u32)offset;
+        offset += (__u64)pitch * rows;
+    }
+    out->size = offset;
+    return 0;
+}
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#pragma once
+#include <linux/types.h>
+
+struct dma_buf;
+struct seq_file;
+struct svp_alloc_req;
+struct svp_heap_stats_req;
+struct svp_stats;
+
+/* Implemented in svp_dmabuf_dmaheap.c */
+int svp_heap_init(void);
+void svp_heap_exit(void);
+/* Fills req->out_layout; zero alignments take the module parameters. */
+int svp_dmabuf_layout(struct svp_alloc_req *req);
+/* Allocates req->out_layout.size bytes from req->heap_name ("" = default). */
+struct dma_buf *svp_dmabuf_alloc(const struct svp_alloc_req *req);
+
+/* Implemented in svp_stats.c */
+void svp_stats_init(void);
+void svp_stats_exit(void);
+/* heap: svp_dmabuf_dmaheap.c entry index, named once by svp_stats_heap_add(). */
+void svp_stats_heap_add(unsigned int heap, const char *name);
+void svp_stats_heap_alloc(unsigned int heap, u64 ns, u64 size, int err);
+void svp_stats_alloc_failed(int err);
+void svp_stats_hold(int bufs, s64 bytes);  /* negative when sessions drop buffers */
+void svp_stats_session(int delta);
+void svp_stats_get(struct svp_stats *out);
+void svp_stats_get_heaps(struct svp_heap_stats_req *out);
+
+/* Implemented in svp_drv.c: one line per session of every open file. */
+void svp_show_sessions(struct seq_file *m);
+int svp_dmabuf_alloc_export_fd(u32 w, u32 h, u32 fourcc, u32 flags, int *out_fd);
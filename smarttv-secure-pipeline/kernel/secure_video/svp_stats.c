@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "svp_uapi.h"
+#include "svp_internal.h"
+
+/*
+ * Module-wide allocation counters. A single spinlock: each update is a few
+ * additions made once per buffer, noise next to the heap allocation itself.
+ * Per-session counters live in the sessions (svp_drv.c). Per-heap ones are
+ * indexed like the heap cache in svp_dmabuf_dmaheap.c; svp_nheap_stats
+ * covers the entries svp_stats_heap_add() has named.
+ */
+static struct svp_stats svp_stats;
+static struct svp_heap_stats svp_heap_stats[SVP_STATS_MAX_HEAPS];
+static unsigned int svp_nheap_stats;
+static DEFINE_SPINLOCK(svp_stats_lock);
+static struct dentry *svp_debugfs_dir;
+
+void svp_stats_heap_add(unsigned int heap, const char *name)
+{
+    if (heap >= SVP_STATS_MAX_HEAPS)
+        return;
+    spin_lock(&svp_stats_lock);
+    strscpy(svp_heap_stats[heap].name, name, sizeof(svp_heap_stats[heap].name));
+    svp_nheap_stats = max(svp_nheap_stats, heap + 1);
+    spin_unlock(&svp_stats_lock);
+}
+
+void svp_stats_heap_alloc(unsigned int heap, u64 ns, u64 size, int err)
+{
+    struct svp_heap_stats *hs = heap < SVP_STATS_MAX_HEAPS ? &svp_heap_stats[heap] : NULL;
+    u64 us = div_u64(ns, NSEC_PER_USEC);
+    unsigned int bucket = 0;
+
+    if (us)
+        bucket = min_t(unsigned int, ilog2(us), SVP_STATS_LAT_BUCKETS - 1);
+
+    spin_lock(&svp_stats_lock);
+    svp_stats.lat_hist[bucket]++;
+    svp_stats.lat_total_ns += ns;
+    if (ns > svp_stats.lat_max_ns)
+        svp_stats.lat_max_ns = ns;
+    if (!err) {
+        svp_stats.allocs++;
+        svp_stats.alloc_bytes += size;
+    }
+    if (hs) {
+        hs->lat_hist[bucket]++;
+        hs->lat_total_ns += ns;
+        if (ns > hs->lat_max_ns)
+            hs->lat_max_ns = ns;
+        if (err) {
+            hs->failures++;
+        } else {
+            hs->allocs++;
+            hs->alloc_bytes += size;
+        }
+    }
+    spin_unlock(&svp_stats_lock);
+}
+
+void svp_stats_alloc_failed(int err)
+{
+    unsigned int e = err < 0 ? -err : err;
+
+    spin_lock(&svp_stats_lock);
+    svp_stats.failures++;
+    svp_stats.fail_errno[e < SVP_STATS_ERRNO_SLOTS ? e : 0]++;
+    spin_unlock(&svp_stats_lock);
+}
+
+void svp_stats_hold(int bufs, s64 bytes)
+{
+    spin_lock(&svp_stats_lock);
+    svp_stats.held_bufs += bufs;
+    svp_stats.held_bytes += bytes;
+    if (bufs < 0)
+        svp_stats.released += -bufs;
+    svp_stats.held_bufs_peak = max(svp_stats.held_bufs_peak, svp_stats.held_bufs);
+    svp_stats.held_bytes_peak = max(svp_stats.held_bytes_peak, svp_stats.held_bytes);
+    spin_unlock(&svp_stats_lock);
+}
+
+void svp_stats_session(int delta)
+{
+    spin_lock(&svp_stats_lock);
+    svp_stats.sessions += delta;
+    spin_unlock(&svp_stats_lock);
+}
+
+void svp_stats_get(struct svp_stats *out)
+{
+    spin_lock(&svp_stats_lock);
+    *out = svp_stats;
+    spin_unlock(&svp_stats_lock);
+}
+
+void svp_stats_get_heaps(struct svp_heap_stats_req *out)
+{
+    spin_lock(&svp_stats_lock);
+    out->num_heaps = svp_nheap_stats;
+    memcpy(out->heaps, svp_heap_stats, sizeof(out->heaps));
+    spin_unlock(&svp_stats_lock);
+}
+
+static u64 svp_lat_attempts(const u64 *hist)
+{
+    u64 n = 0;
+    unsigned int i;
+
+    for (i = 0; i < SVP_STATS_LAT_BUCKETS; i++)
+        n += hist[i];
+    return n;
+}
+
+static void svp_show_lat_hist(struct seq_file *m, const u64 *hist)
+{
+    unsigned int i;
+
+    for (i = 0; i < SVP_STATS_LAT_BUCKETS; i++) {
+        if (!hist[i])
+            continue;
+        if (i == SVP_STATS_LAT_BUCKETS - 1)
+            seq_printf(m, "  >= %7lu us: %llu\n", 1ul << i, hist[i]);
+        else
+            seq_printf(m, "  < %8lu us: %llu\n", 2ul << i, hist[i]);
+    }
+}
+
+static void svp_show_heaps(struct seq_file *m, const struct svp_heap_stats_req *hr)
+{
+    const struct svp_heap_stats *hs;
+    u64 attempts;
+    unsigned int i;
+
+    for (i = 0; i < hr->num_heaps; i++) {
+        hs = &hr->heaps[i];
+        attempts = svp_lat_attempts(hs->lat_hist);
+        seq_printf(m, "heap %s: %llu allocs (%llu bytes), %llu failed, "
+                   "latency avg %llu us, max %llu us\n", hs->name, hs->allocs,
+                   hs->alloc_bytes, hs->failures,
+                   attempts ? div64_u64(hs->lat_total_ns, attempts * NSEC_PER_USEC) : 0,
+                   div_u64(hs->lat_max_ns, NSEC_PER_USEC));
+        svp_show_lat_hist(m, hs->lat_hist);
+    }
+}
+
+static int svp_stats_show(struct seq_file *m, void *unused)
+{
+    struct svp_stats *st = kmalloc(sizeof(*st), GFP_KERNEL);
+    struct svp_heap_stats_req *hr = kmalloc(sizeof(*hr), GFP_KERNEL);
+    u64 attempts;
+    unsigned int i;
+
+    (void)unused;
+    if (!st || !hr) {
+        kfree(st);
+        kfree(hr);
+        return -ENOMEM;
+    }
+    svp_stats_get(st);
+    svp_stats_get_heaps(hr);
+
+    seq_printf(m, "allocs:     %llu (%llu bytes)\n", st->allocs, st->alloc_bytes);
+    seq_printf(m, "held:       %llu bufs, %llu bytes (peak %llu bufs, %llu bytes)\n",
+               st->held_bufs, st->held_bytes, st->held_bufs_peak, st->held_bytes_peak);
+    seq_printf(m, "released:   %llu\n", st->released);
+    seq_printf(m, "sessions:   %llu\n", st->sessions);
+    seq_printf(m, "failures:   %llu\n", st->failures);
+    for (i = 0; i < SVP_STATS_ERRNO_SLOTS; i++)
+        if (st->fail_errno[i])
+            seq_printf(m, "  errno %s%u: %llu\n", i ? "" : ">=", i ? i : SVP_STATS_ERRNO_SLOTS,
+                       st->fail_errno[i]);
+
+    attempts = svp_lat_attempts(st->lat_hist);
+    seq_printf(m, "heap alloc latency: avg %llu us, max %llu us\n",
+               attempts ? div64_u64(st->lat_total_ns, attempts * NSEC_PER_USEC) : 0,
+               div_u64(st->lat_max_ns, NSEC_PER_USEC));
+    svp_show_lat_hist(m, st->lat_hist);
+    svp_show_heaps(m, hr);
+    kfree(st);
+    kfree(hr);
+
+    seq_puts(m, "per session (pid comm handle held_bufs held_bytes peak_bufs peak_bytes):\n");
+    svp_show_sessions(m);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(svp_stats);
+
+void svp_stats_init(void)
+{
+    /* debugfs is best effort; the ioctl works without it. */
+    svp_debugfs_dir = debugfs_create_dir("svp", NULL);
+    debugfs_create_file("stats", 0444, svp_debugfs_dir, NULL, &svp_stats_fops);
+}
+
+void svp_stats_exit(void)
+{
+    debugfs_remove_recursive(svp_debugfs_dir);
+    svp_debugfs_dir = NULL;
+}
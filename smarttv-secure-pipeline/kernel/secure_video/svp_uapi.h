@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 #pragma once
 #include <linux/types.h>
+#include "svp_format.h"
 
 #define SVP_IOC_MAGIC 'S'
 
@@ -9,20 +10,129 @@ enum svp_buf_flags {
     SVP_BUF_CPU_NOACCESS = 1u << 1,  /* disallow CPU mapping (policy) */
 };
 
+/* DMA-HEAP name as in /dev/dma_heap/, NUL-terminated. */
+#define SVP_HEAP_NAME_LEN 32
+
+/*
+ * The buffer is sized from the format table in svp_format.h; the layout it
+ * was allocated with is returned so importers need not guess strides.
+ */
 struct svp_alloc_req {
     __u32 width;
     __u32 height;
-    __u32 fourcc;         /* DRM_FORMAT_* fourcc, e.g. 'NV12' */
+    __u32 fourcc;         /* DRM_FORMAT_* fourcc, e.g. 'NV12' (svp_formats[]) */
     __u32 flags;          /* svp_buf_flags */
-    __u32 reserved;
+    __u32 session;        /* svp_session_req.handle; 0 = the fd's default session */
     __s32 out_dmabuf_fd;  /* returned to userspace */
+    /* Fields below were added later; older callers pass the struct up to here. */
+    __u32 pitch_align;    /* bytes, power of two; 0 = svp_pitch_align parameter */
+    __u32 height_align;   /* rows, power of two; 0 = svp_height_align parameter */
+    struct svp_layout out_layout; /* returned: planes, pitches, offsets, size */
+    char heap_name[SVP_HEAP_NAME_LEN]; /* e.g. "secure", "cma"; "" = svp_heap_name parameter */
+};
+
+/* sizeof(struct svp_alloc_req) before pitch/height alignment and the layout. */
+#define SVP_ALLOC_REQ_SIZE_V1 24
+/* sizeof(struct svp_alloc_req) before heap_name: always the default heap. */
+#define SVP_ALLOC_REQ_SIZE_V2 72
+
+/* Max entries per SVP_IOC_ALLOC_BUF_BATCH call. */
+#define SVP_MAX_BATCH 32
+
+/*
+ * Allocates count buffers in one call. All-or-nothing: either every entry
+ * gets a valid out_dmabuf_fd, or none does and no fd is installed.
+ */
+struct svp_alloc_batch_req {
+    __u32 count;          /* entries at reqs_ptr, 1..SVP_MAX_BATCH */
+    __u32 entry_size;     /* sizeof(struct svp_alloc_req); 0 = SVP_ALLOC_REQ_SIZE_V1 */
+    __u64 reqs_ptr;       /* user pointer to count entries of entry_size bytes */
 };
 
+/*
+ * Sessions are per open file. Buffers allocated in a session stay
+ * referenced by the driver until released, or until the session is
+ * closed or the file is released.
+ */
 struct svp_session_req {
-    __u8  session_id[16]; /* opaque */
+    __u8  session_id[16]; /* opaque, returned by OPEN_SESSION */
+    __u32 handle;         /* returned by OPEN_SESSION; pass back to CLOSE */
+};
+
+/* Drops the session's reference on a buffer (the fd itself stays valid). */
+struct svp_release_req {
+    __u32 session;
+    __s32 dmabuf_fd;
+};
+
+/*
+ * Allocation statistics (SVP_IOC_GET_STATS, also /sys/kernel/debug/svp/stats).
+ * "Held" buffers are the ones a session still references: allocated and not
+ * yet released, closed with their session or dropped with their file.
+ */
+#define SVP_STATS_LAT_BUCKETS 20  /* [i]: heap alloc took [2^i, 2^(i+1)) us; last open-ended */
+#define SVP_STATS_ERRNO_SLOTS 64  /* [e]: failures with errno e; [0]: errno >= 64 */
+#define SVP_STATS_MAX_SESSIONS 256 /* sessions copied out per call, at most */
+#define SVP_STATS_MAX_HEAPS 8     /* distinct heaps the module allocates from */
+
+struct svp_stats {
+    __u64 allocs;         /* successful heap allocations */
+    __u64 alloc_bytes;
+    __u64 released;       /* held buffers dropped by sessions */
+    __u64 failures;       /* failed ALLOC_BUF / ALLOC_BUF_BATCH calls */
+    __u64 held_bufs;
+    __u64 held_bytes;
+    __u64 held_bufs_peak;
+    __u64 held_bytes_peak;
+    __u64 sessions;       /* open sessions, default sessions included */
+    __u64 lat_total_ns;   /* over every heap allocation attempt */
+    __u64 lat_max_ns;
+    __u64 lat_hist[SVP_STATS_LAT_BUCKETS];
+    __u64 fail_errno[SVP_STATS_ERRNO_SLOTS];
+};
+
+/*
+ * Per-heap allocation counters (SVP_IOC_GET_HEAP_STATS), one entry per heap
+ * name the module has resolved, in the order they were first used. Latency
+ * covers every dma_heap_buffer_alloc() attempt on that heap.
+ */
+struct svp_heap_stats {
+    char name[SVP_HEAP_NAME_LEN];
+    __u64 allocs;         /* successful allocations */
+    __u64 alloc_bytes;
+    __u64 failures;       /* failed dma_heap_buffer_alloc() calls */
+    __u64 lat_total_ns;
+    __u64 lat_max_ns;
+    __u64 lat_hist[SVP_STATS_LAT_BUCKETS];
+};
+
+struct svp_heap_stats_req {
+    __u32 num_heaps;      /* returned: valid entries in heaps[] */
     __u32 reserved;
+    struct svp_heap_stats heaps[SVP_STATS_MAX_HEAPS];
+};
+
+struct svp_session_stats {
+    __u32 handle;
+    __u32 held_bufs;
+    __u64 held_bytes;
+    __u32 held_bufs_peak;
+    __u32 reserved;
+    __u64 held_bytes_peak;
+};
+
+struct svp_stats_req {
+    struct svp_stats stats;  /* returned: module-wide */
+    __u64 sessions_ptr;      /* user pointer to struct svp_session_stats[max_sessions], or 0 */
+    __u32 max_sessions;
+    __u32 num_sessions;      /* returned: the calling file's sessions (may exceed max_sessions) */
 };
 
+/* Also accepted with the size of any earlier struct svp_alloc_req. */
 #define SVP_IOC_ALLOC_BUF     _IOWR(SVP_IOC_MAGIC, 1, struct svp_alloc_req)
 #define SVP_IOC_OPEN_SESSION  _IOWR(SVP_IOC_MAGIC, 2, struct svp_session_req)
 #define SVP_IOC_CLOSE_SESSION _IOW(SVP_IOC_MAGIC, 3, struct svp_session_req)
+#define SVP_IOC_ALLOC_BUF_BATCH _IOWR(SVP_IOC_MAGIC, 4, struct svp_alloc_batch_req)
+#define SVP_IOC_RELEASE_BUF   _IOW(SVP_IOC_MAGIC, 5, struct svp_release_req)
+#define SVP_IOC_GET_STATS     _IOWR(SVP_IOC_MAGIC, 6, struct svp_stats_req)
+#define SVP_IOC_GET_HEAP_STATS _IOR(SVP_IOC_MAGIC, 7, struct svp_heap_stats_req)
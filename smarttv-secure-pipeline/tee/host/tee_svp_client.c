@@ -5,11 +5,15 @@
 
 #include "../ta/ta_svp_uuid.h"
 
-#define CMD_IMPORT_KEYBLOB 0x0003
-
 struct tee_svp {
     TEEC_Context ctx;
     TEEC_Session sess;
+    tee_svp_shm_t* batch;  /* allocated on first tee_svp_invoke_batch */
+};
+
+struct tee_svp_shm {
+    tee_svp_t* owner;
+    TEEC_SharedMemory shm;
 };
 
 tee_svp_t* tee_svp_open(void)
@@ -39,24 +43,163 @@ fail:
 void tee_svp_close(tee_svp_t* c)
 {
     if (!c) return;
+    tee_svp_shm_release(c->batch);
     TEEC_CloseSession(&c->sess);
     TEEC_FinalizeContext(&c->ctx);
     free(c);
 }
 
+int tee_svp_invoke(tee_svp_t* c, uint32_t cmd, const void* data, size_t len)
+{
+    if (!c || (!data && len)) return -1;
+
+    TEEC_Operation op;
+    uint32_t err_origin = 0;
+    memset(&op, 0, sizeof(op));
+
+    if (len) {
+        op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+                                        TEEC_NONE, TEEC_NONE, TEEC_NONE);
+        op.params[0].tmpref.buffer = (void*)data;
+        op.params[0].tmpref.size = len;
+    } else {
+        op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    }
+
+    TEEC_Result r = TEEC_InvokeCommand(&c->sess, cmd, &op, &err_origin);
+    return (r == TEEC_SUCCESS) ? 0 : -2;
+}
+
 int tee_svp_import_keyblob(tee_svp_t* c, const void* blob, size_t blob_len)
 {
-    if (!c || !blob || blob_len == 0) return -1;
+    if (!blob || blob_len == 0) return -1;
+    return tee_svp_invoke(c, TA_SVP_CMD_IMPORT_KEYBLOB, blob, blob_len);
+}
+
+static tee_svp_shm_t* shm_new(tee_svp_t* c, void* buf, size_t size, int allocate)
+{
+    if (!c || size == 0 || (!allocate && !buf)) return NULL;
+
+    tee_svp_shm_t* s = (tee_svp_shm_t*)calloc(1, sizeof(*s));
+    if (!s) return NULL;
+
+    s->owner = c;
+    s->shm.buffer = buf;
+    s->shm.size = size;
+    s->shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+
+    TEEC_Result r = allocate ? TEEC_AllocateSharedMemory(&c->ctx, &s->shm)
+                             : TEEC_RegisterSharedMemory(&c->ctx, &s->shm);
+    if (r != TEEC_SUCCESS) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+tee_svp_shm_t* tee_svp_shm_alloc(tee_svp_t* c, size_t size)
+{
+    return shm_new(c, NULL, size, 1);
+}
+
+tee_svp_shm_t* tee_svp_shm_register(tee_svp_t* c, void* buf, size_t size)
+{
+    return shm_new(c, buf, size, 0);
+}
+
+void tee_svp_shm_release(tee_svp_shm_t* shm)
+{
+    if (!shm) return;
+    TEEC_ReleaseSharedMemory(&shm->shm);
+    free(shm);
+}
+
+void* tee_svp_shm_data(tee_svp_shm_t* shm)
+{
+    return shm ? shm->shm.buffer : NULL;
+}
+
+size_t tee_svp_shm_size(const tee_svp_shm_t* shm)
+{
+    return shm ? shm->shm.size : 0;
+}
+
+int tee_svp_invoke_shm(tee_svp_t* c, uint32_t cmd, tee_svp_shm_t* shm,
+                       size_t offset, size_t len, enum tee_svp_shm_dir dir)
+{
+    if (!c || !shm || shm->owner != c || len == 0) return -1;
+    if (offset > shm->shm.size || len > shm->shm.size - offset) return -1;
+
+    uint32_t type;
+    switch (dir) {
+    case TEE_SVP_SHM_IN:    type = TEEC_MEMREF_PARTIAL_INPUT; break;
+    case TEE_SVP_SHM_OUT:   type = TEEC_MEMREF_PARTIAL_OUTPUT; break;
+    case TEE_SVP_SHM_INOUT: type = TEEC_MEMREF_PARTIAL_INOUT; break;
+    default: return -1;
+    }
 
     TEEC_Operation op;
     uint32_t err_origin = 0;
     memset(&op, 0, sizeof(op));
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-                                    TEEC_NONE, TEEC_NONE, TEEC_NONE);
-    op.params[0].tmpref.buffer = (void*)blob;
-    op.params[0].tmpref.size = blob_len;
+    op.paramTypes = TEEC_PARAM_TYPES(type, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    op.params[0].memref.parent = &shm->shm;
+    op.params[0].memref.offset = offset;
+    op.params[0].memref.size = len;
 
-    TEEC_Result r = TEEC_InvokeCommand(&c->sess, CMD_IMPORT_KEYBLOB, &op, &err_origin);
+    TEEC_Result r = TEEC_InvokeCommand(&c->sess, cmd, &op, &err_origin);
     return (r == TEEC_SUCCESS) ? 0 : -2;
 }
+
+int tee_svp_import_keyblob_shm(tee_svp_t* c, tee_svp_shm_t* shm, size_t offset, size_t len)
+{
+    return tee_svp_invoke_shm(c, TA_SVP_CMD_IMPORT_KEYBLOB, shm, offset, len, TEE_SVP_SHM_IN);
+}
+
+#define BATCH_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+int tee_svp_invoke_batch(tee_svp_t* c, struct tee_svp_cmd* cmds, size_t count)
+{
+    if (!c || !cmds || count == 0 || count > TA_SVP_BATCH_MAX_CMDS) return -1;
+
+    /* Each len is checked against what is left, so a huge one cannot wrap size. */
+    size_t size = sizeof(struct ta_svp_batch_hdr) + count * sizeof(struct ta_svp_batch_entry);
+    for (size_t i = 0; i < count; i++) {
+        if (!cmds[i].data && cmds[i].len) return -1;
+        size = BATCH_ALIGN(size);
+        if (size > TA_SVP_BATCH_MAX_SIZE || cmds[i].len > TA_SVP_BATCH_MAX_SIZE - size) return -1;
+        size += cmds[i].len;
+    }
+
+    if (!c->batch) {
+        c->batch = tee_svp_shm_alloc(c, TA_SVP_BATCH_MAX_SIZE);
+        if (!c->batch) return -2;
+    }
+
+    uint8_t* buf = (uint8_t*)tee_svp_shm_data(c->batch);
+    struct ta_svp_batch_hdr* hdr = (struct ta_svp_batch_hdr*)buf;
+    struct ta_svp_batch_entry* ents = (struct ta_svp_batch_entry*)(hdr + 1);
+    size_t off = sizeof(*hdr) + count * sizeof(*ents);
+
+    hdr->count = (uint32_t)count;
+    hdr->reserved = 0;
+    for (size_t i = 0; i < count; i++) {
+        off = BATCH_ALIGN(off);
+        ents[i].cmd = cmds[i].cmd;
+        ents[i].offset = (uint32_t)off;
+        ents[i].len = (uint32_t)cmds[i].len;
+        ents[i].result = TA_SVP_BATCH_NOT_RUN;
+        if (cmds[i].len) memcpy(buf + off, cmds[i].data, cmds[i].len);
+        off += cmds[i].len;
+    }
+
+    if (tee_svp_invoke_shm(c, TA_SVP_CMD_BATCH, c->batch, 0, size, TEE_SVP_SHM_INOUT) != 0)
+        return -2;
+
+    int rc = 0;
+    for (size_t i = 0; i < count; i++) {
+        cmds[i].result = ents[i].result;
+        if (cmds[i].result != TEEC_SUCCESS) rc = -3;
+    }
+    return rc;
+}
@@ -1,15 +1,72 @@
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
+
+#include "../ta/ta_svp_cmds.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct tee_svp tee_svp_t;
+typedef struct tee_svp_shm tee_svp_shm_t;
 
 tee_svp_t* tee_svp_open(void);
 void tee_svp_close(tee_svp_t* c);
+/*
+ * One TA command (TA_SVP_CMD_*) with an optional input payload, passed as
+ * TEEC_MEMREF_TEMP_INPUT. Returns 0, -1 on bad arguments, -2 if the TEE call
+ * or the command failed.
+ */
+int tee_svp_invoke(tee_svp_t* c, uint32_t cmd, const void* data, size_t len);
 int tee_svp_import_keyblob(tee_svp_t* c, const void* blob, size_t blob_len);
 
+struct tee_svp_cmd {
+    uint32_t cmd;       /* TA_SVP_CMD_*, not TA_SVP_CMD_BATCH */
+    const void* data;   /* optional input payload */
+    size_t len;
+    uint32_t result;    /* out: TEEC result, or TA_SVP_BATCH_NOT_RUN */
+};
+
+/*
+ * Runs up to TA_SVP_BATCH_MAX_CMDS commands in order inside the TA with a
+ * single world switch (TA_SVP_CMD_BATCH), stopping at the first failure.
+ * Payloads are packed into a session-owned shared buffer, so nothing is
+ * allocated per call. Returns 0 if every command succeeded, -1 on bad
+ * arguments (or more than TA_SVP_BATCH_MAX_SIZE bytes packed), -2 if the
+ * TEE call failed, -3 if a command failed (see each result).
+ */
+int tee_svp_invoke_batch(tee_svp_t* c, struct tee_svp_cmd* cmds, size_t count);
+
+/*
+ * Shared memory that stays registered with the TEE for the lifetime of the
+ * handle. Commands on it pass TEEC_MEMREF_PARTIAL_* references, so libteec
+ * does not allocate and copy a bounce buffer per invoke as it does for
+ * tee_svp_import_keyblob(). Release every buffer before tee_svp_close().
+ */
+/* TEEC_AllocateSharedMemory: the TEE driver owns the pages. */
+tee_svp_shm_t* tee_svp_shm_alloc(tee_svp_t* c, size_t size);
+/* TEEC_RegisterSharedMemory: buf must outlive the handle. */
+tee_svp_shm_t* tee_svp_shm_register(tee_svp_t* c, void* buf, size_t size);
+void tee_svp_shm_release(tee_svp_shm_t* shm);
+void* tee_svp_shm_data(tee_svp_shm_t* shm);
+size_t tee_svp_shm_size(const tee_svp_shm_t* shm);
+
+enum tee_svp_shm_dir {
+    TEE_SVP_SHM_IN    = 1,
+    TEE_SVP_SHM_OUT   = 2,
+    TEE_SVP_SHM_INOUT = 3,
+};
+
+/*
+ * Invokes TA command `cmd` with [offset, offset + len) of shm as its only
+ * parameter. Returns 0, -1 on bad arguments, -2 if the TEE call failed.
+ */
+int tee_svp_invoke_shm(tee_svp_t* c, uint32_t cmd, tee_svp_shm_t* shm,
+                       size_t offset, size_t len, enum tee_svp_shm_dir dir);
+/* tee_svp_import_keyblob() for a blob already placed in shm. */
+int tee_svp_import_keyblob_shm(tee_svp_t* c, tee_svp_shm_t* shm, size_t offset, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,59 @@
+#pragma once
+/*
+ * Just enough of the GlobalPlatform TEE Internal Core API to build
+ * ta/ta_svp.c into the mock libteec, which then runs the TA in-process.
+ * Values match optee_os.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEE_SUCCESS                 0x00000000
+#define TEE_ERROR_GENERIC           0xFFFF0000
+#define TEE_ERROR_BAD_PARAMETERS    0xFFFF0006
+#define TEE_ERROR_NOT_SUPPORTED     0xFFFF000A
+#define TEE_ERROR_OUT_OF_MEMORY     0xFFFF000C
+
+#define TEE_PARAM_TYPE_NONE             0
+#define TEE_PARAM_TYPE_VALUE_INPUT      1
+#define TEE_PARAM_TYPE_VALUE_OUTPUT     2
+#define TEE_PARAM_TYPE_VALUE_INOUT      3
+#define TEE_PARAM_TYPE_MEMREF_INPUT     5
+#define TEE_PARAM_TYPE_MEMREF_OUTPUT    6
+#define TEE_PARAM_TYPE_MEMREF_INOUT     7
+
+#define TEE_PARAM_TYPES(t0, t1, t2, t3) \
+    ((t0) | ((t1) << 4) | ((t2) << 8) | ((t3) << 12))
+#define TEE_PARAM_TYPE_GET(t, i) (((t) >> ((i) * 4)) & 0xF)
+
+#define TEE_MALLOC_FILL_ZERO 0x00000000
+
+typedef uint32_t TEE_Result;
+
+typedef union {
+    struct {
+        void *buffer;
+        size_t size;
+    } memref;
+    struct {
+        uint32_t a;
+        uint32_t b;
+    } value;
+} TEE_Param;
+
+static inline void *TEE_Malloc(size_t size, uint32_t hint)
+{
+    (void)hint;
+    return calloc(1, size ? size : 1);
+}
+
+static inline void TEE_Free(void *p) { free(p); }
+static inline void TEE_MemMove(void *dst, const void *src, size_t n) { memmove(dst, src, n); }
+static inline void TEE_MemFill(void *dst, uint32_t x, size_t n) { memset(dst, (int)x, n); }
+
+TEE_Result TA_CreateEntryPoint(void);
+void TA_DestroyEntryPoint(void);
+TEE_Result TA_OpenSessionEntryPoint(uint32_t pt, TEE_Param p[4], void **ctx);
+void TA_CloseSessionEntryPoint(void *ctx);
+TEE_Result TA_InvokeCommandEntryPoint(void *ctx, uint32_t cmd, uint32_t pt, TEE_Param p[4]);
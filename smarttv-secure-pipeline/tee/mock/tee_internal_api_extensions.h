@@ -0,0 +1,2 @@
+#pragma once
+/* Nothing from the OP-TEE extensions is used by ta_svp.c. */
@@ -0,0 +1,302 @@
+/*
+ * Mock libteec: lets tee_svp_client run and be benchmarked without OP-TEE.
+ *
+ * Memory handling follows optee_client: TEEC_MEMREF_TEMP_* parameters get a
+ * freshly allocated bounce buffer per invoke, copied in before and out after
+ * the call; registered/allocated shared memory is referenced in place.
+ * Commands are then run by ta/ta_svp.c, linked into the same library, so
+ * TA-side behaviour (parameter checks, CMD_BATCH) is real; every
+ * TEEC_InvokeCommand counts as one world switch.
+ */
+#include "tee_client_api.h"
+#include "tee_internal_api.h"
+#include "teec_mock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+static struct teec_mock_stats g_stats;
+static uint64_t g_invoke_ns;
+static uint32_t g_next_session = 1;
+static int g_ta_created;
+
+#define STAT_ADD(field, v) __atomic_fetch_add(&g_stats.field, (uint64_t)(v), __ATOMIC_RELAXED)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void teec_mock_get_stats(struct teec_mock_stats *st)
+{
+    st->invokes = __atomic_load_n(&g_stats.invokes, __ATOMIC_RELAXED);
+    st->shm_allocs = __atomic_load_n(&g_stats.shm_allocs, __ATOMIC_RELAXED);
+    st->shm_registers = __atomic_load_n(&g_stats.shm_registers, __ATOMIC_RELAXED);
+    st->temp_allocs = __atomic_load_n(&g_stats.temp_allocs, __ATOMIC_RELAXED);
+    st->temp_bytes = __atomic_load_n(&g_stats.temp_bytes, __ATOMIC_RELAXED);
+    st->shm_bytes = __atomic_load_n(&g_stats.shm_bytes, __ATOMIC_RELAXED);
+}
+
+void teec_mock_reset_stats(void)
+{
+    memset(&g_stats, 0, sizeof(g_stats));
+}
+
+void teec_mock_set_invoke_ns(uint64_t ns)
+{
+    g_invoke_ns = ns;
+}
+
+static volatile uint64_t g_sink;
+
+/* The scaffold TA does not parse its inputs yet; read them once as a real
+ * one would (key blobs are decrypted and verified). */
+static void ta_read(const uint8_t *p, size_t len)
+{
+    uint64_t sum = 0, w;
+    size_t i;
+
+    for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+        memcpy(&w, p + i, sizeof(w));
+        sum ^= w;
+    }
+    for (; i < len; i++)
+        sum ^= p[i];
+    g_sink = sum;
+}
+
+/*
+ * optee_client backs temp memrefs and allocated shared memory with a
+ * TEE_IOC_SHM_ALLOC fd that it mmaps; an anonymous mapping keeps the
+ * per-allocation syscalls and page faults.
+ */
+static void *shm_map(size_t size)
+{
+    void *p = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void shm_unmap(void *p, size_t size)
+{
+    if (p)
+        munmap(p, size ? size : 1);
+}
+
+TEEC_Result TEEC_InitializeContext(const char *name, TEEC_Context *ctx)
+{
+    const char *env = getenv("TEEC_MOCK_INVOKE_NS");
+
+    (void)name;
+    if (!ctx)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    if (env)
+        g_invoke_ns = strtoull(env, NULL, 0);
+    if (!__atomic_exchange_n(&g_ta_created, 1, __ATOMIC_ACQ_REL) &&
+        TA_CreateEntryPoint() != TEE_SUCCESS)
+        return TEEC_ERROR_GENERIC;
+    ctx->fd = -1;
+    return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context *ctx)
+{
+    (void)ctx;
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context *ctx, TEEC_Session *session,
+                             const TEEC_UUID *destination, uint32_t connectionMethod,
+                             const void *connectionData, TEEC_Operation *operation,
+                             uint32_t *returnOrigin)
+{
+    TEE_Param p[4];
+    TEE_Result res;
+
+    (void)destination; (void)connectionMethod; (void)connectionData; (void)operation;
+    if (returnOrigin)
+        *returnOrigin = TEEC_ORIGIN_API;
+    if (!ctx || !session)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    memset(p, 0, sizeof(p));
+    res = TA_OpenSessionEntryPoint(0, p, &session->ta_ctx);
+    if (res != TEE_SUCCESS) {
+        if (returnOrigin)
+            *returnOrigin = TEEC_ORIGIN_TRUSTED_APP;
+        return res;
+    }
+    session->ctx = ctx;
+    session->session_id = __atomic_fetch_add(&g_next_session, 1, __ATOMIC_RELAXED);
+    return TEEC_SUCCESS;
+}
+
+void TEEC_CloseSession(TEEC_Session *session)
+{
+    if (!session || !session->ctx)
+        return;
+    TA_CloseSessionEntryPoint(session->ta_ctx);
+    session->ctx = NULL;
+}
+
+TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context *ctx, TEEC_SharedMemory *shm)
+{
+    if (!ctx || !shm)
+        return TEEC_ERROR_BAD_PARAMETERS;
+    shm->alloced_size = shm->size;
+    shm->buffer = shm_map(shm->alloced_size);
+    if (!shm->buffer)
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    shm->buffer_allocated = 1;
+    shm->registered = 1;
+    STAT_ADD(shm_allocs, 1);
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *ctx, TEEC_SharedMemory *shm)
+{
+    if (!ctx || !shm || (!shm->buffer && shm->size))
+        return TEEC_ERROR_BAD_PARAMETERS;
+    shm->alloced_size = shm->size;
+    shm->buffer_allocated = 0;
+    shm->registered = 1;
+    STAT_ADD(shm_registers, 1);
+    return TEEC_SUCCESS;
+}
+
+void TEEC_ReleaseSharedMemory(TEEC_SharedMemory *shm)
+{
+    if (!shm || !shm->registered)
+        return;
+    if (shm->buffer_allocated)
+        shm_unmap(shm->buffer, shm->alloced_size);
+    shm->buffer = NULL;
+    shm->size = 0;
+    shm->registered = 0;
+    shm->buffer_allocated = 0;
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session *session, uint32_t commandID,
+                               TEEC_Operation *operation, uint32_t *returnOrigin)
+{
+    void *bounce[4] = { NULL, NULL, NULL, NULL };
+    size_t bounce_len[4] = { 0, 0, 0, 0 };
+    TEE_Param ta[4];
+    uint32_t ta_pt = 0;
+    TEEC_Result res = TEEC_SUCCESS;
+    int i;
+
+    if (returnOrigin)
+        *returnOrigin = TEEC_ORIGIN_API;
+    if (!session || !session->ctx)
+        return TEEC_ERROR_BAD_STATE;
+    STAT_ADD(invokes, 1);
+    memset(ta, 0, sizeof(ta));
+
+    for (i = 0; operation && i < 4; i++) {
+        uint32_t t = TEEC_PARAM_TYPE_GET(operation->paramTypes, i);
+        TEEC_Parameter *p = &operation->params[i];
+
+        switch (t) {
+        case TEEC_NONE:
+            break;
+        case TEEC_VALUE_INPUT:
+        case TEEC_VALUE_OUTPUT:
+        case TEEC_VALUE_INOUT:
+            ta[i].value.a = p->value.a;
+            ta[i].value.b = p->value.b;
+            ta_pt |= t << (i * 4);
+            break;
+        case TEEC_MEMREF_TEMP_INPUT:
+        case TEEC_MEMREF_TEMP_OUTPUT:
+        case TEEC_MEMREF_TEMP_INOUT:
+            if (!p->tmpref.buffer && p->tmpref.size) {
+                res = TEEC_ERROR_BAD_PARAMETERS;
+                goto out;
+            }
+            bounce[i] = shm_map(p->tmpref.size);
+            bounce_len[i] = p->tmpref.size;
+            if (!bounce[i]) {
+                res = TEEC_ERROR_OUT_OF_MEMORY;
+                goto out;
+            }
+            STAT_ADD(temp_allocs, 1);
+            if (t != TEEC_MEMREF_TEMP_OUTPUT) {
+                memcpy(bounce[i], p->tmpref.buffer, p->tmpref.size);
+                STAT_ADD(temp_bytes, p->tmpref.size);
+            }
+            ta[i].memref.buffer = bounce[i];
+            ta[i].memref.size = p->tmpref.size;
+            ta_pt |= (t - TEEC_MEMREF_TEMP_INPUT + TEE_PARAM_TYPE_MEMREF_INPUT) << (i * 4);
+            break;
+        case TEEC_MEMREF_WHOLE:
+        case TEEC_MEMREF_PARTIAL_INPUT:
+        case TEEC_MEMREF_PARTIAL_OUTPUT:
+        case TEEC_MEMREF_PARTIAL_INOUT: {
+            TEEC_SharedMemory *shm = p->memref.parent;
+            size_t off = (t == TEEC_MEMREF_WHOLE) ? 0 : p->memref.offset;
+            size_t len = (t == TEEC_MEMREF_WHOLE) ? (shm ? shm->size : 0) : p->memref.size;
+            uint32_t tt = (t == TEEC_MEMREF_WHOLE) ? TEE_PARAM_TYPE_MEMREF_INOUT
+                                                   : t - TEEC_MEMREF_PARTIAL_INPUT +
+                                                     TEE_PARAM_TYPE_MEMREF_INPUT;
+
+            if (!shm || !shm->registered || off > shm->size || len > shm->size - off) {
+                res = TEEC_ERROR_BAD_PARAMETERS;
+                goto out;
+            }
+            STAT_ADD(shm_bytes, len);
+            ta[i].memref.buffer = (uint8_t *)shm->buffer + off;
+            ta[i].memref.size = len;
+            ta_pt |= tt << (i * 4);
+            break;
+        }
+        default:
+            res = TEEC_ERROR_BAD_PARAMETERS;
+            goto out;
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        uint32_t tt = TEE_PARAM_TYPE_GET(ta_pt, i);
+
+        if (tt == TEE_PARAM_TYPE_MEMREF_INPUT || tt == TEE_PARAM_TYPE_MEMREF_INOUT)
+            ta_read(ta[i].memref.buffer, ta[i].memref.size);
+    }
+
+    if (g_invoke_ns) {
+        uint64_t end = now_ns() + g_invoke_ns;
+        while (now_ns() < end)
+            ;
+    }
+
+    if (returnOrigin)
+        *returnOrigin = TEEC_ORIGIN_TRUSTED_APP;
+    res = TA_InvokeCommandEntryPoint(session->ta_ctx, commandID, ta_pt, ta);
+
+    /* Copy outputs back like libteec does after the call returns. */
+    for (i = 0; operation && i < 4; i++) {
+        uint32_t t = TEEC_PARAM_TYPE_GET(operation->paramTypes, i);
+        TEEC_Parameter *p = &operation->params[i];
+
+        if (t == TEEC_VALUE_OUTPUT || t == TEEC_VALUE_INOUT) {
+            p->value.a = ta[i].value.a;
+            p->value.b = ta[i].value.b;
+        } else if (t == TEEC_MEMREF_TEMP_OUTPUT || t == TEEC_MEMREF_TEMP_INOUT) {
+            size_t n = ta[i].memref.size < p->tmpref.size ? ta[i].memref.size : p->tmpref.size;
+
+            memcpy(p->tmpref.buffer, bounce[i], n);
+            STAT_ADD(temp_bytes, n);
+            p->tmpref.size = ta[i].memref.size;
+        } else if (t == TEEC_MEMREF_PARTIAL_OUTPUT || t == TEEC_MEMREF_PARTIAL_INOUT) {
+            p->memref.size = ta[i].memref.size;
+        }
+    }
+
+out:
+    for (i = 0; i < 4; i++)
+        if (bounce[i])
+            shm_unmap(bounce[i], bounce_len[i]);
+    return res;
+}
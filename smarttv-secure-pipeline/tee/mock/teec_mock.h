@@ -0,0 +1,32 @@
+#pragma once
+/*
+ * Controls and counters of the mock libteec. Only available when the client
+ * is built with -DTEE_SVP_MOCK_TEEC=ON (which also defines TEE_SVP_MOCK_TEEC).
+ */
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct teec_mock_stats {
+    uint64_t invokes;
+    uint64_t shm_allocs;       /* TEEC_AllocateSharedMemory */
+    uint64_t shm_registers;    /* TEEC_RegisterSharedMemory */
+    uint64_t temp_allocs;      /* bounce buffers for TEEC_MEMREF_TEMP_* */
+    uint64_t temp_bytes;       /* copied in and out of those buffers */
+    uint64_t shm_bytes;        /* referenced in place through registered memory */
+};
+
+void teec_mock_get_stats(struct teec_mock_stats *st);
+void teec_mock_reset_stats(void);
+
+/*
+ * Busy-waits this long in every TEEC_InvokeCommand to stand in for the
+ * world switch and TA entry (0 by default; also TEEC_MOCK_INVOKE_NS).
+ */
+void teec_mock_set_invoke_ns(uint64_t ns);
+
+#ifdef __cplusplus
+}
+#endif
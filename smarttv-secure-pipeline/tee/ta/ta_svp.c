@@ -1,11 +1,8 @@
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
+#include <stddef.h>
 #include "ta_svp_uuid.h"
-
-#define CMD_OPEN_SESSION        0x0001
-#define CMD_CLOSE_SESSION       0x0002
-#define CMD_IMPORT_KEYBLOB      0x0003
-#define CMD_DERIVE_SESSION_KEY  0x0004
+#include "ta_svp_cmds.h"
 
 TEE_Result TA_CreateEntryPoint(void) { return TEE_SUCCESS; }
 void TA_DestroyEntryPoint(void) {}
@@ -34,17 +31,92 @@ static TEE_Result cmd_import_keyblob(uint32_t pt, TEE_Param p[4])
     return TEE_SUCCESS;
 }
 
-TEE_Result TA_InvokeCommandEntryPoint(void *ctx, uint32_t cmd, uint32_t pt, TEE_Param p[4])
+static TEE_Result dispatch(void *ctx, uint32_t cmd, uint32_t pt, TEE_Param p[4])
 {
     (void)ctx;
     switch (cmd) {
-    case CMD_IMPORT_KEYBLOB:
+    case TA_SVP_CMD_IMPORT_KEYBLOB:
         return cmd_import_keyblob(pt, p);
-    case CMD_OPEN_SESSION:
-    case CMD_CLOSE_SESSION:
-    case CMD_DERIVE_SESSION_KEY:
+    case TA_SVP_CMD_OPEN_SESSION:
+    case TA_SVP_CMD_CLOSE_SESSION:
+    case TA_SVP_CMD_DERIVE_SESSION_KEY:
         return TEE_SUCCESS;
     default:
         return TEE_ERROR_NOT_SUPPORTED;
     }
 }
+
+static TEE_Result cmd_batch(void *ctx, uint32_t pt, TEE_Param p[4])
+{
+    struct ta_svp_batch_hdr *hdr;
+    struct ta_svp_batch_entry *ents;
+    uint8_t *shared, *buf;
+    size_t size;
+    uint32_t i;
+
+    if (pt != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INOUT,
+                             TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    shared = p[0].memref.buffer;
+    size = p[0].memref.size;
+    if (!shared || size < sizeof(*hdr) || size > TA_SVP_BATCH_MAX_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    /* Validate and run from a private copy: the normal world can still
+     * write the shared buffer while we work. */
+    buf = TEE_Malloc(size, TEE_MALLOC_FILL_ZERO);
+    if (!buf)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    TEE_MemMove(buf, shared, size);
+
+    hdr = (struct ta_svp_batch_hdr *)buf;
+    ents = (struct ta_svp_batch_entry *)(hdr + 1);
+    if (hdr->count == 0 || hdr->count > TA_SVP_BATCH_MAX_CMDS ||
+        sizeof(*hdr) + hdr->count * sizeof(*ents) > size) {
+        TEE_Free(buf);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    for (i = 0; i < hdr->count; i++)
+        ents[i].result = TA_SVP_BATCH_NOT_RUN;
+
+    for (i = 0; i < hdr->count; i++) {
+        struct ta_svp_batch_entry *e = &ents[i];
+        uint32_t sub_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE,
+                                          TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+        TEE_Param sub[4];
+
+        TEE_MemFill(sub, 0, sizeof(sub));
+        if (e->cmd == TA_SVP_CMD_BATCH) {
+            e->result = TEE_ERROR_BAD_PARAMETERS;
+        } else if (e->len && (e->offset > size || e->len > size - e->offset)) {
+            e->result = TEE_ERROR_BAD_PARAMETERS;
+        } else {
+            if (e->len) {
+                sub_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE,
+                                         TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+                sub[0].memref.buffer = buf + e->offset;
+                sub[0].memref.size = e->len;
+            }
+            e->result = dispatch(ctx, e->cmd, sub_pt, sub);
+        }
+        if (e->result != TEE_SUCCESS)
+            break;
+    }
+
+    for (i = 0; i < hdr->count; i++)
+        TEE_MemMove(shared + sizeof(*hdr) + i * sizeof(*ents) +
+                    offsetof(struct ta_svp_batch_entry, result),
+                    &ents[i].result, sizeof(ents[i].result));
+
+    TEE_Free(buf);
+    return TEE_SUCCESS;
+}
+
+TEE_Result TA_InvokeCommandEntryPoint(void *ctx, uint32_t cmd, uint32_t pt, TEE_Param p[4])
+{
+    if (cmd == TA_SVP_CMD_BATCH)
+        return cmd_batch(ctx, pt, p);
+    return dispatch(ctx, cmd, pt, p);
+}
@@ -0,0 +1,41 @@
+#ifndef TA_SVP_CMDS_H
+#define TA_SVP_CMDS_H
+
+#include <stdint.h>
+
+/* Command ids shared by the SVP TA and tee_svp_client. */
+#define TA_SVP_CMD_OPEN_SESSION        0x0001
+#define TA_SVP_CMD_CLOSE_SESSION       0x0002
+#define TA_SVP_CMD_IMPORT_KEYBLOB      0x0003
+#define TA_SVP_CMD_DERIVE_SESSION_KEY  0x0004
+#define TA_SVP_CMD_BATCH               0x0005
+
+/*
+ * TA_SVP_CMD_BATCH takes one MEMREF_INOUT laid out as
+ *
+ *   struct ta_svp_batch_hdr
+ *   struct ta_svp_batch_entry[count]
+ *   payloads (entry offsets are from the start of the buffer)
+ *
+ * The TA runs the entries in order, each as if invoked on its own with its
+ * payload (if len != 0) as a MEMREF_INPUT in param 0, and stops at the first
+ * failure. Only the result fields are written back; entries that did not run
+ * keep TA_SVP_BATCH_NOT_RUN.
+ */
+#define TA_SVP_BATCH_MAX_CMDS   16
+#define TA_SVP_BATCH_MAX_SIZE   (16 * 1024)
+#define TA_SVP_BATCH_NOT_RUN    0xFFFFFFFFu
+
+struct ta_svp_batch_hdr {
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct ta_svp_batch_entry {
+    uint32_t cmd;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t result;    /* TEE_Result, filled by the TA */
+};
+
+#endif
@@ -1,34 +1,47 @@
+#include "../common/args.h"
 #include "../common/log.h"
 #include "../player/pipeline.h"
 #include <string>
 
-static std::string arg_value(int argc, char** argv, const char* key, const std::string& def) {
-  for (int i = 1; i + 1 < argc; ++i) {
-    if (std::string(argv[i]) == key) return argv[i + 1];
-  }
-  return def;
-}
-
-static bool has_flag(int argc, char** argv, const char* key) {
-  for (int i = 1; i < argc; ++i) {
-    if (std::string(argv[i]) == key) return true;
-  }
-  return false;
-}
-
 int main(int argc, char** argv) {
   std::string card = arg_value(argc, argv, "--card", "/dev/dri/card0");
-  std::string heap = arg_value(argc, argv, "--heap", "secure");
+  std::string heap = arg_value(argc, argv, "--heap", ""); // "" = svp_heap_name
   int width = std::stoi(arg_value(argc, argv, "--width", "1920"));
   int height = std::stoi(arg_value(argc, argv, "--height", "1080"));
   int frames = std::stoi(arg_value(argc, argv, "--frames", "120"));
   bool rdma = has_flag(argc, argv, "--rdma");
+  bool plane = has_flag(argc, argv, "--plane");
+  std::string timing_csv = arg_value(argc, argv, "--timing-csv", "");
+  // Raw NV12/P010 (--width/--height/--format/--fps) or Y4M frames from a file.
+  FileSourceConfig input;
+  input.path = arg_value(argc, argv, "--input", "");
+  input.width = (uint32_t)width;
+  input.height = (uint32_t)height;
+  std::string format = arg_value(argc, argv, "--format", "nv12");
+  if (!ParseRawFormat(format, &input.fourcc)) {
+    LOGE("demo_player: unknown --format %s (want nv12, nv21 or p010)", format.c_str());
+    return 1;
+  }
+  input.fps = std::stod(arg_value(argc, argv, "--fps", "60"));
+  input.realtime = has_flag(argc, argv, "--realtime");
+  input.loop = has_flag(argc, argv, "--loop");
 
-  LOGI("demo_player: card=%s heap_hint=%s %dx%d frames=%d rdma=%s",
-       card.c_str(), heap.c_str(), width, height, frames, rdma ? "on" : "off");
+  LOGI("demo_player: card=%s heap=%s %dx%d frames=%d rdma=%s scanout=%s",
+       card.c_str(), heap.empty() ? "(svp_heap_name)" : heap.c_str(), width, height, frames, rdma ? "on" : "off",
+       plane ? "plane" : "gl");
+  if (!input.path.empty())
+    LOGI("demo_player: input=%s (%s if raw)%s%s", input.path.c_str(), format.c_str(),
+         input.realtime ? " realtime" : "", input.loop ? " loop" : "");
 
   SecurePipeline p;
+  p.set_plane_scanout(plane);
+  if (!input.path.empty()) p.set_input(input);
+  if (!timing_csv.empty()) p.frame_timing().enable_trace((size_t)frames + 16);
   int rc = p.run_demo(card, heap, width, height, rdma, frames);
+
+  p.frame_timing().print_summary();
+  if (!timing_csv.empty() && p.frame_timing().write_csv(timing_csv))
+    LOGI("per-frame timing written to %s", timing_csv.c_str());
   LOGI("demo_player exit rc=%d", rc);
   return rc;
 }
@@ -0,0 +1,241 @@
+// Prints the svp.ko allocation counters, or what changed between two
+// snapshots: a saved one and now, or two taken --interval-ms apart.
+//   svp_stats [--dev /dev/svp0]
+//   svp_stats --save before.bin
+//   svp_stats --diff before.bin
+//   svp_stats --interval-ms 5000
+// Per-heap counters follow the module-wide ones, so streams on different
+// heaps (secure, CMA, system) can be told apart.
+// Per-session counters of every process are in /sys/kernel/debug/svp/stats.
+// "sessions" includes the default session of this tool's own open.
+#include "../common/args.h"
+#include "../common/fd.h"
+#include "../player/svp_client.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../../kernel/secure_video/svp_uapi.h"
+}
+
+namespace {
+
+constexpr char kSnapMagic[4] = { 'S', 'V', 'P', 'S' };
+
+// The module-wide counters, then (since per-heap stats) a heap count and
+// the heaps; snapshots without the heap part still load.
+bool save_snapshot(const std::string& path, const svp_stats& st,
+                   const std::vector<svp_heap_stats>& heaps) {
+  FILE* f = std::fopen(path.c_str(), "wb");
+  if (!f) return false;
+  uint32_t size = sizeof(st), n = (uint32_t)heaps.size();
+  bool ok = std::fwrite(kSnapMagic, sizeof(kSnapMagic), 1, f) == 1 &&
+            std::fwrite(&size, sizeof(size), 1, f) == 1 && std::fwrite(&st, sizeof(st), 1, f) == 1 &&
+            std::fwrite(&n, sizeof(n), 1, f) == 1 &&
+            std::fwrite(heaps.data(), sizeof(svp_heap_stats), n, f) == n;
+  return std::fclose(f) == 0 && ok;
+}
+
+bool load_snapshot(const std::string& path, svp_stats* st, std::vector<svp_heap_stats>* heaps) {
+  FILE* f = std::fopen(path.c_str(), "rb");
+  if (!f) return false;
+  char magic[4];
+  uint32_t size = 0, n = 0;
+  bool ok = std::fread(magic, sizeof(magic), 1, f) == 1 &&
+            !std::memcmp(magic, kSnapMagic, sizeof(magic)) &&
+            std::fread(&size, sizeof(size), 1, f) == 1 && size == sizeof(*st) &&
+            std::fread(st, sizeof(*st), 1, f) == 1;
+  heaps->clear();
+  if (ok && std::fread(&n, sizeof(n), 1, f) == 1 && n <= SVP_STATS_MAX_HEAPS) {
+    heaps->resize(n);
+    if (std::fread(heaps->data(), sizeof(svp_heap_stats), n, f) != n) ok = false;
+  }
+  std::fclose(f);
+  return ok;
+}
+
+// Counters are differenced; gauges (held, peaks, sessions, max latency)
+// are shown as of `now`.
+svp_stats delta(const svp_stats& before, const svp_stats& now) {
+  svp_stats d = now;
+  d.allocs -= before.allocs;
+  d.alloc_bytes -= before.alloc_bytes;
+  d.released -= before.released;
+  d.failures -= before.failures;
+  d.lat_total_ns -= before.lat_total_ns;
+  for (int i = 0; i < SVP_STATS_LAT_BUCKETS; ++i) d.lat_hist[i] -= before.lat_hist[i];
+  for (int i = 0; i < SVP_STATS_ERRNO_SLOTS; ++i) d.fail_errno[i] -= before.fail_errno[i];
+  return d;
+}
+
+// Heaps are matched by name; one first used after `before` counts from zero.
+std::vector<svp_heap_stats> delta(const std::vector<svp_heap_stats>& before,
+                                  const std::vector<svp_heap_stats>& now) {
+  std::vector<svp_heap_stats> d = now;
+  for (svp_heap_stats& h : d) {
+    for (const svp_heap_stats& b : before) {
+      if (std::strncmp(h.name, b.name, SVP_HEAP_NAME_LEN)) continue;
+      h.allocs -= b.allocs;
+      h.alloc_bytes -= b.alloc_bytes;
+      h.failures -= b.failures;
+      h.lat_total_ns -= b.lat_total_ns;
+      for (int i = 0; i < SVP_STATS_LAT_BUCKETS; ++i) h.lat_hist[i] -= b.lat_hist[i];
+      break;
+    }
+  }
+  return d;
+}
+
+uint64_t hist_attempts(const __u64* hist) {
+  uint64_t n = 0;
+  for (int i = 0; i < SVP_STATS_LAT_BUCKETS; ++i) n += hist[i];
+  return n;
+}
+
+// Upper bound (us) of the bucket holding the p-th percentile; the last
+// bucket is open-ended and reported by its lower bound.
+uint64_t hist_percentile_us(const __u64* hist, uint64_t attempts, double p) {
+  uint64_t want = (uint64_t)(p / 100.0 * (double)attempts + 0.5), seen = 0;
+  if (want == 0) want = 1;
+  for (int i = 0; i < SVP_STATS_LAT_BUCKETS; ++i) {
+    seen += hist[i];
+    if (seen >= want) return i == SVP_STATS_LAT_BUCKETS - 1 ? 1ull << i : 2ull << i;
+  }
+  return 0;
+}
+
+void print_stats(const svp_stats& st, const svp_stats* before) {
+  const char* sign = before ? "+" : "";
+  auto mib = [](uint64_t b) { return (double)b / (1024.0 * 1024.0); };
+
+  std::printf("allocs     %s%llu (%s%.1f MiB)\n", sign, (unsigned long long)st.allocs, sign,
+              mib(st.alloc_bytes));
+  std::printf("held       %llu bufs, %.1f MiB", (unsigned long long)st.held_bufs,
+              mib(st.held_bytes));
+  if (before)
+    std::printf(" (%+lld bufs, %+.1f MiB)", (long long)(st.held_bufs - before->held_bufs),
+                mib(st.held_bytes) - mib(before->held_bytes));
+  std::printf("\npeak       %llu bufs, %.1f MiB\n", (unsigned long long)st.held_bufs_peak,
+              mib(st.held_bytes_peak));
+  std::printf("released   %s%llu\n", sign, (unsigned long long)st.released);
+  std::printf("sessions   %llu\n", (unsigned long long)st.sessions);
+  std::printf("failures   %s%llu\n", sign, (unsigned long long)st.failures);
+  for (int e = 1; e < SVP_STATS_ERRNO_SLOTS; ++e) {
+    if (st.fail_errno[e])
+      std::printf("  errno %-3d %s%llu (%s)\n", e, sign, (unsigned long long)st.fail_errno[e],
+                  std::strerror(e));
+  }
+  if (st.fail_errno[0])
+    std::printf("  errno >=%d %s%llu\n", SVP_STATS_ERRNO_SLOTS, sign,
+                (unsigned long long)st.fail_errno[0]);
+
+  uint64_t attempts = hist_attempts(st.lat_hist);
+  if (!attempts) {
+    std::printf("heap alloc latency: no allocations\n");
+    return;
+  }
+  std::printf("heap alloc latency (%llu allocs): avg %.1f us, p50 <%llu us, p99 <%llu us, "
+              "max %.1f us\n", (unsigned long long)attempts,
+              (double)st.lat_total_ns / (double)attempts / 1e3,
+              (unsigned long long)hist_percentile_us(st.lat_hist, attempts, 50),
+              (unsigned long long)hist_percentile_us(st.lat_hist, attempts, 99),
+              (double)st.lat_max_ns / 1e3);
+  for (int i = 0; i < SVP_STATS_LAT_BUCKETS; ++i) {
+    if (!st.lat_hist[i]) continue;
+    if (i == SVP_STATS_LAT_BUCKETS - 1)
+      std::printf("  >= %7llu us %s%llu\n", 1ull << i, sign, (unsigned long long)st.lat_hist[i]);
+    else
+      std::printf("  <  %7llu us %s%llu\n", 2ull << i, sign, (unsigned long long)st.lat_hist[i]);
+  }
+}
+
+void print_heaps(const std::vector<svp_heap_stats>& heaps, bool diff) {
+  const char* sign = diff ? "+" : "";
+  if (heaps.empty()) return;
+  std::printf("\n%-16s %10s %10s %8s %10s %10s %10s %10s\n", "heap", "allocs", "MiB", "failed",
+              "avg us", "p50 <us", "p99 <us", "max us");
+  for (const svp_heap_stats& h : heaps) {
+    uint64_t attempts = hist_attempts(h.lat_hist);
+    std::printf("%-16.*s %9s%llu %9s%.1f %7s%llu", SVP_HEAP_NAME_LEN, h.name, sign,
+                (unsigned long long)h.allocs, sign, (double)h.alloc_bytes / (1024.0 * 1024.0),
+                sign, (unsigned long long)h.failures);
+    if (attempts)
+      std::printf(" %10.1f %10llu %10llu %10.1f\n",
+                  (double)h.lat_total_ns / (double)attempts / 1e3,
+                  (unsigned long long)hist_percentile_us(h.lat_hist, attempts, 50),
+                  (unsigned long long)hist_percentile_us(h.lat_hist, attempts, 99),
+                  (double)h.lat_max_ns / 1e3);
+    else
+      std::printf(" %10s %10s %10s %10s\n", "-", "-", "-", "-");
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string dev = arg_value(argc, argv, "--dev", "/dev/svp0");
+  std::string save = arg_value(argc, argv, "--save", "");
+  std::string diff = arg_value(argc, argv, "--diff", "");
+  int interval_ms = std::stoi(arg_value(argc, argv, "--interval-ms", "0"));
+
+  UniqueFd fd(::open(dev.c_str(), O_RDWR | O_CLOEXEC));
+  if (!fd) {
+    std::fprintf(stderr, "open %s: %s\n", dev.c_str(), std::strerror(errno));
+    return 1;
+  }
+
+  svp_stats before{}, now{};
+  std::vector<svp_heap_stats> heaps_before, heaps_now;
+  bool have_before = false;
+  if (!diff.empty()) {
+    if (!load_snapshot(diff, &before, &heaps_before)) {
+      std::fprintf(stderr, "%s: not a snapshot from this svp_stats\n", diff.c_str());
+      return 1;
+    }
+    have_before = true;
+  } else if (interval_ms > 0) {
+    int rc = svp_get_stats(fd.get(), &before);
+    if (rc != 0) {
+      std::fprintf(stderr, "SVP_IOC_GET_STATS: %s\n", std::strerror(-rc));
+      return 1;
+    }
+    svp_get_heap_stats(fd.get(), &heaps_before);
+    have_before = true;
+    timespec ts{ interval_ms / 1000, (long)(interval_ms % 1000) * 1000000 };
+    nanosleep(&ts, nullptr);
+  }
+
+  int rc = svp_get_stats(fd.get(), &now);
+  if (rc != 0) {
+    std::fprintf(stderr, "SVP_IOC_GET_STATS: %s\n", std::strerror(-rc));
+    return 1;
+  }
+  // Left empty by modules without per-heap stats (ENOTTY).
+  svp_get_heap_stats(fd.get(), &heaps_now);
+
+  if (!save.empty()) {
+    if (!save_snapshot(save, now, heaps_now)) {
+      std::fprintf(stderr, "cannot write %s\n", save.c_str());
+      return 1;
+    }
+    std::printf("snapshot saved to %s\n", save.c_str());
+    return 0;
+  }
+
+  if (have_before) {
+    svp_stats d = delta(before, now);
+    print_stats(d, &before);
+    print_heaps(delta(heaps_before, heaps_now), true);
+  } else {
+    print_stats(now, nullptr);
+    print_heaps(heaps_now, false);
+  }
+  return 0;
+}
@@ -0,0 +1,72 @@
+// Alloc-vs-reuse latency: one allocation per frame vs. SecureBufferPool.
+//   bench_buffer_pool [--backend memfd|svp] [--width W] [--height H] [--iters N]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/fd.h"
+#include "../common/log.h"
+#include "../player/secure_buffer_pool.h"
+
+#include <fcntl.h>
+#include <string>
+
+static std::unique_ptr<IBufferAllocator> make_backend(const std::string& name, int svp_fd) {
+  if (name == "svp") return CreateSvpAllocator(svp_fd);
+  return CreateMemfdAllocator();
+}
+
+int main(int argc, char** argv) {
+  std::string backend = arg_value(argc, argv, "--backend", "memfd");
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "2000"));
+
+  BufferPoolConfig cfg;
+  cfg.desc.width = (uint32_t)std::stoi(arg_value(argc, argv, "--width", "3840"));
+  cfg.desc.height = (uint32_t)std::stoi(arg_value(argc, argv, "--height", "2160"));
+  cfg.desc.flags = backend == "svp" ? 0x3 : 0; // SVP_BUF_SECURE | SVP_BUF_CPU_NOACCESS
+
+  UniqueFd svp_fd;
+  if (backend == "svp") {
+    svp_fd.reset(::open("/dev/svp0", O_RDWR | O_CLOEXEC));
+    if (!svp_fd) { LOGE("open(/dev/svp0) failed"); return 1; }
+  }
+
+  std::printf("backend=%s %ux%u iters=%d\n", backend.c_str(), cfg.desc.width, cfg.desc.height, iters);
+
+  // Baseline: allocate and drop one buffer per frame.
+  {
+    auto alloc = make_backend(backend, svp_fd.get());
+    LatencySamples lat((size_t)iters);
+    for (int i = 0; i < iters; ++i) {
+      UniqueFd fd;
+      BufferLayout layout{};
+      uint64_t t0 = bench_now_ns();
+      int rc = alloc->allocate(cfg.desc, &fd, &layout);
+      if (rc == 0) alloc->release(cfg.desc, fd.get());
+      fd.reset();
+      lat.add(bench_now_ns() - t0);
+      if (rc != 0) { LOGE("allocate failed rc=%d", rc); return 1; }
+    }
+    lat.print("alloc+free per frame");
+  }
+
+  // Pool: acquire/release a handle per frame, three frames in flight.
+  {
+    SecureBufferPool pool(make_backend(backend, svp_fd.get()), cfg);
+    if (!pool.init()) return 1;
+    LatencySamples lat((size_t)iters);
+    SecureBufferPool::Handle inflight[3];
+    for (int i = 0; i < iters; ++i) {
+      uint64_t t0 = bench_now_ns();
+      inflight[i % 3] = pool.acquire();
+      lat.add(bench_now_ns() - t0);
+      if (!inflight[i % 3]) { LOGE("pool exhausted"); return 1; }
+    }
+    lat.print("pool acquire/release");
+
+    BufferPoolStats st = pool.stats();
+    std::printf("pool stats: hits=%llu misses=%llu exhausted=%llu allocated=%llu freed=%llu live=%zu idle=%zu\n",
+                (unsigned long long)st.hits, (unsigned long long)st.misses,
+                (unsigned long long)st.exhausted, (unsigned long long)st.allocated,
+                (unsigned long long)st.freed, st.live, st.idle);
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+// CpuCopier against plain memcpy and the RDMA engine, 4 KiB .. 16 MiB.
+//   memcpy       std::memcpy between buffers mapped once (copy cost only)
+//   cpu-mem      CpuCopier::copy_mem on the same mappings (SIMD + workers)
+//   cpu          CpuCopier::copy on buffer fds (cached mapping, DMA_BUF_IOCTL_SYNC)
+//   rdma         RdmaClient::copy, if /dev/rdma_stub0 has a DMA channel
+//   auto         what CreateAutoCopyEngine() picks for non-secure buffers
+// Buffers are udmabufs when /dev/udmabuf exists, memfds otherwise.
+//   bench_cpu_copy [--threads 0] [--iters 200] [--cpu-max 262144]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/fd.h"
+#include "../common/log.h"
+#include "../player/cpu_copy.h"
+#include "../player/rdma_client.h"
+#include "../player/staged_pipeline.h"
+#include "../player/udmabuf.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static constexpr size_t kMaxSize = 16u << 20;
+
+struct Buffer {
+  UdmaBuffer udma;    // dmabuf + backing memfd, or just a memfd
+  uint8_t* p = nullptr;
+  int fd() const { return udma.dmabuf ? udma.dmabuf.get() : udma.memfd.get(); }
+};
+
+static bool alloc_buffer(bool use_udmabuf, Buffer* b) {
+  if (use_udmabuf) {
+    if (udmabuf_alloc(kMaxSize, &b->udma) != 0) return false;
+  } else {
+    b->udma.memfd.reset(::memfd_create("bench-cpu-copy", MFD_CLOEXEC));
+    if (!b->udma.memfd || ::ftruncate(b->udma.memfd.get(), kMaxSize) != 0) return false;
+    b->udma.size = kMaxSize;
+  }
+  void* m = ::mmap(nullptr, kMaxSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   b->udma.memfd.get(), 0);
+  if (m == MAP_FAILED) return false;
+  b->p = (uint8_t*)m;
+  return true;
+}
+
+// Unaligned offsets and sizes around the worker split and the
+// non-temporal threshold.
+static bool verify(CpuCopier* cpu, Buffer* src, Buffer* dst) {
+  struct { uint32_t src_off, dst_off, size; } cases[] = {
+    { 0, 0, 4096 }, { 3, 61, 1000 }, { 17, 4095, (1u << 20) + 33 }, { 1, 0, (8u << 20) - 5 },
+  };
+  for (size_t i = 0; i < (8u << 20) + 64; ++i) src->p[i] = (uint8_t)(i * 131 + 7);
+  for (const auto& c : cases) {
+    std::memset(dst->p, 0, c.dst_off + c.size + 1);
+    RdmaCopyReq r{};
+    r.src_fd = src->fd();
+    r.dst_fd = dst->fd();
+    r.src_off = c.src_off;
+    r.dst_off = c.dst_off;
+    r.size = c.size;
+    bool ok = cpu->copy(r) == 0 && !std::memcmp(dst->p + c.dst_off, src->p + c.src_off, c.size) &&
+              (c.dst_off == 0 || dst->p[c.dst_off - 1] == 0) && dst->p[c.dst_off + c.size] == 0;
+    std::printf("verify src_off=%-3u dst_off=%-5u size=%-8u %s\n", c.src_off, c.dst_off, c.size,
+                ok ? "ok" : "FAILED");
+    if (!ok) return false;
+  }
+  return true;
+}
+
+template <typename Fn>
+static double p50_us(int iters, Fn&& fn) {
+  LatencySamples lat((size_t)iters);
+  for (int i = 0; i < iters + 2; ++i) {
+    uint64_t t0 = bench_now_ns();
+    if (fn() != 0) return -1.0;
+    if (i >= 2) lat.add(bench_now_ns() - t0); // two warm-up rounds
+  }
+  return (double)lat.percentile(50) / 1e3;
+}
+
+int main(int argc, char** argv) {
+  unsigned threads = (unsigned)std::stoul(arg_value(argc, argv, "--threads", "0"));
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "200"));
+  size_t cpu_max = std::stoul(arg_value(argc, argv, "--cpu-max", "262144"));
+
+  bool use_udmabuf = udmabuf_available();
+  Buffer src, dst;
+  if (!alloc_buffer(use_udmabuf, &src) || !alloc_buffer(use_udmabuf, &dst)) {
+    LOGE("buffer allocation failed");
+    return 1;
+  }
+  std::memset(dst.p, 0, kMaxSize); // fault the pages in up front
+
+  RdmaClient rdma;
+  bool use_rdma = use_udmabuf && rdma.open() && rdma.has_channel();
+  CpuCopier cpu(threads);
+  CpuCopier cpu1(1);
+  auto engine = CreateAutoCopyEngine(use_rdma ? &rdma : nullptr, &cpu, 0, cpu_max);
+
+  std::printf("buffers: %s, cpu: %u threads, %s stores, rdma: %s\n",
+              use_udmabuf ? "udmabuf" : "memfd", cpu.threads(), CpuCopier::isa(),
+              use_rdma ? "yes" : "no DMA channel / no udmabuf");
+  if (!verify(&cpu, &src, &dst)) return 1;
+
+  std::printf("\n%-9s %10s %10s %10s %10s %10s %10s  (p50 us)\n", "size", "memcpy", "cpu-mem/1",
+              "cpu-mem", "cpu", "rdma", "auto");
+  for (size_t size = 4096; size <= kMaxSize; size *= 4) {
+    int n = (int)std::max<size_t>(10, std::min<size_t>((size_t)iters, (1ull << 30) / size));
+    RdmaCopyReq r{};
+    r.src_fd = src.fd();
+    r.dst_fd = dst.fd();
+    r.size = (uint32_t)size;
+
+    double t_memcpy = p50_us(n, [&] { std::memcpy(dst.p, src.p, size); return 0; });
+    double t_mem1 = p50_us(n, [&] { cpu1.copy_mem(dst.p, src.p, size); return 0; });
+    double t_mem = p50_us(n, [&] { cpu.copy_mem(dst.p, src.p, size); return 0; });
+    double t_cpu = p50_us(n, [&] { return cpu.copy(r); });
+    double t_rdma = use_rdma ? p50_us(n, [&] { return rdma.copy(r); }) : -1.0;
+    double t_auto = p50_us(n, [&] { return engine->copy(r.src_fd, r.dst_fd, size); });
+    if (t_cpu < 0 || t_auto < 0) {
+      LOGE("copy of %zu bytes failed", size);
+      return 1;
+    }
+
+    std::printf("%-9zu", size);
+    for (double t : { t_memcpy, t_mem1, t_mem, t_cpu, t_rdma, t_auto }) {
+      if (t < 0) std::printf(" %10s", "-");
+      else std::printf(" %10.1f", t);
+    }
+    std::printf("  %s\n", use_rdma && size > cpu_max ? "auto=rdma" : "auto=cpu");
+    std::printf("%-9s %9.2fG %9.2fG %9.2fG %9.2fG", "  GB/s", size / t_memcpy / 1e3,
+                size / t_mem1 / 1e3, size / t_mem / 1e3, size / t_cpu / 1e3);
+    if (t_rdma > 0) std::printf(" %9.2fG", size / t_rdma / 1e3);
+    std::printf("\n");
+  }
+  ::munmap(src.p, kMaxSize);
+  ::munmap(dst.p, kMaxSize);
+  return 0;
+}
@@ -0,0 +1,94 @@
+// Per-frame cost of drawing NV12 dma-bufs through GbmKmsRenderer: the first
+// (importing) draw of each buffer, cached draws cycling a pool of buffers the
+// way the player does, and draws that are forced to re-import every time.
+// Runs headless (EGL surfaceless, e.g. Mesa llvmpipe) on udmabuf buffers.
+//   bench_dmabuf_import [--width 1920] [--height 1080] [--buffers 8] [--frames 300]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "../player/udmabuf.h"
+#include "../renderer/gbm_kms_renderer.h"
+
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+static constexpr uint32_t kNv12 = 0x3231564E; // 'NV12'
+
+static bool fill_frame(const UdmaBuffer& b, uint32_t width, uint32_t height, int seed) {
+  void* m = ::mmap(nullptr, b.size, PROT_READ | PROT_WRITE, MAP_SHARED, b.memfd.get(), 0);
+  if (m == MAP_FAILED) return false;
+  uint8_t* p = (uint8_t*)m;
+  size_t luma = (size_t)width * height;
+  for (uint32_t y = 0; y < height; ++y)
+    std::memset(p + (size_t)y * width, (int)((y + (uint32_t)seed * 32) & 0xff), width);
+  std::memset(p + luma, 128, luma / 2);
+  ::munmap(m, b.size);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  uint32_t width = (uint32_t)std::stoi(arg_value(argc, argv, "--width", "1920"));
+  uint32_t height = (uint32_t)std::stoi(arg_value(argc, argv, "--height", "1080"));
+  int nbuf = std::stoi(arg_value(argc, argv, "--buffers", "8"));
+  int frames = std::stoi(arg_value(argc, argv, "--frames", "300"));
+
+  if (!udmabuf_available()) { LOGE("/dev/udmabuf not available"); return 1; }
+
+  std::vector<UdmaBuffer> bufs((size_t)nbuf);
+  for (int i = 0; i < nbuf; ++i) {
+    if (udmabuf_alloc((size_t)width * height * 3 / 2, &bufs[(size_t)i]) != 0 ||
+        !fill_frame(bufs[(size_t)i], width, height, i)) {
+      LOGE("udmabuf allocation failed");
+      return 1;
+    }
+  }
+
+  GbmKmsRenderer r;
+  if (!r.init_headless(width, height)) return 1;
+
+  const uint32_t strides[3] = { width, width, 0 };
+  const uint32_t offsets[3] = { 0, width * height, 0 };
+  auto draw = [&](int i) {
+    return r.render_dmabuf_frame(bufs[(size_t)i].dmabuf.get(), width, height, kNv12,
+                                 strides, offsets);
+  };
+
+  std::printf("%ux%u NV12, %d buffers, %d frames\n", width, height, nbuf, frames);
+
+  LatencySamples cold((size_t)nbuf), cached((size_t)frames), reimport((size_t)frames);
+  for (int i = 0; i < nbuf; ++i) {
+    uint64_t t0 = bench_now_ns();
+    if (!draw(i)) { LOGE("render_dmabuf_frame failed"); return 1; }
+    r.finish();
+    cold.add(bench_now_ns() - t0);
+  }
+
+  for (int f = 0; f < frames; ++f) {
+    uint64_t t0 = bench_now_ns();
+    if (!draw(f % nbuf)) return 1;
+    r.finish();
+    cached.add(bench_now_ns() - t0);
+  }
+
+  for (int f = 0; f < frames; ++f) {
+    int i = f % nbuf;
+    uint64_t t0 = bench_now_ns();
+    r.forget_dmabuf(bufs[(size_t)i].dmabuf.get());
+    if (!draw(i)) return 1;
+    r.finish();
+    reimport.add(bench_now_ns() - t0);
+  }
+
+  cold.print("first draw (import)");
+  cached.print("cached draw");
+  reimport.print("forced re-import draw");
+
+  GbmKmsRenderer::ImportStats st = r.import_stats();
+  std::printf("imports=%llu cache hits=%llu\n",
+              (unsigned long long)st.imports, (unsigned long long)st.hits);
+
+  r.shutdown();
+  return 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal streaming JSON writer for benchmark reports: objects, arrays and
+// scalar fields, two-space indented. Keys are only written inside objects.
+class JsonWriter {
+public:
+  void begin_object(const char* key = nullptr) { open(key, '{'); }
+  void end_object() { close('}'); }
+  void begin_array(const char* key = nullptr) { open(key, '['); }
+  void end_array() { close(']'); }
+
+  void field(const char* key, const std::string& v) { item(key); quote(v); }
+  void field(const char* key, const char* v) { item(key); quote(v); }
+  void field(const char* key, bool v) { item(key); out_ += v ? "true" : "false"; }
+  void field(const char* key, int v) { field(key, (int64_t)v); }
+  void field(const char* key, int64_t v) {
+    char b[32];
+    std::snprintf(b, sizeof(b), "%" PRId64, v);
+    item(key);
+    out_ += b;
+  }
+  void field(const char* key, uint64_t v) {
+    char b[32];
+    std::snprintf(b, sizeof(b), "%" PRIu64, v);
+    item(key);
+    out_ += b;
+  }
+  void field(const char* key, double v) {
+    char b[32];
+    if (std::isfinite(v)) std::snprintf(b, sizeof(b), "%.3f", v);
+    else std::snprintf(b, sizeof(b), "null");
+    item(key);
+    out_ += b;
+  }
+
+  const std::string& str() const { return out_; }
+
+private:
+  void item(const char* key) {
+    if (!first_.empty()) {
+      if (!first_.back()) out_ += ',';
+      first_.back() = false;
+      out_ += '\n';
+      out_.append(first_.size() * 2, ' ');
+    }
+    if (key) {
+      quote(key);
+      out_ += ": ";
+    }
+  }
+  void open(const char* key, char c) {
+    item(key);
+    out_ += c;
+    first_.push_back(true);
+  }
+  void close(char c) {
+    bool empty = first_.back();
+    first_.pop_back();
+    if (!empty) {
+      out_ += '\n';
+      out_.append(first_.size() * 2, ' ');
+    }
+    out_ += c;
+  }
+  void quote(const std::string& s) {
+    out_ += '"';
+    for (char ch : s) {
+      unsigned char c = (unsigned char)ch;
+      if (c == '"' || c == '\\') {
+        out_ += '\\';
+        out_ += ch;
+      } else if (c < 0x20) {
+        char b[8];
+        std::snprintf(b, sizeof(b), "\\u%04x", c);
+        out_ += b;
+      } else {
+        out_ += ch;
+      }
+    }
+    out_ += '"';
+  }
+
+  std::string out_;
+  std::vector<bool> first_; // per open container: nothing written into it yet
+};
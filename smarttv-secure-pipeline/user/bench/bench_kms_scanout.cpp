@@ -0,0 +1,80 @@
+// Atomic plane scanout of udmabuf frames: per-frame present cost (cached FB
+// lookup plus a non-blocking commit, paced by the previous flip), flip
+// interval, and FB cache hit rate (steady state should create no FBs).
+// Works on vkms (`modprobe vkms`), whose planes take XRGB8888/ARGB8888;
+// NV12 exercises the GL fallback there and the overlay path on SoC hardware.
+//   bench_kms_scanout [--card /dev/dri/card0] [--width 1024] [--height 768]
+//                     [--format xrgb8888|nv12] [--buffers 3] [--frames 300]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "../player/udmabuf.h"
+#include "../renderer/gbm_kms_renderer.h"
+
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+static constexpr uint32_t kNv12 = 0x3231564E;     // 'NV12'
+static constexpr uint32_t kXrgb8888 = 0x34325258; // 'XR24'
+
+int main(int argc, char** argv) {
+  std::string card = arg_value(argc, argv, "--card", "/dev/dri/card0");
+  uint32_t width = (uint32_t)std::stoi(arg_value(argc, argv, "--width", "1024"));
+  uint32_t height = (uint32_t)std::stoi(arg_value(argc, argv, "--height", "768"));
+  std::string format = arg_value(argc, argv, "--format", "xrgb8888");
+  int nbuf = std::stoi(arg_value(argc, argv, "--buffers", "3"));
+  int frames = std::stoi(arg_value(argc, argv, "--frames", "300"));
+
+  bool nv12 = format == "nv12";
+  uint32_t fourcc = nv12 ? kNv12 : kXrgb8888;
+  uint32_t strides[3] = { nv12 ? width : width * 4, nv12 ? width : 0, 0 };
+  uint32_t offsets[3] = { 0, nv12 ? width * height : 0, 0 };
+  size_t size = nv12 ? (size_t)width * height * 3 / 2 : (size_t)width * height * 4;
+
+  if (!udmabuf_available()) { LOGE("/dev/udmabuf not available"); return 1; }
+
+  std::vector<UdmaBuffer> bufs((size_t)nbuf);
+  for (int i = 0; i < nbuf; ++i) {
+    if (udmabuf_alloc(size, &bufs[(size_t)i]) != 0) { LOGE("udmabuf allocation failed"); return 1; }
+    void* m = ::mmap(nullptr, bufs[(size_t)i].size, PROT_WRITE, MAP_SHARED,
+                     bufs[(size_t)i].memfd.get(), 0);
+    if (m == MAP_FAILED) return 1;
+    std::memset(m, 0x40 * (i + 1), size);
+    ::munmap(m, bufs[(size_t)i].size);
+  }
+
+  GbmKmsRenderer r;
+  if (!r.init(card)) return 1;
+  r.set_plane_scanout(true);
+
+  LatencySamples present((size_t)frames), interval((size_t)frames);
+  uint64_t last = 0;
+  for (int f = 0; f < frames; ++f) {
+    uint64_t t0 = bench_now_ns();
+    if (!r.present_dmabuf_frame(bufs[(size_t)(f % nbuf)].dmabuf.get(), width, height, fourcc,
+                                strides, offsets)) {
+      LOGE("present_dmabuf_frame failed at frame %d", f);
+      break;
+    }
+    uint64_t t1 = bench_now_ns();
+    present.add(t1 - t0);
+    if (last) interval.add(t1 - last);
+    last = t1;
+  }
+
+  std::printf("%ux%u %s, %d buffers, path=%s\n", width, height, format.c_str(), nbuf,
+              r.plane_active() ? "KMS plane" : "GL fallback");
+  present.print("present_dmabuf_frame");
+  interval.print("frame interval");
+
+  GbmKmsRenderer::FbCacheStats st = r.fb_cache_stats();
+  std::printf("fb cache: creates=%llu hits=%llu (%.1f%%) evictions=%llu invalidations=%llu\n",
+              (unsigned long long)st.creates, (unsigned long long)st.hits,
+              st.creates + st.hits ? 100.0 * (double)st.hits / (double)(st.creates + st.hits) : 0.0,
+              (unsigned long long)st.evictions, (unsigned long long)st.invalidations);
+
+  r.shutdown();
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Cost of a log call on the calling thread: the previous synchronous
+// fprintf(stderr) path vs. the asynchronous LOGI, a LOGI filtered at run
+// time (level set to warn) and a rate-limited LOGW_EVERY_MS, with several
+// threads logging at once.
+//   bench_log [--threads 4] [--msgs 20000] [--gap-us 100] [--out /dev/null]
+// stderr is redirected to --out while measuring. --gap-us paces each thread
+// (sleeping) like a render loop logging per frame; 0 logs flat out, rings
+// then fill and messages are dropped instead of blocking.
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+
+#include <cstdarg>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// log_print() as it was before the async backend.
+static void sync_log_print(const char* lvl, const char* fmt, ...) {
+  std::va_list ap;
+  va_start(ap, fmt);
+  std::fprintf(stderr, "[%s] ", lvl);
+  std::vfprintf(stderr, fmt, ap);
+  std::fprintf(stderr, "\n");
+  va_end(ap);
+}
+
+template <typename Fn>
+static void run_mode(const char* label, int threads, int msgs, uint64_t gap_ns, Fn&& fn) {
+  std::vector<LatencySamples> per_thread((size_t)threads, LatencySamples((size_t)msgs));
+  std::vector<std::thread> ts;
+  for (int t = 0; t < threads; ++t) {
+    ts.emplace_back([&, t] {
+      LatencySamples& s = per_thread[(size_t)t];
+      uint64_t next = bench_now_ns();
+      for (int i = 0; i < msgs; ++i) {
+        uint64_t t0 = bench_now_ns();
+        fn(t, i);
+        s.add(bench_now_ns() - t0);
+        next += gap_ns;
+        if (gap_ns) {
+          timespec until{ (time_t)(next / 1000000000ull), (long)(next % 1000000000ull) };
+          clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr);
+        }
+      }
+    });
+  }
+  for (std::thread& th : ts) th.join();
+  log_flush();
+
+  LatencySamples all((size_t)threads * (size_t)msgs);
+  for (LatencySamples& s : per_thread) all.merge(s);
+  all.print(label);
+}
+
+int main(int argc, char** argv) {
+  int threads = std::stoi(arg_value(argc, argv, "--threads", "4"));
+  int msgs = std::stoi(arg_value(argc, argv, "--msgs", "20000"));
+  uint64_t gap_ns = std::stoull(arg_value(argc, argv, "--gap-us", "100")) * 1000;
+  std::string out = arg_value(argc, argv, "--out", "/dev/null");
+
+  int out_fd = ::open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out_fd < 0) { std::fprintf(stdout, "cannot open %s\n", out.c_str()); return 1; }
+  int saved = ::dup(STDERR_FILENO);
+  ::dup2(out_fd, STDERR_FILENO);
+
+  std::printf("%d threads x %d messages, %llu us apart, stderr -> %s\n", threads, msgs,
+              (unsigned long long)(gap_ns / 1000), out.c_str());
+  run_mode("sync fprintf (previous)", threads, msgs, gap_ns, [](int t, int i) {
+    sync_log_print("I", "frame %d on stage %d: pts=%lld took %.2f ms", i, t, (long long)i * 41708, 1.25);
+  });
+  run_mode("async LOGI", threads, msgs, gap_ns, [](int t, int i) {
+    LOGI("frame %d on stage %d: pts=%lld took %.2f ms", i, t, (long long)i * 41708, 1.25);
+  });
+  // Not LOGD: below LOG_MIN_LEVEL it is compiled out and would time nothing.
+  int level = g_log_level.load();
+  log_set_level(kLogWarn);
+  run_mode("LOGI filtered at runtime", threads, msgs, gap_ns, [](int t, int i) {
+    LOGI("frame %d on stage %d: pts=%lld took %.2f ms", i, t, (long long)i * 41708, 1.25);
+  });
+  log_set_level(level);
+  run_mode("LOGW_EVERY_MS(1000)", threads, msgs, gap_ns, [](int t, int i) {
+    LOGW_EVERY_MS(1000, "frame %d on stage %d late", i, t);
+  });
+
+  log_flush();
+  ::dup2(saved, STDERR_FILENO);
+  ::close(saved);
+  ::close(out_fd);
+  return 0;
+}
@@ -0,0 +1,50 @@
+// GL presentation through page flips: CPU time per rendered+presented frame
+// (which should stay far below the refresh period; presenting never waits
+// for a flip), achieved flip rate, and dropped frames. Runs on vkms.
+//   bench_present [--card /dev/dri/card0] [--frames 600] [--mailbox]
+// By default the loop waits on the display fd while a frame is queued, so
+// nothing is dropped; --mailbox renders flat out and lets frames be replaced.
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "../renderer/gbm_kms_renderer.h"
+
+#include <poll.h>
+#include <string>
+
+int main(int argc, char** argv) {
+  std::string card = arg_value(argc, argv, "--card", "/dev/dri/card0");
+  int frames = std::stoi(arg_value(argc, argv, "--frames", "600"));
+  bool mailbox = has_flag(argc, argv, "--mailbox");
+
+  GbmKmsRenderer r;
+  if (!r.init(card)) return 1;
+
+  LatencySamples render((size_t)frames), wait((size_t)frames);
+  uint64_t start = bench_now_ns();
+  for (int f = 0; f < frames; ++f) {
+    uint64_t t0 = bench_now_ns();
+    while (!mailbox && r.present_queue_full()) {
+      pollfd pfd{r.display_fd(), POLLIN, 0};
+      if (::poll(&pfd, 1, 1000) <= 0) { LOGE("no flip event within 1s"); return 1; }
+      r.dispatch_events();
+    }
+    uint64_t t1 = bench_now_ns();
+    if (!r.render_test_pattern(1)) { LOGE("present failed at frame %d", f); return 1; }
+    r.dispatch_events();
+    wait.add(t1 - t0);
+    render.add(bench_now_ns() - t1);
+  }
+  double secs = (double)(bench_now_ns() - start) / 1e9;
+
+  GbmKmsRenderer::PresentStats st = r.present_stats();
+  std::printf("%d frames in %.2fs (%s)\n", frames, secs, mailbox ? "mailbox" : "paced");
+  render.print("render + present (CPU)");
+  wait.print("wait for queue slot");
+  std::printf("flips=%llu (%.1f/s) dropped=%llu\n", (unsigned long long)st.flips,
+              (double)st.flips / secs, (unsigned long long)st.dropped);
+  r.frame_timing().print_summary();
+
+  r.shutdown();
+  return 0;
+}
@@ -0,0 +1,134 @@
+// NV12 frame copy throughput with 1, 2 and 4 DMA channels in use.
+//   single  one synchronous copy at a time: striping across channels
+//   queued  --queued copies in flight (RDMA_IOC_SUBMIT): spreading
+// Channels in use are switched through the rdma_active_channels module
+// parameter (needs root); load rdma_stub with rdma_channels=4 or more.
+// Buffers are registered udmabufs, so only the DMA itself is timed.
+//   bench_rdma_channels [--channels 1,2,4] [--iters 50] [--queued 4]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "../player/rdma_client.h"
+#include "../player/udmabuf.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+extern "C" {
+#include "../../kernel/rdma_stub/rdma_stub_uapi.h"
+}
+
+static const char kActiveParam[] = "/sys/module/rdma_stub/parameters/rdma_active_channels";
+
+static bool write_param(const char* path, const std::string& v) {
+  std::ofstream f(path);
+  f << v << '\n';
+  f.flush();
+  return (bool)f;
+}
+
+static std::string read_param(const char* path) {
+  std::ifstream f(path);
+  std::string v;
+  std::getline(f, v);
+  return v;
+}
+
+static void print_utilization(const rdma_stats& a, const rdma_stats& b) {
+  double dt = (double)(b.now_ns - a.now_ns);
+  for (uint32_t i = 0; i < b.num_channels; ++i) {
+    const rdma_chan_stats& x = a.chans[i];
+    const rdma_chan_stats& y = b.chans[i];
+    if (y.copies == x.copies) continue;
+    std::printf("    chan%u: %5.1f%% busy, %6llu stripes, %8.1f MiB\n", i,
+                dt > 0 ? (double)(y.busy_ns - x.busy_ns) * 100.0 / dt : 0.0,
+                (unsigned long long)(y.copies - x.copies),
+                (double)(y.bytes - x.bytes) / (1024.0 * 1024.0));
+  }
+}
+
+int main(int argc, char** argv) {
+  std::string list = arg_value(argc, argv, "--channels", "1,2,4");
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "50"));
+  int queued = std::stoi(arg_value(argc, argv, "--queued", "4"));
+
+  RdmaClient rdma;
+  if (!rdma.open()) return 1;
+  if (!rdma.has_channel()) { LOGE("rdma_stub has no DMA channel"); return 1; }
+  if (!udmabuf_available()) { LOGE("/dev/udmabuf not available"); return 1; }
+
+  rdma_stats st{};
+  if (rdma.get_stats(&st) != 0) { LOGE("RDMA_IOC_GET_STATS failed (old module?)"); return 1; }
+  std::string saved = read_param(kActiveParam);
+  std::printf("rdma_stub: %u channels\n", st.num_channels);
+
+  struct Frame { const char* name; uint32_t w, h; } frames[] = {
+    { "1080p", 1920, 1080 }, { "4K", 3840, 2160 },
+  };
+  size_t max_size = (size_t)3840 * 2160 * 3 / 2;
+  UdmaBuffer src, dst;
+  if (udmabuf_alloc(max_size, &src) != 0 || udmabuf_alloc(max_size, &dst) != 0) {
+    LOGE("udmabuf allocation failed");
+    return 1;
+  }
+  int src_h = rdma.register_buffer(src.dmabuf.get());
+  int dst_h = rdma.register_buffer(dst.dmabuf.get());
+  if (src_h < 0 || dst_h < 0) { LOGE("RDMA_IOC_REGISTER_BUF failed"); return 1; }
+
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    uint32_t n = (uint32_t)std::stoul(item);
+    if (n > st.num_channels) {
+      std::printf("\n%u channels: skipped, module has %u\n", n, st.num_channels);
+      continue;
+    }
+    if (!write_param(kActiveParam, std::to_string(n))) {
+      LOGE("cannot write %s (not root?)", kActiveParam);
+      break;
+    }
+    std::printf("\n%u channel%s\n", n, n == 1 ? "" : "s");
+
+    for (const Frame& f : frames) {
+      RdmaCopyReq r{};
+      r.src_fd = src_h;
+      r.dst_fd = dst_h;
+      r.size = f.w * f.h * 3 / 2;
+      r.flags = kRdmaCopySrcHandle | kRdmaCopyDstHandle;
+
+      rdma_stats a{}, b{};
+      rdma.get_stats(&a);
+      LatencySamples lat((size_t)iters);
+      for (int i = 0; i < iters; ++i) {
+        uint64_t t0 = bench_now_ns();
+        if (rdma.copy(r) != 0) { LOGE("copy failed"); return 1; }
+        lat.add(bench_now_ns() - t0);
+      }
+      rdma.get_stats(&b);
+      std::printf("  %-5s single  p50 %8.1f us  %6.2f GB/s\n", f.name,
+                  (double)lat.percentile(50) / 1e3, (double)r.size / lat.mean());
+      print_utilization(a, b);
+
+      rdma.get_stats(&a);
+      uint64_t t0 = bench_now_ns();
+      int done = 0, failed = 0;
+      for (int i = 0; i < iters; ++i) {
+        while (rdma.inflight() >= (size_t)queued) rdma.poll_completions(-1);
+        int rc = rdma.submit(r, [&](int status) { ++done; failed += status != 0; });
+        if (rc != 0) { LOGE("submit failed: %d", rc); return 1; }
+      }
+      if (rdma.wait_all(5000) != 0 || failed) { LOGE("queued copies failed"); return 1; }
+      uint64_t ns = bench_now_ns() - t0;
+      rdma.get_stats(&b);
+      std::printf("  %-5s queued  %d in flight    %6.2f GB/s\n", f.name, queued,
+                  (double)r.size * done / (double)ns);
+      print_utilization(a, b);
+    }
+  }
+
+  write_param(kActiveParam, saved.empty() ? "0" : saved);
+  rdma.unregister_buffer(src_h);
+  rdma.unregister_buffer(dst_h);
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Whole-frame RDMA copies between udmabuf-backed (scattered page) buffers.
+// Verifies data at unaligned offsets that cross SG segment boundaries, then
+// reports throughput of full-frame copies.
+//   bench_rdma_copy [--width 3840] [--height 2160] [--iters 100]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/fd.h"
+#include "../common/log.h"
+#include "../player/rdma_client.h"
+#include "../player/udmabuf.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+
+struct Mapping {
+  uint8_t* p = nullptr;
+  size_t size = 0;
+  Mapping(int fd, size_t sz) : size(sz) {
+    void* m = ::mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    p = (m == MAP_FAILED) ? nullptr : (uint8_t*)m;
+  }
+  ~Mapping() { if (p) ::munmap(p, size); }
+};
+
+static bool verify_copy(int rdma_fd, const UdmaBuffer& src, const UdmaBuffer& dst,
+                        uint32_t src_off, uint32_t dst_off, uint32_t size) {
+  Mapping s(src.memfd.get(), src.size), d(dst.memfd.get(), dst.size);
+  if (!s.p || !d.p) return false;
+  for (size_t i = 0; i < src.size; ++i) s.p[i] = (uint8_t)(i * 131 + 7);
+  std::memset(d.p, 0, dst.size);
+
+  RdmaCopyReq r{};
+  r.src_fd = src.dmabuf.get();
+  r.dst_fd = dst.dmabuf.get();
+  r.src_off = src_off;
+  r.dst_off = dst_off;
+  r.size = size;
+  if (rdma_copy(rdma_fd, r) != 0) return false;
+
+  return std::memcmp(d.p + dst_off, s.p + src_off, size) == 0 &&
+         (dst_off == 0 || d.p[dst_off - 1] == 0) &&
+         (dst_off + size >= dst.size || d.p[dst_off + size] == 0);
+}
+
+int main(int argc, char** argv) {
+  uint32_t width = (uint32_t)std::stoi(arg_value(argc, argv, "--width", "3840"));
+  uint32_t height = (uint32_t)std::stoi(arg_value(argc, argv, "--height", "2160"));
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "100"));
+  size_t frame = (size_t)width * height * 3 / 2;
+
+  if (!udmabuf_available()) { LOGE("/dev/udmabuf not available"); return 1; }
+  UniqueFd rdma_fd(::open("/dev/rdma_stub0", O_RDWR | O_CLOEXEC));
+  if (!rdma_fd) { LOGE("open(/dev/rdma_stub0) failed"); return 1; }
+
+  UdmaBuffer src, dst;
+  if (udmabuf_alloc(frame, &src) != 0 || udmabuf_alloc(frame, &dst) != 0) {
+    LOGE("udmabuf allocation failed");
+    return 1;
+  }
+
+  struct { uint32_t src_off, dst_off, size; } cases[] = {
+    { 0, 0, (uint32_t)frame },           // whole frame
+    { 4000, 100, 3 * 4096 + 17 },        // crosses several page segments
+    { 4095, 8191, 65536 },               // straddles boundaries on both sides
+    { 0, 4096 * 7 + 64, 1 << 20 },
+  };
+  int failed = 0;
+  for (const auto& c : cases) {
+    if (c.src_off + c.size > frame || c.dst_off + c.size > frame) continue;
+    bool ok = verify_copy(rdma_fd.get(), src, dst, c.src_off, c.dst_off, c.size);
+    std::printf("verify src_off=%-6u dst_off=%-6u size=%-9u %s\n",
+                c.src_off, c.dst_off, c.size, ok ? "ok" : "FAILED");
+    failed += ok ? 0 : 1;
+  }
+
+  RdmaCopyReq r{};
+  r.src_fd = src.dmabuf.get();
+  r.dst_fd = dst.dmabuf.get();
+  r.size = (uint32_t)frame;
+  LatencySamples lat((size_t)iters);
+  for (int i = 0; i < iters; ++i) {
+    uint64_t t0 = bench_now_ns();
+    if (rdma_copy(rdma_fd.get(), r) != 0) { LOGE("rdma_copy failed"); return 1; }
+    lat.add(bench_now_ns() - t0);
+  }
+  lat.print("full-frame copy");
+  std::printf("throughput: %.2f GB/s (%ux%u NV12, %zu bytes)\n",
+              (double)frame / lat.mean(), width, height, frame);
+  return failed ? 1 : 0;
+}
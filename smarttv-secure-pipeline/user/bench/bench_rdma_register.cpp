@@ -0,0 +1,59 @@
+// Copy latency with per-copy dma-buf mapping vs. buffers registered once
+// with RDMA_IOC_REGISTER_BUF, across copy sizes.
+//   bench_rdma_register [--iters 200] [--max-size 16777216]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "../player/rdma_client.h"
+#include "../player/udmabuf.h"
+
+#include <string>
+
+int main(int argc, char** argv) {
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "200"));
+  size_t max_size = (size_t)std::stoull(arg_value(argc, argv, "--max-size", "16777216"));
+
+  if (!udmabuf_available()) { LOGE("/dev/udmabuf not available"); return 1; }
+  RdmaClient rdma;
+  if (!rdma.open()) return 1;
+
+  UdmaBuffer src, dst;
+  if (udmabuf_alloc(max_size, &src) != 0 || udmabuf_alloc(max_size, &dst) != 0) {
+    LOGE("udmabuf allocation failed");
+    return 1;
+  }
+
+  int hsrc = rdma.register_buffer(src.dmabuf.get());
+  int hdst = rdma.register_buffer(dst.dmabuf.get());
+  if (hsrc < 0 || hdst < 0) { LOGE("register_buffer failed (%d, %d)", hsrc, hdst); return 1; }
+
+  std::printf("%10s %14s %14s %10s\n", "size", "fd p50 (us)", "reg p50 (us)", "speedup");
+  for (size_t size = 4096; size <= max_size; size *= 4) {
+    LatencySamples by_fd((size_t)iters), by_handle((size_t)iters);
+
+    RdmaCopyReq r{};
+    r.size = (uint32_t)size;
+    for (int i = 0; i < iters; ++i) {
+      r.src_fd = src.dmabuf.get();
+      r.dst_fd = dst.dmabuf.get();
+      r.flags = 0;
+      uint64_t t0 = bench_now_ns();
+      if (rdma.copy(r) != 0) { LOGE("copy by fd failed"); return 1; }
+      by_fd.add(bench_now_ns() - t0);
+
+      r.src_fd = hsrc;
+      r.dst_fd = hdst;
+      r.flags = kRdmaCopySrcHandle | kRdmaCopyDstHandle;
+      t0 = bench_now_ns();
+      if (rdma.copy(r) != 0) { LOGE("copy by handle failed"); return 1; }
+      by_handle.add(bench_now_ns() - t0);
+    }
+
+    double a = (double)by_fd.percentile(50), b = (double)by_handle.percentile(50);
+    std::printf("%10zu %14.1f %14.1f %9.2fx\n", size, a / 1e3, b / 1e3, b > 0 ? a / b : 0.0);
+  }
+
+  rdma.unregister_buffer(hsrc);
+  rdma.unregister_buffer(hdst);
+  return 0;
+}
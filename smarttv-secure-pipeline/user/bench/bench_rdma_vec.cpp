@@ -0,0 +1,77 @@
+// Syscalls and latency for multi-region copies: one RDMA_IOC_COPY per
+// region vs. a single RDMA_IOC_COPY_V. Workloads: an NV12 frame moved plane
+// by plane, and a grid of overlay tiles.
+//   bench_rdma_vec [--width 3840] [--height 2160] [--tiles 64] [--iters 100]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "../player/rdma_client.h"
+#include "../player/udmabuf.h"
+
+#include <string>
+#include <vector>
+
+static void run(RdmaClient& rdma, const char* label, const std::vector<RdmaCopyReq>& regions, int iters) {
+  LatencySamples single((size_t)iters), batched((size_t)iters);
+  uint64_t single_calls = 0, batched_calls = 0;
+
+  for (int i = 0; i < iters; ++i) {
+    uint64_t t0 = bench_now_ns();
+    for (const RdmaCopyReq& r : regions) {
+      if (rdma.copy(r) != 0) { LOGE("%s: single copy failed", label); return; }
+      single_calls++;
+    }
+    single.add(bench_now_ns() - t0);
+
+    t0 = bench_now_ns();
+    if (rdma.copy_batch(regions.data(), regions.size()) != 0) { LOGE("%s: batch copy failed", label); return; }
+    batched_calls += (regions.size() + 63) / 64; // RDMA_MAX_VEC entries per ioctl
+    batched.add(bench_now_ns() - t0);
+  }
+
+  std::printf("%s: %zu regions\n", label, regions.size());
+  std::printf("  syscalls/iter: single=%.0f vectored=%.0f\n",
+              (double)single_calls / iters, (double)batched_calls / iters);
+  single.print("  RDMA_IOC_COPY x N");
+  batched.print("  RDMA_IOC_COPY_V");
+}
+
+int main(int argc, char** argv) {
+  uint32_t width = (uint32_t)std::stoi(arg_value(argc, argv, "--width", "3840"));
+  uint32_t height = (uint32_t)std::stoi(arg_value(argc, argv, "--height", "2160"));
+  int tiles = std::stoi(arg_value(argc, argv, "--tiles", "64"));
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "100"));
+  size_t luma = (size_t)width * height;
+  size_t frame = luma * 3 / 2;
+
+  if (!udmabuf_available()) { LOGE("/dev/udmabuf not available"); return 1; }
+  RdmaClient rdma;
+  if (!rdma.open()) return 1;
+
+  UdmaBuffer src, dst;
+  if (udmabuf_alloc(frame, &src) != 0 || udmabuf_alloc(frame, &dst) != 0) {
+    LOGE("udmabuf allocation failed");
+    return 1;
+  }
+
+  RdmaCopyReq base{};
+  base.src_fd = src.dmabuf.get();
+  base.dst_fd = dst.dmabuf.get();
+
+  std::vector<RdmaCopyReq> planes(2, base);
+  planes[0].size = (uint32_t)luma;
+  planes[1].src_off = planes[1].dst_off = (uint32_t)luma;
+  planes[1].size = (uint32_t)(frame - luma);
+  run(rdma, "NV12 planes", planes, iters);
+
+  // Tiles: 256-pixel-wide luma rows of the top-left region, one request each.
+  std::vector<RdmaCopyReq> tile_reqs;
+  for (int t = 0; t < tiles; ++t) {
+    RdmaCopyReq r = base;
+    r.src_off = r.dst_off = (uint32_t)((size_t)t * width);
+    r.size = 256;
+    tile_reqs.push_back(r);
+  }
+  run(rdma, "overlay tiles", tile_reqs, iters);
+  return 0;
+}
@@ -0,0 +1,56 @@
+// Reference-set allocation on /dev/svp0: SVP_IOC_ALLOC_BUF_BATCH vs. a loop
+// of SVP_IOC_ALLOC_BUF calls.
+//   bench_svp_alloc [--count 16] [--iters 50] [--width W] [--height H] [--heap NAME]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/fd.h"
+#include "../common/log.h"
+#include "../player/svp_client.h"
+
+#include <fcntl.h>
+#include <string>
+
+int main(int argc, char** argv) {
+  int count = std::stoi(arg_value(argc, argv, "--count", "16"));
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "50"));
+
+  BufferDesc d;
+  d.width = (uint32_t)std::stoi(arg_value(argc, argv, "--width", "3840"));
+  d.height = (uint32_t)std::stoi(arg_value(argc, argv, "--height", "2160"));
+  d.flags = 0x3; // SVP_BUF_SECURE | SVP_BUF_CPU_NOACCESS
+  d.heap = arg_value(argc, argv, "--heap", "");
+
+  UniqueFd svp_fd(::open("/dev/svp0", O_RDWR | O_CLOEXEC));
+  if (!svp_fd) { LOGE("open(/dev/svp0) failed"); return 1; }
+
+  std::printf("%ux%u count=%d iters=%d heap=%s\n", d.width, d.height, count, iters,
+              d.heap.empty() ? "(svp_heap_name)" : d.heap.c_str());
+
+  LatencySamples looped((size_t)iters), batched((size_t)iters);
+  for (int i = 0; i < iters; ++i) {
+    {
+      std::vector<UniqueFd> fds;
+      uint64_t t0 = bench_now_ns();
+      for (int k = 0; k < count; ++k) {
+        UniqueFd fd;
+        int rc = svp_alloc(svp_fd.get(), d, &fd);
+        if (rc != 0) { LOGE("svp_alloc failed rc=%d", rc); return 1; }
+        fds.push_back(std::move(fd));
+      }
+      looped.add(bench_now_ns() - t0);
+      for (const UniqueFd& fd : fds) svp_release(svp_fd.get(), d.session, fd.get());
+    }
+    {
+      std::vector<UniqueFd> fds;
+      uint64_t t0 = bench_now_ns();
+      int rc = svp_alloc_batch(svp_fd.get(), d, (size_t)count, &fds);
+      batched.add(bench_now_ns() - t0);
+      if (rc != 0) { LOGE("svp_alloc_batch failed rc=%d", rc); return 1; }
+      for (const UniqueFd& fd : fds) svp_release(svp_fd.get(), d.session, fd.get());
+    }
+  }
+
+  looped.print("looped SVP_IOC_ALLOC_BUF");
+  batched.print("SVP_IOC_ALLOC_BUF_BATCH");
+  return 0;
+}
@@ -0,0 +1,64 @@
+// Multi-client allocation stress for /dev/svp0. Each client thread opens
+// its own fd (its own driver context) and allocates/frees in a loop; the
+// aggregate rate should scale with the number of clients.
+//   bench_svp_stress [--max-clients 8] [--seconds 2] [--width W] [--height H]
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/fd.h"
+#include "../common/log.h"
+#include "../player/svp_client.h"
+
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ClientResult {
+  uint64_t allocs = 0;
+  uint64_t failures = 0;
+};
+
+static void client_loop(const BufferDesc& d, const std::atomic<bool>& stop, ClientResult* out) {
+  UniqueFd svp_fd(::open("/dev/svp0", O_RDWR | O_CLOEXEC));
+  if (!svp_fd) { out->failures++; return; }
+  while (!stop.load(std::memory_order_relaxed)) {
+    UniqueFd buf;
+    if (svp_alloc(svp_fd.get(), d, &buf) != 0) { out->failures++; continue; }
+    (void)svp_release(svp_fd.get(), d.session, buf.get());
+    out->allocs++;
+  }
+}
+
+int main(int argc, char** argv) {
+  int max_clients = std::stoi(arg_value(argc, argv, "--max-clients", "8"));
+  double seconds = std::stod(arg_value(argc, argv, "--seconds", "2"));
+
+  BufferDesc d;
+  d.width = (uint32_t)std::stoi(arg_value(argc, argv, "--width", "1920"));
+  d.height = (uint32_t)std::stoi(arg_value(argc, argv, "--height", "1080"));
+  d.flags = 0x3; // SVP_BUF_SECURE | SVP_BUF_CPU_NOACCESS
+
+  std::printf("%ux%u, %.1fs per step\n", d.width, d.height, seconds);
+  std::printf("%8s %14s %14s %10s\n", "clients", "allocs/s", "per-client/s", "failures");
+
+  for (int n = 1; n <= max_clients; n *= 2) {
+    std::atomic<bool> stop{false};
+    std::vector<ClientResult> results((size_t)n);
+    std::vector<std::thread> threads;
+
+    uint64_t t0 = bench_now_ns();
+    for (int i = 0; i < n; ++i) threads.emplace_back(client_loop, std::cref(d), std::cref(stop), &results[(size_t)i]);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (auto& t : threads) t.join();
+    double elapsed = (double)(bench_now_ns() - t0) / 1e9;
+
+    uint64_t allocs = 0, failures = 0;
+    for (const ClientResult& r : results) { allocs += r.allocs; failures += r.failures; }
+    std::printf("%8d %14.0f %14.0f %10llu\n", n, allocs / elapsed, allocs / elapsed / n,
+                (unsigned long long)failures);
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+// TEE work on a channel change (open session, import N key blobs, derive M
+// keys): one TEEC_InvokeCommand per command vs. a single TA_SVP_CMD_BATCH.
+//   bench_tee_batch [--keys 4] [--derive 2] [--blob-size 512] [--iters 2000]
+//                   [--invoke-ns 0]
+// Built with -DTEE_SVP_MOCK_TEEC=ON the TA runs in-process, world switches
+// are counted by the mock and --invoke-ns sets the simulated cost of each.
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "tee_svp_client.h"
+#ifdef TEE_SVP_MOCK_TEEC
+#include "teec_mock.h"
+#endif
+
+#include <string>
+#include <vector>
+
+static void print_transitions(const char* label, int iters, uint64_t calls) {
+#ifdef TEE_SVP_MOCK_TEEC
+  teec_mock_stats st;
+  teec_mock_get_stats(&st);
+  calls = st.invokes;
+  teec_mock_reset_stats();
+#endif
+  std::printf("%-28s %.1f world switches per channel change\n", label, (double)calls / iters);
+}
+
+int main(int argc, char** argv) {
+  int keys = std::stoi(arg_value(argc, argv, "--keys", "4"));
+  int derive = std::stoi(arg_value(argc, argv, "--derive", "2"));
+  size_t blob_size = (size_t)std::stoul(arg_value(argc, argv, "--blob-size", "512"));
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "2000"));
+#ifdef TEE_SVP_MOCK_TEEC
+  teec_mock_set_invoke_ns(std::stoull(arg_value(argc, argv, "--invoke-ns", "0")));
+#endif
+
+  std::vector<tee_svp_cmd> change;
+  std::vector<std::vector<uint8_t>> blobs((size_t)keys, std::vector<uint8_t>(blob_size, 0x5a));
+  change.push_back({ TA_SVP_CMD_OPEN_SESSION, nullptr, 0, 0 });
+  for (const auto& b : blobs) change.push_back({ TA_SVP_CMD_IMPORT_KEYBLOB, b.data(), b.size(), 0 });
+  for (int i = 0; i < derive; ++i) change.push_back({ TA_SVP_CMD_DERIVE_SESSION_KEY, nullptr, 0, 0 });
+  if (change.size() > TA_SVP_BATCH_MAX_CMDS) {
+    LOGE("at most %d commands per batch", TA_SVP_BATCH_MAX_CMDS);
+    return 1;
+  }
+
+  tee_svp_t* tee = tee_svp_open();
+  if (!tee) { LOGE("tee_svp_open failed (is OP-TEE + tee-supplicant running?)"); return 1; }
+#ifdef TEE_SVP_MOCK_TEEC
+  teec_mock_reset_stats();
+  std::printf("mock TEE, ");
+#endif
+  std::printf("%zu commands per channel change (%d x %zu-byte key blobs), %d iters\n",
+              change.size(), keys, blob_size, iters);
+
+  int rc = 0;
+  LatencySamples single((size_t)iters), batched((size_t)iters);
+  for (int i = 0; i < iters && rc == 0; ++i) {
+    uint64_t t0 = bench_now_ns();
+    for (const tee_svp_cmd& c : change) {
+      rc = tee_svp_invoke(tee, c.cmd, c.data, c.len);
+      if (rc != 0) break;
+    }
+    single.add(bench_now_ns() - t0);
+  }
+  single.print("one invoke per command");
+  print_transitions("", iters, (uint64_t)iters * change.size());
+
+  for (int i = 0; i < iters && rc == 0; ++i) {
+    uint64_t t0 = bench_now_ns();
+    rc = tee_svp_invoke_batch(tee, change.data(), change.size());
+    batched.add(bench_now_ns() - t0);
+  }
+  batched.print("TA_SVP_CMD_BATCH");
+  print_transitions("", iters, (uint64_t)iters);
+
+  if (rc != 0) {
+    LOGE("invoke failed rc=%d", rc);
+    for (const tee_svp_cmd& c : change) LOGE("  cmd 0x%04x result 0x%08x", c.cmd, c.result);
+  }
+  tee_svp_close(tee);
+  return rc == 0 ? 0 : 1;
+}
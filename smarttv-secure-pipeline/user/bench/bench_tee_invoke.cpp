@@ -0,0 +1,98 @@
+// Per-call cost of handing a buffer to the SVP TA: TEEC_MEMREF_TEMP_INPUT
+// (libteec bounce buffer per invoke) vs. persistent shared memory referenced
+// with TEEC_MEMREF_PARTIAL_INPUT, either copied into or built in place.
+//   bench_tee_invoke [--iters 20000] [--size 2048] [--slots 8] [--invoke-ns 0]
+// With -DTEE_SVP_MOCK_TEEC=ON no OP-TEE is needed; allocation and copy counts
+// are then printed too, and --invoke-ns adds a simulated world switch.
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/log.h"
+#include "tee_svp_client.h"
+#ifdef TEE_SVP_MOCK_TEEC
+#include "teec_mock.h"
+#endif
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+static void print_counters(int iters) {
+#ifdef TEE_SVP_MOCK_TEEC
+  teec_mock_stats st;
+  teec_mock_get_stats(&st);
+  std::printf("%-28s invokes=%llu bounce allocs/call=%.2f bounce bytes/call=%.0f shm setups=%llu\n", "",
+              (unsigned long long)st.invokes, (double)st.temp_allocs / iters,
+              (double)st.temp_bytes / iters,
+              (unsigned long long)(st.shm_allocs + st.shm_registers));
+  teec_mock_reset_stats();
+#else
+  (void)iters;
+#endif
+}
+
+int main(int argc, char** argv) {
+  int iters = std::stoi(arg_value(argc, argv, "--iters", "20000"));
+  size_t size = (size_t)std::stoul(arg_value(argc, argv, "--size", "2048"));
+  size_t slots = (size_t)std::stoul(arg_value(argc, argv, "--slots", "8"));
+#ifdef TEE_SVP_MOCK_TEEC
+  teec_mock_set_invoke_ns(std::stoull(arg_value(argc, argv, "--invoke-ns", "0")));
+#endif
+
+  tee_svp_t* tee = tee_svp_open();
+  if (!tee) { LOGE("tee_svp_open failed (is OP-TEE + tee-supplicant running?)"); return 1; }
+
+  std::vector<uint8_t> blob(size);
+  for (size_t i = 0; i < size; ++i) blob[i] = (uint8_t)i;
+  std::vector<uint8_t> arena(size * slots);
+  tee_svp_shm_t* shm = tee_svp_shm_alloc(tee, size);
+  tee_svp_shm_t* reg = tee_svp_shm_register(tee, arena.data(), arena.size());
+  if (!shm || !reg) {
+    LOGE("shared memory setup failed");
+    tee_svp_shm_release(shm);
+    tee_svp_shm_release(reg);
+    tee_svp_close(tee);
+    return 1;
+  }
+#ifdef TEE_SVP_MOCK_TEEC
+  teec_mock_reset_stats();
+  std::printf("mock libteec, ");
+#endif
+  std::printf("%zu-byte buffers, %d invokes per mode\n", size, iters);
+
+  int rc = 0;
+  LatencySamples temp((size_t)iters), copied((size_t)iters), in_place((size_t)iters);
+  for (int i = 0; i < iters && rc == 0; ++i) {
+    uint64_t t0 = bench_now_ns();
+    rc = tee_svp_import_keyblob(tee, blob.data(), blob.size());
+    temp.add(bench_now_ns() - t0);
+  }
+  temp.print("TEMP_INPUT");
+  print_counters(iters);
+
+  for (int i = 0; i < iters && rc == 0; ++i) {
+    uint64_t t0 = bench_now_ns();
+    std::memcpy(tee_svp_shm_data(shm), blob.data(), size);
+    rc = tee_svp_import_keyblob_shm(tee, shm, 0, size);
+    copied.add(bench_now_ns() - t0);
+  }
+  copied.print("copy + PARTIAL_INPUT");
+  print_counters(iters);
+
+  // Producer writes straight into registered slots; each call references
+  // its slot by offset.
+  for (int i = 0; i < iters && rc == 0; ++i) {
+    size_t off = (size_t)i % slots * size;
+    arena[off] = (uint8_t)i;
+    uint64_t t0 = bench_now_ns();
+    rc = tee_svp_import_keyblob_shm(tee, reg, off, size);
+    in_place.add(bench_now_ns() - t0);
+  }
+  in_place.print("in-place PARTIAL_INPUT");
+  print_counters(iters);
+
+  if (rc != 0) LOGE("invoke failed rc=%d", rc);
+  tee_svp_shm_release(shm);
+  tee_svp_shm_release(reg);
+  tee_svp_close(tee);
+  return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+inline uint64_t bench_now_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Collects per-iteration latencies and reports percentiles.
+class LatencySamples {
+public:
+  explicit LatencySamples(size_t reserve = 0) { ns_.reserve(reserve); }
+
+  void add(uint64_t ns) { ns_.push_back(ns); sorted_ = false; }
+  void merge(const LatencySamples& o) {
+    ns_.insert(ns_.end(), o.ns_.begin(), o.ns_.end());
+    sorted_ = false;
+  }
+  size_t count() const { return ns_.size(); }
+
+  uint64_t percentile(double p) {
+    if (ns_.empty()) return 0;
+    sort();
+    size_t idx = (size_t)(p / 100.0 * (double)(ns_.size() - 1) + 0.5);
+    return ns_[std::min(idx, ns_.size() - 1)];
+  }
+
+  double mean() const {
+    if (ns_.empty()) return 0.0;
+    long double sum = 0;
+    for (uint64_t v : ns_) sum += v;
+    return (double)(sum / ns_.size());
+  }
+
+  void print(const char* label) {
+    std::printf("%-28s n=%-7zu mean=%9.1fus p50=%9.1fus p99=%9.1fus max=%9.1fus\n",
+                label, count(), mean() / 1e3,
+                percentile(50) / 1e3, percentile(99) / 1e3, percentile(100) / 1e3);
+  }
+
+private:
+  void sort() {
+    if (!sorted_) { std::sort(ns_.begin(), ns_.end()); sorted_ = true; }
+  }
+
+  std::vector<uint64_t> ns_;
+  bool sorted_ = false;
+};
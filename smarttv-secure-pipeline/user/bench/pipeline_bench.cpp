@@ -0,0 +1,514 @@
+// Benchmark suite over the playback hot paths, reported as JSON for
+// release-to-release comparison:
+//   alloc   SVP buffer allocation + free        /dev/svp0      | memfd
+//   copy    secure copy, 4 KiB .. 32 MiB        /dev/rdma_stub0 + udmabuf | memcpy
+//   tee     TA invoke round trip (key import)   libteec        | mock libteec (build option)
+//   import  dma-buf import + draw               udmabuf + surfaceless EGL (skipped without)
+//   e2e     staged feed/copy/present fps        svp/rdma/--card | memfd, memcpy, null sink
+// Real devices are used when they open; --standin forces the stand-ins.
+// --input feeds e2e from a raw NV12/P010 (--format) or Y4M file into memfd
+// buffers instead of a pattern, and adds the ingest rate (file MB/s).
+//   pipeline_bench [--cases alloc,copy,tee,import,e2e] [--warmup 10] [--iters 200]
+//                  [--json report.json|-] [--standin] [--width 1920] [--height 1080]
+//                  [--frames 300] [--runs 3] [--card /dev/dri/card0] [--interval-us 0]
+//                  [--input file.y4m|file.yuv] [--format nv12|nv21|p010] [--fps 60]
+//                  [--realtime] [--loop]
+// Every case runs --warmup untimed iterations first. Copies stop early once
+// 1 GiB has been copied at a size, so large sizes finish quickly.
+#include "bench_json.h"
+#include "bench_util.h"
+#include "../common/args.h"
+#include "../common/fd.h"
+#include "../common/log.h"
+#include "../player/buffer_allocator.h"
+#include "../player/cpu_copy.h"
+#include "../player/file_source.h"
+#include "../player/rdma_client.h"
+#include "../player/secure_buffer_pool.h"
+#include "../player/staged_pipeline.h"
+#include "../player/udmabuf.h"
+#include "../renderer/gbm_kms_renderer.h"
+#include "tee_svp_client.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include "../../kernel/secure_video/svp_uapi.h"
+}
+
+namespace {
+
+struct Options {
+  int warmup = 10;
+  int iters = 200;
+  bool standin = false;
+  BufferDesc desc;
+  uint64_t frames = 300;
+  int runs = 3;
+  std::string card;
+  uint32_t interval_us = 0;
+  FileSourceConfig input; // e2e source when input.path is set
+};
+
+struct Result {
+  std::string name;
+  std::string variant;
+  std::string backend;
+  std::string status = "ok"; // ok | skipped | failed
+  std::string note;
+  int warmup = 0;
+  LatencySamples lat;
+  uint64_t bytes = 0;      // buffer size / bytes moved per iteration
+  bool throughput = false; // bytes / mean latency is meaningful
+  double fps = 0.0;
+};
+
+// Runs fn() opt.warmup times untimed, then `iters` timed times. fn returns
+// 0 or a negative errno; the first failure stops the loop.
+template <typename Fn>
+int measure(int warmup, int iters, Result* r, Fn&& fn) {
+  r->warmup = warmup;
+  for (int i = 0; i < warmup; ++i) {
+    int rc = fn();
+    if (rc != 0) return rc;
+  }
+  for (int i = 0; i < iters; ++i) {
+    uint64_t t0 = bench_now_ns();
+    int rc = fn();
+    r->lat.add(bench_now_ns() - t0);
+    if (rc != 0) return rc;
+  }
+  return 0;
+}
+
+Result skipped(const char* name, const std::string& why) {
+  Result r;
+  r.name = name;
+  r.status = "skipped";
+  r.note = why;
+  return r;
+}
+
+void finish(Result* r, int rc) {
+  if (rc == 0) return;
+  r->status = "failed";
+  r->note = std::string("rc=") + std::to_string(rc) + " (" + std::strerror(-rc) + ")";
+}
+
+// --- alloc -----------------------------------------------------------------
+
+Result bench_alloc(const Options& o) {
+  Result r;
+  r.name = "alloc";
+  char v[32];
+  std::snprintf(v, sizeof(v), "%ux%u", o.desc.width, o.desc.height);
+  r.variant = v;
+
+  UniqueFd svp;
+  if (!o.standin) svp.reset(::open("/dev/svp0", O_RDWR | O_CLOEXEC));
+  std::unique_ptr<IBufferAllocator> alloc =
+      svp ? CreateSvpAllocator(svp.get()) : CreateMemfdAllocator();
+  r.backend = alloc->name();
+
+  BufferLayout layout{};
+  int rc = measure(o.warmup, o.iters, &r, [&] {
+    UniqueFd fd;
+    int rc = alloc->allocate(o.desc, &fd, &layout);
+    if (rc == 0) alloc->release(o.desc, fd.get());
+    return rc;
+  });
+  r.bytes = layout.size;
+  finish(&r, rc);
+  return r;
+}
+
+// --- copy ------------------------------------------------------------------
+
+constexpr size_t kCopySizes[] = {
+  4u << 10, 16u << 10, 64u << 10, 256u << 10, 1u << 20, 4u << 20, 16u << 20, 32u << 20,
+};
+constexpr size_t kCopyMaxSize = 32u << 20;
+constexpr uint64_t kCopyBytesPerSize = 1ull << 30;
+
+struct Mapping {
+  void* p = MAP_FAILED;
+  size_t size = 0;
+  Mapping(int fd, size_t sz) : size(sz) {
+    p = ::mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ~Mapping() { if (p != MAP_FAILED) ::munmap(p, size); }
+  bool ok() const { return p != MAP_FAILED; }
+};
+
+void bench_copy(const Options& o, std::vector<Result>* out) {
+  RdmaClient rdma;
+  UdmaBuffer src, dst;
+  bool use_rdma = !o.standin && udmabuf_available() && rdma.open() && rdma.has_channel() &&
+                  udmabuf_alloc(kCopyMaxSize, &src) == 0 &&
+                  udmabuf_alloc(kCopyMaxSize, &dst) == 0;
+
+  // CPU stand-in: two memfds mapped once, so only the copy is timed.
+  UniqueFd src_mfd, dst_mfd;
+  std::unique_ptr<Mapping> src_map, dst_map;
+  if (!use_rdma) {
+    src_mfd.reset(::memfd_create("bench-src", MFD_CLOEXEC));
+    dst_mfd.reset(::memfd_create("bench-dst", MFD_CLOEXEC));
+    if (!src_mfd || !dst_mfd || ::ftruncate(src_mfd.get(), kCopyMaxSize) != 0 ||
+        ::ftruncate(dst_mfd.get(), kCopyMaxSize) != 0) {
+      out->push_back(skipped("copy", "memfd setup failed"));
+      return;
+    }
+    src_map.reset(new Mapping(src_mfd.get(), kCopyMaxSize));
+    dst_map.reset(new Mapping(dst_mfd.get(), kCopyMaxSize));
+    if (!src_map->ok() || !dst_map->ok()) {
+      out->push_back(skipped("copy", "mmap failed"));
+      return;
+    }
+    std::memset(src_map->p, 0x5a, kCopyMaxSize);
+    std::memset(dst_map->p, 0, kCopyMaxSize); // fault the pages in up front
+  }
+
+  // CpuCopier on the same buffers, through their fds like the pipeline.
+  CpuCopier cpu;
+  RdmaCopyReq cpu_req{};
+  cpu_req.src_fd = use_rdma ? src.dmabuf.get() : src_mfd.get();
+  cpu_req.dst_fd = use_rdma ? dst.dmabuf.get() : dst_mfd.get();
+
+  for (size_t size : kCopySizes) {
+    Result r;
+    r.name = "copy";
+    r.variant = std::to_string(size);
+    r.backend = use_rdma ? "rdma" : "memcpy";
+    r.bytes = size;
+    r.throughput = true;
+    int iters = (int)std::min<uint64_t>((uint64_t)o.iters,
+                                        std::max<uint64_t>(10, kCopyBytesPerSize / size));
+    int rc = measure(std::min(o.warmup, iters), iters, &r, [&] {
+      if (!use_rdma) {
+        std::memcpy(dst_map->p, src_map->p, size);
+        return 0;
+      }
+      RdmaCopyReq req{};
+      req.src_fd = src.dmabuf.get();
+      req.dst_fd = dst.dmabuf.get();
+      req.size = (uint32_t)size;
+      return rdma.copy(req);
+    });
+    finish(&r, rc);
+    out->push_back(std::move(r));
+
+    Result c;
+    c.name = "copy";
+    c.variant = std::to_string(size);
+    c.backend = std::string("cpu-") + CpuCopier::isa();
+    c.bytes = size;
+    c.throughput = true;
+    cpu_req.size = (uint32_t)size;
+    rc = measure(std::min(o.warmup, iters), iters, &c, [&] { return cpu.copy(cpu_req); });
+    finish(&c, rc);
+    out->push_back(std::move(c));
+  }
+}
+
+// --- tee -------------------------------------------------------------------
+
+Result bench_tee(const Options& o) {
+#ifdef TEE_SVP_MOCK_TEEC
+  const char* backend = "mock-libteec";
+#else
+  const char* backend = "libteec";
+#endif
+  tee_svp_t* tee = tee_svp_open();
+  if (!tee) return skipped("tee", "tee_svp_open failed (OP-TEE/tee-supplicant not running?)");
+
+  // The player's path: the key blob is built in registered shared memory
+  // and referenced in place.
+  std::vector<uint8_t> blob(2048, 0xa5);
+  tee_svp_shm_t* shm = tee_svp_shm_register(tee, blob.data(), blob.size());
+  if (!shm) {
+    tee_svp_close(tee);
+    return skipped("tee", "tee_svp_shm_register failed");
+  }
+
+  Result r;
+  r.name = "tee";
+  r.variant = "import_keyblob_shm/2048";
+  r.backend = backend;
+  r.bytes = blob.size();
+  int rc = measure(o.warmup, o.iters, &r, [&] {
+    return tee_svp_import_keyblob_shm(tee, shm, 0, blob.size()) == 0 ? 0 : -EIO;
+  });
+  finish(&r, rc);
+  tee_svp_shm_release(shm);
+  tee_svp_close(tee);
+  return r;
+}
+
+// --- import ----------------------------------------------------------------
+
+void bench_import(const Options& o, std::vector<Result>* out) {
+  if (!udmabuf_available()) {
+    out->push_back(skipped("import", "/dev/udmabuf not available"));
+    return;
+  }
+  BufferLayout layout{};
+  if (buffer_layout(o.desc, &layout) != 0) {
+    out->push_back(skipped("import", "unsupported buffer format"));
+    return;
+  }
+  constexpr size_t kBuffers = 4;
+  std::vector<UdmaBuffer> bufs(kBuffers);
+  for (UdmaBuffer& b : bufs) {
+    if (udmabuf_alloc((size_t)layout.size, &b) != 0) {
+      out->push_back(skipped("import", "udmabuf allocation failed"));
+      return;
+    }
+  }
+
+  GbmKmsRenderer renderer;
+  if (!renderer.init_headless(o.desc.width, o.desc.height)) {
+    out->push_back(skipped("import", "surfaceless EGL not available"));
+    return;
+  }
+
+  char v[32];
+  std::snprintf(v, sizeof(v), "%ux%u", o.desc.width, o.desc.height);
+  size_t next = 0;
+  auto draw = [&](bool reimport) {
+    int fd = bufs[next++ % kBuffers].dmabuf.get();
+    if (reimport) renderer.forget_dmabuf(fd);
+    bool ok = renderer.render_dmabuf_frame(fd, o.desc.width, o.desc.height, o.desc.fourcc,
+                                           layout.pitches, layout.offsets);
+    renderer.finish();
+    return ok ? 0 : -EIO;
+  };
+
+  for (bool reimport : { true, false }) {
+    Result r;
+    r.name = "import";
+    r.variant = std::string(reimport ? "import+draw/" : "cached_draw/") + v;
+    r.backend = "udmabuf+egl";
+    r.bytes = layout.size;
+    finish(&r, measure(o.warmup, o.iters, &r, [&] { return draw(reimport); }));
+    out->push_back(std::move(r));
+  }
+  renderer.shutdown();
+}
+
+// --- e2e -------------------------------------------------------------------
+
+Result bench_e2e(const Options& o) {
+  Result r;
+  r.name = "e2e";
+
+  StagedPipelineConfig cfg;
+  cfg.frames = o.frames;
+  BufferPoolConfig pool_cfg;
+  pool_cfg.desc = o.desc;
+  pool_cfg.max_buffers = 2 * cfg.ring_depth + 4;
+  pool_cfg.high_watermark = pool_cfg.max_buffers;
+
+  // A file is written into memfd buffers by the CPU (its rate, not the
+  // device's, is what is measured), so no svp/rdma then.
+  CpuCopier cpu;
+  std::unique_ptr<FileFrameSource> file;
+  if (!o.input.path.empty()) {
+    FileSourceConfig in = o.input;
+    in.width = o.desc.width;
+    in.height = o.desc.height;
+    in.readahead_frames = pool_cfg.max_buffers;
+    file = CreateFileSource(in, &cpu);
+    if (!file) return skipped("e2e", "cannot read " + in.path);
+    pool_cfg.desc.width = file->info().width;
+    pool_cfg.desc.height = file->info().height;
+    pool_cfg.desc.fourcc = file->info().fourcc;
+  }
+
+  UniqueFd svp;
+  if (!o.standin && !file) svp.reset(::open("/dev/svp0", O_RDWR | O_CLOEXEC));
+  RdmaClient rdma;
+  bool use_rdma = !o.standin && !file && rdma.open() && rdma.has_channel();
+
+  // Secure buffers are not CPU-mappable: no CPU fill, and no copy without RDMA.
+  std::unique_ptr<IFrameSource> pattern = svp ? CreateNullSource() : CreatePatternSource();
+  IFrameSource* source = file ? file.get() : pattern.get();
+  uint32_t buf_flags = svp ? (uint32_t)(SVP_BUF_SECURE | SVP_BUF_CPU_NOACCESS) : 0u;
+  std::unique_ptr<ICopyEngine> copy;
+  if (use_rdma || !svp) copy = CreateAutoCopyEngine(use_rdma ? &rdma : nullptr, &cpu, buf_flags);
+
+  auto make_alloc = [&] { return svp ? CreateSvpAllocator(svp.get()) : CreateMemfdAllocator(); };
+  SecureBufferPool src(make_alloc(), pool_cfg), dst(make_alloc(), pool_cfg);
+  src.set_free_hook([&cpu](int fd) { cpu.forget_buffer(fd); });
+  dst.set_free_hook([&cpu](int fd) { cpu.forget_buffer(fd); });
+  if (!src.init() || (copy && !dst.init())) return skipped("e2e", "pool allocation failed");
+  GbmKmsRenderer renderer;
+  std::unique_ptr<IFrameSink> sink = o.card.empty()
+      ? CreateNullSink(o.interval_us) : CreateRendererSink(&renderer, o.card, pool_cfg.desc);
+
+  char v[64];
+  std::snprintf(v, sizeof(v), "%ux%u/%llu_frames", pool_cfg.desc.width, pool_cfg.desc.height,
+                (unsigned long long)o.frames);
+  r.variant = v;
+  r.backend = std::string(file ? "file+" : "") + src.backend() + "+" +
+              (copy ? copy->name() : "nocopy") + "+" + sink->name();
+  if (file) {
+    size_t slash = o.input.path.rfind('/');
+    r.variant = o.input.path.substr(slash == std::string::npos ? 0 : slash + 1) + "/" + v;
+    r.bytes = file->info().frame_bytes; // per mean frame period: ingest rate
+    r.throughput = true;
+  }
+
+  // One sample per run: mean frame period.
+  int warmup = o.warmup > 0 ? 1 : 0;
+  double fps_sum = 0.0;
+  int rc = 0;
+  for (int i = 0; i < warmup + o.runs && rc == 0; ++i) {
+    StagedPipeline sp(&src, copy ? &dst : nullptr, source, copy.get(), sink.get());
+    rc = sp.run(cfg);
+    if (i < warmup || rc != 0) continue;
+    r.lat.add(sp.stats().frames ? sp.stats().elapsed_ns / sp.stats().frames : 0);
+    fps_sum += sp.stats().fps();
+  }
+  r.warmup = warmup;
+  r.fps = o.runs > 0 ? fps_sum / o.runs : 0.0;
+  finish(&r, rc);
+  return r;
+}
+
+// --- report ----------------------------------------------------------------
+
+void print_human(Result& r) {
+  std::string label = r.name + (r.variant.empty() ? "" : "/" + r.variant);
+  if (r.status != "ok" && r.lat.count() == 0) {
+    std::printf("%-34s %-8s %s\n", label.c_str(), r.status.c_str(), r.note.c_str());
+    return;
+  }
+  std::printf("%-34s %-20s n=%-5zu p50=%9.1fus p99=%9.1fus", label.c_str(), r.backend.c_str(),
+              r.lat.count(), r.lat.percentile(50) / 1e3, r.lat.percentile(99) / 1e3);
+  if (r.fps > 0) std::printf(" %.1f fps", r.fps);
+  if (r.throughput && r.lat.mean() > 0)
+    std::printf(" %.0f MB/s", (double)r.bytes / r.lat.mean() * 1e3);
+  if (r.status != "ok") std::printf(" %s %s", r.status.c_str(), r.note.c_str());
+  std::printf("\n");
+}
+
+void write_json(JsonWriter* j, Result& r) {
+  j->begin_object();
+  j->field("name", r.name);
+  j->field("variant", r.variant);
+  j->field("backend", r.backend);
+  j->field("status", r.status);
+  if (!r.note.empty()) j->field("note", r.note);
+  if (r.lat.count() > 0) {
+    j->field("warmup", r.warmup);
+    j->field("iterations", (uint64_t)r.lat.count());
+    j->begin_object("latency_ns");
+    j->field("mean", r.lat.mean());
+    j->field("min", r.lat.percentile(0));
+    j->field("p50", r.lat.percentile(50));
+    j->field("p90", r.lat.percentile(90));
+    j->field("p99", r.lat.percentile(99));
+    j->field("max", r.lat.percentile(100));
+    j->end_object();
+    if (r.bytes) j->field("bytes", r.bytes);
+    if (r.throughput) j->field("throughput_mb_s", (double)r.bytes / r.lat.mean() * 1e3);
+    if (r.fps > 0) j->field("fps", r.fps);
+  }
+  j->end_object();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  std::string cases = arg_value(argc, argv, "--cases", "alloc,copy,tee,import,e2e");
+  std::string json_path = arg_value(argc, argv, "--json", "");
+  o.warmup = std::stoi(arg_value(argc, argv, "--warmup", "10"));
+  o.iters = std::stoi(arg_value(argc, argv, "--iters", "200"));
+  o.standin = has_flag(argc, argv, "--standin");
+  o.desc.width = (uint32_t)std::stoul(arg_value(argc, argv, "--width", "1920"));
+  o.desc.height = (uint32_t)std::stoul(arg_value(argc, argv, "--height", "1080"));
+  o.frames = std::stoull(arg_value(argc, argv, "--frames", "300"));
+  o.runs = std::stoi(arg_value(argc, argv, "--runs", "3"));
+  o.card = arg_value(argc, argv, "--card", "");
+  o.interval_us = (uint32_t)std::stoul(arg_value(argc, argv, "--interval-us", "0"));
+  o.input.path = arg_value(argc, argv, "--input", "");
+  std::string format = arg_value(argc, argv, "--format", "nv12");
+  if (!ParseRawFormat(format, &o.input.fourcc)) {
+    LOGE("pipeline_bench: unknown --format %s (want nv12, nv21 or p010)", format.c_str());
+    return 1;
+  }
+  o.input.fps = std::stod(arg_value(argc, argv, "--fps", "60"));
+  o.input.realtime = has_flag(argc, argv, "--realtime");
+  o.input.loop = has_flag(argc, argv, "--loop");
+  auto want = [&](const char* c) {
+    return ("," + cases + ",").find(std::string(",") + c + ",") != std::string::npos;
+  };
+
+  std::vector<Result> results;
+  if (want("alloc")) results.push_back(bench_alloc(o));
+  if (want("copy")) bench_copy(o, &results);
+  if (want("tee")) results.push_back(bench_tee(o));
+  if (want("import")) bench_import(o, &results);
+  if (want("e2e")) results.push_back(bench_e2e(o));
+
+  bool json_stdout = json_path == "-";
+  bool failed = false;
+  for (Result& r : results) {
+    if (!json_stdout) print_human(r);
+    failed |= r.status == "failed";
+  }
+
+  if (!json_path.empty()) {
+    utsname u{};
+    ::uname(&u);
+    JsonWriter j;
+    j.begin_object();
+    j.field("suite", "pipeline_bench");
+    j.field("format_version", 1);
+    j.field("timestamp", (int64_t)std::time(nullptr));
+    j.begin_object("host");
+    j.field("nodename", u.nodename);
+    j.field("release", u.release);
+    j.field("machine", u.machine);
+    j.field("cpus", (int64_t)::sysconf(_SC_NPROCESSORS_ONLN));
+    j.end_object();
+    j.begin_object("config");
+    j.field("warmup", o.warmup);
+    j.field("iterations", o.iters);
+    j.field("standin", o.standin);
+    j.field("width", (uint64_t)o.desc.width);
+    j.field("height", (uint64_t)o.desc.height);
+    j.field("frames", o.frames);
+    j.field("runs", o.runs);
+    if (!o.input.path.empty()) j.field("input", o.input.path);
+    j.end_object();
+    j.begin_array("results");
+    for (Result& r : results) write_json(&j, r);
+    j.end_array();
+    j.end_object();
+
+    if (json_stdout) {
+      std::printf("%s\n", j.str().c_str());
+    } else {
+      FILE* f = std::fopen(json_path.c_str(), "w");
+      bool ok = f && std::fprintf(f, "%s\n", j.str().c_str()) >= 0;
+      if (f && std::fclose(f) != 0) ok = false;
+      if (!ok) {
+        LOGE("cannot write %s", json_path.c_str());
+        return 1;
+      }
+      std::printf("report written to %s\n", json_path.c_str());
+    }
+  }
+  log_flush();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+
+// Minimal "--key value" / "--flag" command line helpers shared by the apps.
+inline std::string arg_value(int argc, char** argv, const char* key, const std::string& def) {
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (std::string(argv[i]) == key) return argv[i + 1];
+  }
+  return def;
+}
+
+inline bool has_flag(int argc, char** argv, const char* key) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == key) return true;
+  }
+  return false;
+}
@@ -0,0 +1,303 @@
+#include "log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kRingSlots = 256; // per logging thread, power of two
+constexpr size_t kTextMax = 240;
+constexpr int kFlushIntervalMs = 20;
+
+uint64_t mono_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+struct Record {
+  uint64_t ts_ns;
+  uint16_t len;
+  uint8_t level;
+  char text[kTextMax];
+};
+
+// Single producer (the owning thread), single consumer (whoever holds
+// Logger::drain_mu, normally the flusher).
+struct Ring {
+  alignas(64) std::atomic<uint32_t> head{0};
+  alignas(64) std::atomic<uint32_t> tail{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<bool> retired{false};
+  int tid = 0;
+  Record slots[kRingSlots];
+};
+
+class Logger {
+public:
+  static Logger& get();
+
+  void add(const std::shared_ptr<Ring>& r) {
+    std::lock_guard<std::mutex> g(rings_mu_);
+    rings_.push_back(r);
+  }
+
+  // The flusher sleeps up to kFlushIntervalMs; errors and filling rings wake
+  // it early. At most one wake-up is outstanding.
+  void wake() {
+    if (!wake_pending_.exchange(true, std::memory_order_acq_rel)) {
+      uint64_t one = 1;
+      (void)!::write(efd_, &one, sizeof(one));
+    }
+  }
+
+  void drain();
+  bool stopped() const { return stopped_.load(std::memory_order_acquire); }
+
+private:
+  Logger();
+  void flusher();
+  static void at_exit();
+
+  std::mutex rings_mu_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+  std::mutex drain_mu_;
+  std::string out_;
+  int efd_ = -1;
+  std::atomic<bool> wake_pending_{false};
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> stopped_{false};
+  std::thread thread_;
+};
+
+const char kLevelChar[] = { 'D', 'I', 'W', 'E' };
+
+size_t format_prefix(char* buf, size_t cap, int level, uint64_t ts_ns, int tid) {
+  int n = std::snprintf(buf, cap, "[%c %llu.%06llu %d] ", kLevelChar[level & 3],
+                        (unsigned long long)(ts_ns / 1000000000ull),
+                        (unsigned long long)(ts_ns % 1000000000ull / 1000), tid);
+  return n > 0 ? std::min((size_t)n, cap - 1) : 0;
+}
+
+void write_all(int fd, const char* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = ::write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    p += w;
+    n -= (size_t)w;
+  }
+}
+
+int current_tid() {
+  thread_local int tid = (int)::syscall(SYS_gettid);
+  return tid;
+}
+
+// Marks the ring retired when its thread exits; the flusher frees it once
+// drained.
+struct ThreadRing {
+  std::shared_ptr<Ring> ring;
+  ~ThreadRing() {
+    if (ring) ring->retired.store(true, std::memory_order_release);
+  }
+};
+thread_local ThreadRing t_ring;
+
+Ring* local_ring() {
+  if (!t_ring.ring) {
+    auto r = std::make_shared<Ring>();
+    r->tid = current_tid();
+    Logger::get().add(r);
+    t_ring.ring = std::move(r);
+  }
+  return t_ring.ring.get();
+}
+
+int parse_level(const char* s) {
+  static const char* const names[] = { "debug", "info", "warn", "error", "off" };
+  for (int i = 0; i <= kLogOff; ++i)
+    if (!std::strcmp(s, names[i])) return i;
+  if (s[0] >= '0' && s[0] <= '4' && !s[1]) return s[0] - '0';
+  return -1;
+}
+
+// LOG_LEVEL applies before the first message, not only once the logger starts.
+const bool g_env_level = [] {
+  const char* s = std::getenv("LOG_LEVEL");
+  int lvl = s ? parse_level(s) : -1;
+  if (lvl >= 0) g_log_level.store(lvl, std::memory_order_relaxed);
+  return lvl >= 0;
+}();
+
+} // namespace
+
+Logger& Logger::get() {
+  // Leaked on purpose: logging from static destructors must stay safe.
+  static Logger* l = new Logger();
+  return *l;
+}
+
+Logger::Logger() : efd_(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  thread_ = std::thread([this] { flusher(); });
+  std::atexit(at_exit);
+}
+
+void Logger::at_exit() {
+  Logger& l = get();
+  l.stop_.store(true, std::memory_order_release);
+  l.wake_pending_.store(false, std::memory_order_relaxed);
+  l.wake();
+  if (l.thread_.joinable()) l.thread_.join();
+  // Later messages are written synchronously; pick up what is queued.
+  l.stopped_.store(true, std::memory_order_release);
+  l.drain();
+}
+
+void Logger::flusher() {
+  while (!stop_.load(std::memory_order_acquire)) {
+    pollfd pfd{efd_, POLLIN, 0};
+    if (::poll(&pfd, 1, kFlushIntervalMs) > 0) {
+      uint64_t v;
+      (void)!::read(efd_, &v, sizeof(v));
+    }
+    wake_pending_.store(false, std::memory_order_release);
+    drain();
+  }
+}
+
+void Logger::drain() {
+  std::lock_guard<std::mutex> dg(drain_mu_);
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard<std::mutex> g(rings_mu_);
+    rings = rings_;
+  }
+
+  struct Pending { const Record* rec; const Ring* ring; };
+  std::vector<Pending> batch;
+  std::vector<uint32_t> tails(rings.size());
+  for (size_t i = 0; i < rings.size(); ++i) {
+    Ring& r = *rings[i];
+    uint32_t h = r.head.load(std::memory_order_relaxed);
+    tails[i] = r.tail.load(std::memory_order_acquire);
+    for (uint32_t k = h; k != tails[i]; ++k)
+      batch.push_back({ &r.slots[k & (kRingSlots - 1)], &r });
+  }
+  // Interleave threads in time order, at least within one batch.
+  std::stable_sort(batch.begin(), batch.end(), [](const Pending& a, const Pending& b) {
+    return a.rec->ts_ns < b.rec->ts_ns;
+  });
+
+  out_.clear();
+  char prefix[64];
+  for (const Pending& p : batch) {
+    out_.append(prefix, format_prefix(prefix, sizeof(prefix), p.rec->level, p.rec->ts_ns,
+                                      p.ring->tid));
+    out_.append(p.rec->text, p.rec->len);
+    out_.push_back('\n');
+  }
+  for (size_t i = 0; i < rings.size(); ++i) {
+    Ring& r = *rings[i];
+    r.head.store(tails[i], std::memory_order_release);
+    uint64_t dropped = r.dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped) {
+      out_.append(prefix, format_prefix(prefix, sizeof(prefix), kLogWarn, mono_ns(), r.tid));
+      out_ += "log: " + std::to_string(dropped) + " messages dropped (ring full)\n";
+    }
+  }
+  if (!out_.empty()) write_all(STDERR_FILENO, out_.data(), out_.size());
+
+  std::lock_guard<std::mutex> g(rings_mu_);
+  rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<Ring>& r) {
+    return r->retired.load(std::memory_order_acquire) &&
+           r->head.load(std::memory_order_relaxed) == r->tail.load(std::memory_order_acquire);
+  }), rings_.end());
+}
+
+void log_set_level(int level) {
+  g_log_level.store(std::max((int)kLogDebug, std::min(level, (int)kLogOff)),
+                    std::memory_order_relaxed);
+}
+
+static size_t format_text(char* buf, size_t cap, uint32_t suppressed, const char* fmt,
+                          va_list ap) {
+  int n = std::vsnprintf(buf, cap, fmt, ap);
+  if (n < 0) n = 0;
+  size_t len = std::min((size_t)n, cap - 1);
+  if ((size_t)n >= cap && cap > 4) std::memcpy(buf + cap - 4, "...", 4); // truncated
+  if (suppressed) {
+    int m = std::snprintf(buf + len, cap - len, " [%u similar suppressed]", suppressed);
+    if (m > 0) len = std::min(len + (size_t)m, cap - 1);
+  }
+  return len;
+}
+
+void log_write(int level, uint32_t suppressed, const char* fmt, ...) {
+  va_list ap;
+  Logger& l = Logger::get();
+
+  if (l.stopped()) {
+    // After exit handlers ran: write synchronously.
+    char line[64 + kTextMax];
+    size_t n = format_prefix(line, sizeof(line), level, mono_ns(), current_tid());
+    va_start(ap, fmt);
+    n += format_text(line + n, kTextMax, suppressed, fmt, ap);
+    va_end(ap);
+    line[n++] = '\n';
+    write_all(STDERR_FILENO, line, n);
+    return;
+  }
+
+  Ring* r = local_ring();
+  uint32_t t = r->tail.load(std::memory_order_relaxed);
+  uint32_t used = t - r->head.load(std::memory_order_acquire);
+  if (used == kRingSlots) {
+    r->dropped.fetch_add(1, std::memory_order_relaxed);
+    l.wake();
+    return;
+  }
+  Record& rec = r->slots[t & (kRingSlots - 1)];
+  rec.ts_ns = mono_ns();
+  rec.level = (uint8_t)level;
+  va_start(ap, fmt);
+  rec.len = (uint16_t)format_text(rec.text, sizeof(rec.text), suppressed, fmt, ap);
+  va_end(ap);
+  r->tail.store(t + 1, std::memory_order_release);
+
+  if (level >= kLogError || used + 1 >= kRingSlots / 2) l.wake();
+}
+
+void log_flush() {
+  Logger& l = Logger::get();
+  if (!l.stopped()) l.drain();
+}
+
+bool LogRateLimit::allow(uint64_t interval_ms, uint32_t* suppressed) {
+  uint64_t now = mono_ns();
+  uint64_t next = next_ns_.load(std::memory_order_relaxed);
+  if (now < next ||
+      !next_ns_.compare_exchange_strong(next, now + interval_ms * 1000000ull,
+                                        std::memory_order_relaxed)) {
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  *suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+  return true;
+}
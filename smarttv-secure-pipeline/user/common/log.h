@@ -1,16 +1,74 @@
 #pragma once
-#include <cstdio>
-#include <cstdarg>
-
-inline void log_print(const char* lvl, const char* fmt, ...) {
-  std::va_list ap;
-  va_start(ap, fmt);
-  std::fprintf(stderr, "[%s] ", lvl);
-  std::vfprintf(stderr, fmt, ap);
-  std::fprintf(stderr, "\n");
-  va_end(ap);
+#include <atomic>
+#include <cstdint>
+
+// Asynchronous logging. LOGx() formats the message into a per-thread
+// lock-free ring and returns; a background thread writes the rings out in
+// timestamp order (one write() per batch), so callers never block on
+// stderr. A full ring drops the message and the drop is reported later.
+//
+// Lines look like "[W 12.345678 4321] text": level, CLOCK_MONOTONIC seconds
+// and kernel thread id.
+//
+// Filtering:
+//   - compile time: levels below LOG_MIN_LEVEL are compiled out, arguments
+//     included (-DLOG_MIN_LEVEL=2 keeps warnings and errors);
+//   - run time: log_set_level() or LOG_LEVEL=debug|info|warn|error|off;
+//     a filtered call costs one relaxed load. It only filters what was
+//     compiled in: LOGD needs -DLOG_MIN_LEVEL=0 for LOG_LEVEL=debug to
+//     show anything.
+
+enum LogLevel { kLogDebug = 0, kLogInfo = 1, kLogWarn = 2, kLogError = 3, kLogOff = 4 };
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+inline std::atomic<int> g_log_level{kLogInfo};
+
+inline bool log_enabled(int level) {
+  return level >= g_log_level.load(std::memory_order_relaxed);
 }
+void log_set_level(int level);
+
+// Queues one message. suppressed > 0 appends how many were rate-limited away.
+void log_write(int level, uint32_t suppressed, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Blocks until everything logged so far has been written.
+void log_flush();
+
+// One per call site (see LOG_EVERY_MS): lets a message through at most once
+// per interval and counts the ones it held back.
+class LogRateLimit {
+public:
+  bool allow(uint64_t interval_ms, uint32_t* suppressed);
+
+private:
+  std::atomic<uint64_t> next_ns_{0};
+  std::atomic<uint32_t> suppressed_{0};
+};
+
+#define LOG_AT(level, ...)                                          \
+  do {                                                              \
+    if ((level) >= LOG_MIN_LEVEL && log_enabled(level))             \
+      log_write((level), 0, __VA_ARGS__);                           \
+  } while (0)
+
+// For warnings that can fire every frame.
+#define LOG_EVERY_MS(level, interval_ms, ...)                       \
+  do {                                                              \
+    if ((level) >= LOG_MIN_LEVEL && log_enabled(level)) {           \
+      static LogRateLimit log_rl_;                                  \
+      uint32_t log_suppressed_;                                     \
+      if (log_rl_.allow((interval_ms), &log_suppressed_))           \
+        log_write((level), log_suppressed_, __VA_ARGS__);           \
+    }                                                               \
+  } while (0)
 
-#define LOGI(...) log_print("I", __VA_ARGS__)
-#define LOGW(...) log_print("W", __VA_ARGS__)
-#define LOGE(...) log_print("E", __VA_ARGS__)
+#define LOGD(...) LOG_AT(kLogDebug, __VA_ARGS__)
+#define LOGI(...) LOG_AT(kLogInfo, __VA_ARGS__)
+#define LOGW(...) LOG_AT(kLogWarn, __VA_ARGS__)
+#define LOGE(...) LOG_AT(kLogError, __VA_ARGS__)
+#define LOGW_EVERY_MS(interval_ms, ...) LOG_EVERY_MS(kLogWarn, interval_ms, __VA_ARGS__)
+#define LOGE_EVERY_MS(interval_ms, ...) LOG_EVERY_MS(kLogError, interval_ms, __VA_ARGS__)
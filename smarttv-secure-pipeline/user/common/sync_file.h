@@ -0,0 +1,35 @@
+#pragma once
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/sync_file.h>
+#include "fd.h"
+
+// sync_file (dma-fence) helpers. A sync_file fd polls readable once its
+// fence has signalled; fd < 0 stands for "no fence" and counts as signalled.
+
+// Waits up to timeout_ms (-1 = forever). Returns 0, -ETIME on timeout or a
+// negative errno.
+inline int sync_file_wait(int fd, int timeout_ms) {
+  if (fd < 0) return 0;
+  pollfd pfd{fd, POLLIN, 0};
+  for (;;) {
+    int rc = ::poll(&pfd, 1, timeout_ms);
+    if (rc > 0) return (pfd.revents & POLLNVAL) ? -EINVAL : 0;
+    if (rc == 0) return -ETIME;
+    if (errno != EINTR && errno != EAGAIN) return -errno;
+  }
+}
+
+// 1 signalled, 0 still pending, or the fence's negative error status.
+inline int sync_file_status(int fd) {
+  if (fd < 0) return 1;
+  sync_file_info info{};
+  if (::ioctl(fd, SYNC_IOC_FILE_INFO, &info) != 0) return -errno;
+  return info.status;
+}
+
+inline UniqueFd sync_file_dup(int fd) {
+  return UniqueFd(fd >= 0 ? ::fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1);
+}
@@ -0,0 +1,81 @@
+#include "buffer_allocator.h"
+#include "svp_client.h"
+#include "../common/log.h"
+
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int IBufferAllocator::allocate_batch(const BufferDesc& desc, size_t count,
+                                     std::vector<UniqueFd>* out, BufferLayout* out_layout) {
+  std::vector<UniqueFd> fds;
+  fds.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    UniqueFd fd;
+    int rc = allocate(desc, &fd, out_layout);
+    if (rc != 0) return rc;
+    fds.push_back(std::move(fd));
+  }
+  *out = std::move(fds);
+  return 0;
+}
+
+class SvpAllocator final : public IBufferAllocator {
+public:
+  explicit SvpAllocator(int svp_fd): svp_fd_(svp_fd) {}
+  const char* name() const override { return "svp"; }
+
+  int allocate(const BufferDesc& desc, UniqueFd* out, BufferLayout* out_layout) override {
+    int rc = svp_alloc(svp_fd_, desc, out, out_layout);
+    if (rc == 0) fill_missing_layout(desc, out->get(), out_layout);
+    return rc;
+  }
+
+  int allocate_batch(const BufferDesc& desc, size_t count,
+                     std::vector<UniqueFd>* out, BufferLayout* out_layout) override {
+    int rc = svp_alloc_batch(svp_fd_, desc, count, out, out_layout);
+    if (rc == 0 && !out->empty()) fill_missing_layout(desc, (*out)[0].get(), out_layout);
+    return rc;
+  }
+
+  void release(const BufferDesc& desc, int fd) override {
+    (void)svp_release(svp_fd_, desc.session, fd);
+  }
+
+private:
+  // Modules without layout reporting: assume the default layout, but never
+  // more bytes than the dma-buf has.
+  static void fill_missing_layout(const BufferDesc& desc, int fd, BufferLayout* layout) {
+    if (!layout || layout->num_planes != 0 || buffer_layout(desc, layout) != 0) return;
+    off_t size = ::lseek(fd, 0, SEEK_END);
+    if (size >= 0 && (uint64_t)size < layout->size) layout->size = (uint64_t)size;
+    LOGW_EVERY_MS(60000, "svp.ko reports no buffer layout; assuming the default one");
+  }
+
+  int svp_fd_;
+};
+
+class MemfdAllocator final : public IBufferAllocator {
+public:
+  const char* name() const override { return "memfd"; }
+
+  int allocate(const BufferDesc& desc, UniqueFd* out, BufferLayout* out_layout) override {
+    BufferLayout layout{};
+    int rc = buffer_layout(desc, &layout);
+    if (rc != 0) return rc;
+    UniqueFd fd(::memfd_create("svp-pool", MFD_CLOEXEC));
+    if (!fd) return -errno;
+    if (::ftruncate(fd.get(), (off_t)layout.size) != 0) return -errno;
+    *out = std::move(fd);
+    *out_layout = layout;
+    return 0;
+  }
+};
+
+std::unique_ptr<IBufferAllocator> CreateSvpAllocator(int svp_fd) {
+  return std::make_unique<SvpAllocator>(svp_fd);
+}
+
+std::unique_ptr<IBufferAllocator> CreateMemfdAllocator() {
+  return std::make_unique<MemfdAllocator>();
+}
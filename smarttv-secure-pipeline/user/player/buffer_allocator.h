@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../common/fd.h"
+#include "../../kernel/secure_video/svp_format.h"
+
+// Geometry and policy of one video buffer.
+struct BufferDesc {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t fourcc = SVP_FMT_NV12;
+  uint32_t flags = 0;           // svp_buf_flags
+  uint32_t pitch_align = 0;     // bytes; 0 = allocator default
+  uint32_t height_align = 0;    // rows; 0 = allocator default
+  std::string heap;             // DMA-HEAP name (svp only); empty = svp_heap_name
+  uint32_t session = 0;         // svp_session_req.handle (svp only); 0 = default session
+};
+
+// Per-plane pitches and offsets of an allocated buffer, and its size.
+using BufferLayout = svp_layout;
+
+// The layout svp.ko gives `d` with its default alignment parameters; the
+// software backends allocate exactly this. Returns 0 or -EINVAL.
+constexpr int buffer_layout(const BufferDesc& d, BufferLayout* out) {
+  return svp_fmt_layout(d.fourcc, d.width, d.height,
+                        d.pitch_align ? d.pitch_align : SVP_FMT_DEFAULT_PITCH_ALIGN,
+                        d.height_align ? d.height_align : SVP_FMT_DEFAULT_HEIGHT_ALIGN, out);
+}
+
+// Backend that produces dmabuf-like fds for SecureBufferPool.
+class IBufferAllocator {
+public:
+  virtual ~IBufferAllocator() = default;
+  virtual const char* name() const = 0;
+  // Returns 0 and fills out/out_layout, or a negative errno.
+  virtual int allocate(const BufferDesc& desc, UniqueFd* out, BufferLayout* out_layout) = 0;
+  // All-or-nothing allocation of `count` buffers. Default loops allocate().
+  virtual int allocate_batch(const BufferDesc& desc, size_t count,
+                             std::vector<UniqueFd>* out, BufferLayout* out_layout);
+  // Called right before the pool closes a buffer's fd; desc is the one it
+  // was allocated with.
+  virtual void release(const BufferDesc& desc, int fd) {
+    (void)desc;
+    (void)fd;
+  }
+};
+
+// Secure heap allocations through /dev/svp0 (svp_fd is borrowed, not owned).
+std::unique_ptr<IBufferAllocator> CreateSvpAllocator(int svp_fd);
+
+// Software backend: memfd-backed buffers, usable on hosts without /dev/svp0.
+std::unique_ptr<IBufferAllocator> CreateMemfdAllocator();
@@ -0,0 +1,110 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+#include "rdma_client.h"
+
+// Userspace copy engine for hosts whose rdma_stub has no DMA_MEMCPY
+// channel. Takes the same RdmaCopyReq as rdma_copy(), for buffers the
+// policy lets the CPU map (memfd, udmabuf, non-secure heap dma-bufs). Like
+// RdmaClient::register_buffer(), a buffer is mapped once and the mapping
+// kept (up to 32, least recently used go first); every copy is bracketed
+// with DMA_BUF_IOCTL_SYNC. Copies of at least split_bytes are divided
+// across a worker pool, and large ones use non-temporal stores (AVX2/SSE2
+// on x86-64, STNP on arm64) so a frame on its way to the display does not
+// evict the caches. Thread-safe; copies run one at a time.
+class CpuCopier {
+public:
+  // threads: copying threads including the caller; 0 = one per CPU, at most 4.
+  explicit CpuCopier(unsigned threads = 0, size_t split_bytes = 1u << 20);
+  ~CpuCopier();
+  CpuCopier(const CpuCopier&) = delete;
+  CpuCopier& operator=(const CpuCopier&) = delete;
+
+  // Returns 0 or a negative errno: -EPERM for kRdmaCopySecure, -EOPNOTSUPP
+  // for RdmaClient handles, -EINVAL if a range lies outside its buffer.
+  int copy(const RdmaCopyReq& r);
+
+  // Same contract as rdma_copy_batch().
+  int copy_batch(const RdmaCopyReq* reqs, size_t count, int* statuses = nullptr);
+
+  // The copy itself, between mappings the caller owns.
+  void copy_mem(void* dst, const void* src, size_t n);
+
+  // CPU write access to a whole buffer through the mapping cache, for
+  // producers that fill buffers in place (FileFrameSource). Holds the cache
+  // lock and a DMA_BUF_SYNC_START|WRITE window until finish() or
+  // destruction; copy_mem() may be used meanwhile, copy() may not.
+  class WriteMapping {
+  public:
+    WriteMapping(WriteMapping&& o) noexcept;
+    WriteMapping& operator=(WriteMapping&&) = delete;
+    ~WriteMapping() { (void)finish(); }
+
+    // 0, or the negative errno map_for_write() failed with.
+    int error() const { return rc_; }
+    char* data() const { return p_; }
+    // Closes the window (DMA_BUF_SYNC_END). Returns 0 or a negative errno.
+    int finish();
+
+  private:
+    friend class CpuCopier;
+    WriteMapping() = default;
+
+    CpuCopier* cpu_ = nullptr;
+    std::unique_lock<std::mutex> lk_;
+    size_t idx_ = 0;
+    char* p_ = nullptr;
+    int rc_ = 0;
+  };
+  // Maps fd read-write (it must hold at least size bytes) and opens the
+  // write window. Check error() first: -EACCES for a read-only fd, -EINVAL
+  // for a short buffer.
+  WriteMapping map_for_write(int fd, size_t size);
+
+  // Drops the mapping of a buffer that is about to be freed, so the
+  // mapping does not keep its memory alive (SecureBufferPool free hook).
+  void forget_buffer(int fd);
+
+  unsigned threads() const { return (unsigned)workers_.size() + 1; }
+  // Store kernel in use: "avx2", "sse2", "neon" or "memcpy".
+  static const char* isa();
+
+private:
+  struct Job;
+  struct Mapping {
+    int fd;
+    dev_t dev;
+    ino_t ino; // tells a recycled fd number from the buffer mapped before
+    char* p;
+    size_t len;
+    bool writable;
+    bool dmabuf; // false once DMA_BUF_IOCTL_SYNC failed with ENOTTY (memfd)
+    uint64_t last_use;
+  };
+
+  void worker();
+  static void run_parts(Job* job);
+  int map_locked(int fd, size_t* out_idx);
+  void forget_locked(int fd);
+  int sync_locked(size_t idx, uint64_t flags);
+
+  size_t split_bytes_;
+  std::mutex copy_mu_; // one pooled copy at a time
+  std::mutex mu_;
+  std::condition_variable work_cv_, idle_cv_;
+  uint64_t gen_ = 0;      // bumped per pooled copy
+  Job* job_ = nullptr;    // the copy workers may join, or null
+  unsigned active_ = 0;   // workers inside run_parts()
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+
+  std::mutex map_mu_; // maps_, held across copy()
+  std::vector<Mapping> maps_;
+  uint64_t clock_ = 0;
+};
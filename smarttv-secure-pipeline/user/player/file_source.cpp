@@ -0,0 +1,283 @@
+#include "file_source.h"
+#include "cpu_copy.h"
+#include "../common/fd.h"
+#include "../common/log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+uint64_t now_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// "W1920 H1080 F30000:1001 Ip A1:1 C420p10 XYSCSS=..." after the signature.
+struct Y4mHeader {
+  uint32_t width = 0, height = 0;
+  double fps = 0.0;
+  std::string chroma = "420jpeg"; // the format's default
+};
+
+bool parse_y4m_header(const char* p, const char* end, Y4mHeader* h) {
+  while (p < end) {
+    const char* tok = p;
+    while (p < end && *p != ' ') ++p;
+    std::string t(tok, p);
+    if (p < end) ++p;
+    if (t.size() < 2) continue;
+    switch (t[0]) {
+    case 'W': h->width = (uint32_t)std::strtoul(t.c_str() + 1, nullptr, 10); break;
+    case 'H': h->height = (uint32_t)std::strtoul(t.c_str() + 1, nullptr, 10); break;
+    case 'C': h->chroma = t.substr(1); break;
+    case 'F': {
+      char* colon = nullptr;
+      double num = std::strtod(t.c_str() + 1, &colon);
+      double den = (colon && *colon == ':') ? std::strtod(colon + 1, nullptr) : 1.0;
+      h->fps = den > 0 ? num / den : 0.0;
+      break;
+    }
+    default: break; // interlacing, aspect, X extensions: not needed here
+    }
+  }
+  return h->width && h->height;
+}
+
+} // namespace
+
+FileFrameSource::~FileFrameSource() {
+  if (file_) ::munmap((void*)file_, file_len_);
+}
+
+bool ParseRawFormat(const std::string& name, uint32_t* fourcc) {
+  if (name == "nv12") *fourcc = SVP_FMT_NV12;
+  else if (name == "nv21") *fourcc = SVP_FMT_NV21;
+  else if (name == "p010") *fourcc = SVP_FMT_P010;
+  else return false;
+  return true;
+}
+
+std::unique_ptr<FileFrameSource> CreateFileSource(const FileSourceConfig& cfg, CpuCopier* cpu) {
+  if (!cpu) {
+    LOGE("file source: needs a CpuCopier");
+    return nullptr;
+  }
+  UniqueFd fd(::open(cfg.path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st{};
+  if (!fd || ::fstat(fd.get(), &st) != 0) {
+    LOGE("file source: cannot open %s (errno %d)", cfg.path.c_str(), errno);
+    return nullptr;
+  }
+  if (st.st_size <= 0) {
+    LOGE("file source: %s is empty", cfg.path.c_str());
+    return nullptr;
+  }
+  void* p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd.get(), 0);
+  if (p == MAP_FAILED) {
+    LOGE("file source: mmap of %s failed (errno %d)", cfg.path.c_str(), errno);
+    return nullptr;
+  }
+  // Read once, front to back: aggressive read-ahead, pages dropped early.
+  (void)::madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  std::unique_ptr<FileFrameSource> src(new FileFrameSource());
+  src->file_ = (const char*)p;
+  src->file_len_ = (size_t)st.st_size;
+  src->cpu_ = cpu;
+  src->realtime_ = cfg.realtime;
+  src->loop_ = cfg.loop;
+  src->readahead_ = std::max<size_t>(cfg.readahead_frames, 1);
+  FileSourceInfo& in = src->info_;
+
+  static const char kY4m[] = "YUV4MPEG2 ";
+  const char* file = src->file_;
+  size_t len = src->file_len_;
+  bool y4m = len > sizeof(kY4m) - 1 && std::memcmp(file, kY4m, sizeof(kY4m) - 1) == 0;
+  size_t sample = 1;
+  if (y4m) {
+    const char* hdr = file + sizeof(kY4m) - 1;
+    const char* nl = (const char*)std::memchr(hdr, '\n', std::min<size_t>(len - (hdr - file), 4096));
+    Y4mHeader h;
+    if (!nl || !parse_y4m_header(hdr, nl, &h)) {
+      LOGE("file source: %s: bad Y4M header", cfg.path.c_str());
+      return nullptr;
+    }
+    if (h.chroma == "420p10") {
+      in.fourcc = SVP_FMT_P010;
+      src->y4m_p10_ = true;
+      sample = 2;
+    } else if (h.chroma == "420jpeg" || h.chroma == "420mpeg2" || h.chroma == "420paldv" ||
+               h.chroma == "420") {
+      in.fourcc = SVP_FMT_YUV420;
+    } else {
+      LOGE("file source: %s: Y4M chroma C%s not supported (4:2:0 8/10-bit only)",
+           cfg.path.c_str(), h.chroma.c_str());
+      return nullptr;
+    }
+    in.width = h.width;
+    in.height = h.height;
+    in.fps = h.fps > 0 ? h.fps : cfg.fps;
+
+    // Frame headers may carry parameters; all are assumed as long as the first.
+    src->data_off_ = (size_t)(nl + 1 - file);
+    const char* fh = file + src->data_off_;
+    const char* fnl = src->data_off_ + 6 <= len && std::memcmp(fh, "FRAME", 5) == 0
+        ? (const char*)std::memchr(fh, '\n', std::min<size_t>(len - src->data_off_, 256)) : nullptr;
+    if (!fnl) {
+      LOGE("file source: %s: no Y4M frame", cfg.path.c_str());
+      return nullptr;
+    }
+    src->frame_hdr_ = (size_t)(fnl + 1 - fh);
+  } else {
+    if (cfg.fourcc != SVP_FMT_NV12 && cfg.fourcc != SVP_FMT_NV21 && cfg.fourcc != SVP_FMT_P010) {
+      LOGE("file source: raw files must be NV12, NV21 or P010");
+      return nullptr;
+    }
+    if (!cfg.width || !cfg.height) {
+      LOGE("file source: raw file %s needs a width and height", cfg.path.c_str());
+      return nullptr;
+    }
+    in.fourcc = cfg.fourcc;
+    in.width = cfg.width;
+    in.height = cfg.height;
+    in.fps = cfg.fps;
+    sample = cfg.fourcc == SVP_FMT_P010 ? 2 : 1;
+  }
+
+  // Rows as they land in the pool buffer; in the file they are packed.
+  size_t w = in.width, cw = (w + 1) / 2;
+  uint32_t ch = (in.height + 1) / 2;
+  if (in.fourcc == SVP_FMT_YUV420) {
+    src->planes_[0] = { 0, w, in.height };
+    src->planes_[1] = { w * in.height, cw, ch };
+    src->planes_[2] = { w * in.height + cw * ch, cw, ch };
+    src->nplanes_ = 3;
+    in.frame_bytes = w * in.height + 2 * cw * ch;
+  } else {
+    src->planes_[0] = { 0, w * sample, in.height };
+    src->planes_[1] = { w * sample * in.height, 2 * cw * sample, ch };
+    src->nplanes_ = 2;
+    in.frame_bytes = (w * in.height + 2 * cw * ch) * sample;
+  }
+
+  size_t stride = src->frame_hdr_ + in.frame_bytes;
+  in.frames = (len - src->data_off_) / stride;
+  if (in.frames == 0) {
+    LOGE("file source: %s holds no whole %ux%u frame", cfg.path.c_str(), in.width, in.height);
+    return nullptr;
+  }
+  if ((len - src->data_off_) % stride)
+    LOGW("file source: %s: %zu trailing bytes ignored", cfg.path.c_str(),
+         (size_t)((len - src->data_off_) % stride));
+
+  LOGI("file source: %s %s %ux%u %.4s, %llu frames at %.2f fps%s%s", cfg.path.c_str(),
+       y4m ? "y4m" : "raw", in.width, in.height, (const char*)&in.fourcc,
+       (unsigned long long)in.frames, in.fps, cfg.realtime ? ", paced" : "",
+       cfg.loop ? ", looping" : "");
+  return src;
+}
+
+// Keeps the next readahead_ frames on their way into the page cache: a new
+// window is requested once the feeder is halfway through the last one (or
+// has wrapped around).
+void FileFrameSource::readahead(uint64_t frame) {
+  if (frame < ra_next_ && frame >= ra_start_) return;
+  static const size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+  size_t stride = frame_hdr_ + info_.frame_bytes;
+  uint64_t end = std::min<uint64_t>(frame + readahead_, info_.frames);
+  size_t from = (data_off_ + frame * stride) & ~(page - 1);
+  size_t to = std::min(data_off_ + end * stride, file_len_);
+  (void)::madvise((void*)(file_ + from), to - from, MADV_WILLNEED);
+  ra_start_ = frame;
+  ra_next_ = frame + std::max<size_t>(readahead_ / 2, 1);
+}
+
+// Real-time pacing as NullSink does it: late frames are not caught up on.
+void FileFrameSource::pace(uint64_t seq) {
+  if (!realtime_ || info_.fps <= 0) return;
+  uint64_t interval_ns = (uint64_t)(1e9 / info_.fps);
+  uint64_t now = now_ns();
+  next_ns_ = (seq && next_ns_) ? next_ns_ + interval_ns : now;
+  if (next_ns_ < now) next_ns_ = now;
+  timespec ts{ (time_t)(next_ns_ / 1000000000ull), (long)(next_ns_ % 1000000000ull) };
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+
+void FileFrameSource::copy_plane(char* dst, uint32_t pitch, const char* src, size_t row_bytes,
+                                 uint32_t rows) {
+  if (pitch == row_bytes) {
+    cpu_->copy_mem(dst, src, row_bytes * rows);
+    return;
+  }
+  for (uint32_t y = 0; y < rows; ++y, dst += pitch, src += row_bytes)
+    std::memcpy(dst, src, row_bytes);
+}
+
+// Planar 10-bit (LSB aligned, Y4M C420p10) to P010 (MSB aligned, CbCr
+// interleaved). Samples may sit at odd file offsets, hence the memcpy loads.
+void FileFrameSource::convert_p010(char* dst, const BufferLayout& layout, const char* src) {
+  auto load = [](const char* p) {
+    uint16_t v;
+    std::memcpy(&v, p, 2);
+    return v;
+  };
+  uint32_t w = info_.width, cw = (w + 1) / 2, ch = (info_.height + 1) / 2;
+  const char* y = src;
+  for (uint32_t r = 0; r < info_.height; ++r) {
+    uint16_t* d = (uint16_t*)(dst + layout.offsets[0] + (size_t)r * layout.pitches[0]);
+    const char* s = y + (size_t)r * w * 2;
+    for (uint32_t x = 0; x < w; ++x) d[x] = (uint16_t)(load(s + 2 * x) << 6);
+  }
+  const char* u = src + (size_t)w * info_.height * 2;
+  const char* v = u + (size_t)cw * ch * 2;
+  for (uint32_t r = 0; r < ch; ++r) {
+    uint16_t* d = (uint16_t*)(dst + layout.offsets[1] + (size_t)r * layout.pitches[1]);
+    const char* su = u + (size_t)r * cw * 2;
+    const char* sv = v + (size_t)r * cw * 2;
+    for (uint32_t x = 0; x < cw; ++x) {
+      d[2 * x] = (uint16_t)(load(su + 2 * x) << 6);
+      d[2 * x + 1] = (uint16_t)(load(sv + 2 * x) << 6);
+    }
+  }
+}
+
+int FileFrameSource::fill(int fd, const BufferLayout& layout, uint64_t seq) {
+  if (seq >= info_.frames && !loop_) return -ENODATA;
+  if (layout.num_planes != nplanes_) return -EINVAL;
+  for (unsigned p = 0; p < nplanes_; ++p) {
+    if (layout.pitches[p] < planes_[p].row_bytes ||
+        layout.offsets[p] + (uint64_t)layout.pitches[p] * planes_[p].rows > layout.size)
+      return -EINVAL;
+  }
+
+  uint64_t frame = seq % info_.frames;
+  pace(seq);
+  readahead(frame);
+  const char* hdr = file_ + data_off_ + frame * (frame_hdr_ + info_.frame_bytes);
+  if (frame_hdr_ && std::memcmp(hdr, "FRAME", 5) != 0) {
+    LOGE_EVERY_MS(1000, "file source: Y4M frame %llu has no FRAME header",
+                  (unsigned long long)frame);
+    return -EINVAL;
+  }
+  const char* src = hdr + frame_hdr_;
+
+  CpuCopier::WriteMapping m = cpu_->map_for_write(fd, (size_t)layout.size);
+  if (m.error() != 0) return m.error();
+  if (y4m_p10_) {
+    convert_p010(m.data(), layout, src);
+  } else {
+    for (unsigned p = 0; p < nplanes_; ++p)
+      copy_plane(m.data() + layout.offsets[p], layout.pitches[p], src + planes_[p].src_off,
+                 planes_[p].row_bytes, planes_[p].rows);
+  }
+  return m.finish();
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "staged_pipeline.h"
+
+class CpuCopier;
+
+struct FileSourceConfig {
+  std::string path;
+  // Raw files only; a Y4M header carries its own geometry and rate.
+  uint32_t width = 0, height = 0;
+  uint32_t fourcc = SVP_FMT_NV12; // NV12, NV21 or P010, planes packed back to back
+  double fps = 60.0;
+  bool realtime = false;          // pace fills at the file's frame rate
+  bool loop = false;              // wrap around instead of ending the stream
+  size_t readahead_frames = 8;    // MADV_WILLNEED window; about the pool size
+};
+
+// What a FileFrameSource produces; the pool must be allocated for it.
+struct FileSourceInfo {
+  uint32_t width = 0, height = 0;
+  uint32_t fourcc = 0;       // pool format: NV12, P010, or YUV420 for 8-bit Y4M
+  double fps = 0.0;
+  uint64_t frames = 0;       // in the file
+  size_t frame_bytes = 0;    // payload per frame in the file
+};
+
+// Feeds frames from a raw NV12/P010 file or a 4:2:0 Y4M file (8-bit, or
+// 10-bit converted to P010). The file is mapped once and read with
+// MADV_SEQUENTIAL plus MADV_WILLNEED windows of readahead_frames, so disk
+// reads run ahead of the feeder; each frame is then copied straight from
+// the page cache into the pool buffer (one copy, row by row only where
+// pitches differ). Pool buffers must be CPU-mappable; they are written
+// through CpuCopier::map_for_write(), so the copier's forget_buffer()
+// belongs in the pool's free hook. fill() returns -ENODATA past the last
+// frame unless looping.
+class FileFrameSource final : public IFrameSource {
+public:
+  ~FileFrameSource() override;
+  FileFrameSource(const FileFrameSource&) = delete;
+  FileFrameSource& operator=(const FileFrameSource&) = delete;
+
+  const char* name() const override { return "file"; }
+  int fill(int fd, const BufferLayout& layout, uint64_t seq) override;
+
+  const FileSourceInfo& info() const { return info_; }
+
+private:
+  friend std::unique_ptr<FileFrameSource> CreateFileSource(const FileSourceConfig& cfg,
+                                                           CpuCopier* cpu);
+  FileFrameSource() = default;
+
+  // One plane of the pool format, rows as they are packed in the file.
+  struct Plane {
+    size_t src_off;   // from the start of the frame payload
+    size_t row_bytes;
+    uint32_t rows;
+  };
+
+  void readahead(uint64_t frame);
+  void pace(uint64_t seq);
+  void copy_plane(char* dst, uint32_t pitch, const char* src, size_t row_bytes, uint32_t rows);
+  void convert_p010(char* dst, const BufferLayout& layout, const char* src);
+
+  FileSourceInfo info_;
+  CpuCopier* cpu_ = nullptr;
+  bool realtime_ = false;
+  bool loop_ = false;
+  bool y4m_p10_ = false;     // 10-bit planar samples, converted to P010
+  size_t readahead_ = 8;
+  Plane planes_[3] = {};
+  unsigned nplanes_ = 0;
+
+  const char* file_ = nullptr; // whole-file mapping
+  size_t file_len_ = 0;
+  size_t data_off_ = 0;      // first frame (its FRAME header for Y4M)
+  size_t frame_hdr_ = 0;     // Y4M "FRAME...\n" bytes before each payload
+  uint64_t ra_start_ = 0;    // first frame of the window requested last
+  uint64_t ra_next_ = 0;     // frame at which the next window is requested
+  uint64_t next_ns_ = 0;     // realtime pacing deadline
+};
+
+// Opens and maps cfg.path. Y4M is recognised by its signature; anything
+// else is raw and needs cfg.width/height/fourcc. Returns null (and logs)
+// for a missing, empty or unsupported file. `cpu` (required) is borrowed.
+std::unique_ptr<FileFrameSource> CreateFileSource(const FileSourceConfig& cfg, CpuCopier* cpu);
+
+// Maps a --format name ("nv12", "nv21", "p010") to its SVP fourcc. Returns
+// false for anything else so a typo can't read a raw file with the wrong
+// geometry.
+bool ParseRawFormat(const std::string& name, uint32_t* fourcc);
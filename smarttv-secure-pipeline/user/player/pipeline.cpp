@@ -7,13 +7,20 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <algorithm>
 #include <vector>
+#include <cerrno>
+#include <memory>
 
 extern "C" {
 #include "../../kernel/secure_video/svp_uapi.h"
 }
 
+#include "cpu_copy.h"
 #include "rdma_client.h"
+#include "secure_buffer_pool.h"
+#include "staged_pipeline.h"
+#include "startup_graph.h"
 
 static int open_dev(const char* path) {
   int fd = ::open(path, O_RDWR | O_CLOEXEC);
@@ -22,98 +29,173 @@ static int open_dev(const char* path) {
 }
 
 int SecurePipeline::run_demo(const std::string& card,
-                             const std::string& heap_hint,
+                             const std::string& heap,
                              int width, int height,
                              bool do_rdma_copy,
                              int frames)
 {
-  (void)heap_hint; // heap selection is done by svp.ko module param
-
-  auto cdm = CreateCdmAdapter();
-  if (!cdm->initialize()) return -1;
-
-  // OP-TEE: import an opaque blob (stub) to demonstrate secure-world call path
-  UniqueFd svp_fd(open_dev("/dev/svp0"));
-  if (!svp_fd) return -2;
-
-  tee_svp_t* tee = tee_svp_open();
-  if (!tee) { LOGE("tee_svp_open failed (is OP-TEE + tee-supplicant running?)"); return -3; }
-
-  std::vector<uint8_t> license_msg(128, 0x11);
-  auto lic = cdm->process_license(license_msg);
-
-  if (tee_svp_import_keyblob(tee, lic.key_blob.data(), lic.key_blob.size()) != 0) {
-    LOGE("TEE import keyblob failed");
-    tee_svp_close(tee);
-    return -4;
+  StagedPipelineConfig sp_cfg;
+  sp_cfg.frames = (uint64_t)std::max(frames, 0);
+
+  BufferPoolConfig pool_cfg;
+  pool_cfg.desc.width = (uint32_t)width;
+  pool_cfg.desc.height = (uint32_t)height;
+  pool_cfg.desc.fourcc = 0x3231564E; // 'NV12'
+  pool_cfg.desc.flags = SVP_BUF_SECURE | SVP_BUF_CPU_NOACCESS;
+  pool_cfg.desc.heap = heap;
+  pool_cfg.max_buffers = 2 * sp_cfg.ring_depth + 4;
+  // Nothing is freed while frames flow: the free hook below touches
+  // renderer state, which belongs to the present thread.
+  pool_cfg.high_watermark = pool_cfg.max_buffers;
+
+  // File input: the CPU writes the frames, so the buffers must be mappable,
+  // and CpuCopier can also copy them when there is no DMA channel.
+  std::unique_ptr<CpuCopier> cpu;
+  std::unique_ptr<FileFrameSource> file;
+  if (!input_.path.empty()) {
+    FileSourceConfig in = input_;
+    in.readahead_frames = pool_cfg.max_buffers;
+    cpu = std::make_unique<CpuCopier>();
+    file = CreateFileSource(in, cpu.get());
+    if (!file) return -10;
+    pool_cfg.desc.width = file->info().width;
+    pool_cfg.desc.height = file->info().height;
+    pool_cfg.desc.fourcc = file->info().fourcc;
+    pool_cfg.desc.flags = 0;
   }
-  LOGI("TEE keyblob import ok (scaffold)");
 
-  // Open SVP session (policy token)
+  auto cdm = CreateCdmAdapter();
+  LicenseResponse lic;
+  UniqueFd svp_fd;
+  tee_svp_t* tee = nullptr;
   svp_session_req sess{};
-  if (::ioctl(svp_fd.get(), SVP_IOC_OPEN_SESSION, &sess) != 0) {
-    LOGE("SVP open session ioctl failed");
-    tee_svp_close(tee);
-    return -5;
-  }
-
-  // Allocate two secure buffers (dmabuf fds)
-  svp_alloc_req a{};
-  a.width = (uint32_t)width;
-  a.height = (uint32_t)height;
-  a.fourcc = 0x3231564E; // 'NV12'
-  a.flags = SVP_BUF_SECURE | SVP_BUF_CPU_NOACCESS;
-
-  if (::ioctl(svp_fd.get(), SVP_IOC_ALLOC_BUF, &a) != 0) {
-    LOGE("SVP alloc A failed");
-    tee_svp_close(tee);
-    return -6;
-  }
-  UniqueFd bufA(a.out_dmabuf_fd);
-
-  svp_alloc_req b = a;
-  if (::ioctl(svp_fd.get(), SVP_IOC_ALLOC_BUF, &b) != 0) {
-    LOGE("SVP alloc B failed");
-    tee_svp_close(tee);
-    return -7;
-  }
-  UniqueFd bufB(b.out_dmabuf_fd);
-
-  LOGI("Allocated secure dma-bufs: A=%d B=%d", bufA.get(), bufB.get());
-
+  bool sess_open = false;
+  std::unique_ptr<SecureBufferPool> src_pool, dst_pool;
+  RdmaClient rdma;
+  bool rdma_ok = false;
+
+  // Cold start: independent steps run concurrently, error codes are those
+  // of the serial bring-up this replaced.
+  StartupGraph boot;
+  auto cdm_init = boot.add("cdm_init", [&] { return cdm->initialize() ? 0 : -1; });
+  auto svp_open = boot.add("svp_open", [&] {
+    svp_fd.reset(open_dev("/dev/svp0"));
+    return svp_fd ? 0 : -2;
+  });
+  auto tee_open = boot.add("tee_open", [&] {
+    // OP-TEE: import an opaque blob (stub) to demonstrate secure-world call path
+    tee = tee_svp_open();
+    if (!tee) LOGE("tee_svp_open failed (is OP-TEE + tee-supplicant running?)");
+    return tee ? 0 : -3;
+  });
+  auto license = boot.add("license", [&] {
+    std::vector<uint8_t> license_msg(128, 0x11);
+    lic = cdm->process_license(license_msg);
+    return 0;
+  }, { cdm_init });
+  auto key_import = boot.add("key_import", [&] {
+    if (tee_svp_import_keyblob(tee, lic.key_blob.data(), lic.key_blob.size()) != 0) {
+      LOGE("TEE import keyblob failed");
+      return -4;
+    }
+    LOGI("TEE keyblob import ok (scaffold)");
+    return 0;
+  }, { tee_open, license });
+  // Open SVP session (policy token) once the keys are in place; the pools
+  // allocate in it, so closing it drops whatever they still hold.
+  auto session = boot.add("svp_session", [&] {
+    if (::ioctl(svp_fd.get(), SVP_IOC_OPEN_SESSION, &sess) != 0) {
+      LOGE("SVP open session ioctl failed");
+      return -5;
+    }
+    sess_open = true;
+    pool_cfg.desc.session = sess.handle;
+    return 0;
+  }, { svp_open, key_import });
+  boot.add("src_pool", [&] {
+    src_pool = std::make_unique<SecureBufferPool>(CreateSvpAllocator(svp_fd.get()), pool_cfg);
+    src_pool->set_free_hook([this, &cpu](int fd) {
+      renderer_.forget_dmabuf(fd);
+      if (cpu) cpu->forget_buffer(fd);
+    });
+    if (!src_pool->init()) {
+      LOGE("SVP pool allocation failed (heap '%s')", heap.empty() ? "default" : heap.c_str());
+      return -6;
+    }
+    return 0;
+  }, { session });
   if (do_rdma_copy) {
-    UniqueFd rdma_fd(open_dev("/dev/rdma_stub0"));
-    if (!rdma_fd) {
-      LOGW("RDMA device not available; skipping copy");
-    } else {
-      RdmaCopyReq r{};
-      r.src_fd = bufA.get();
-      r.dst_fd = bufB.get();
-      r.src_off = 0;
-      r.dst_off = 0;
-      r.size = 4096; // demo chunk
-      r.flags = 0x1; // secure-policy hint
-      int rc = rdma_copy(rdma_fd.get(), r);
-      if (rc != 0) {
-        LOGW("RDMA copy ioctl failed rc=%d (secure DMA may require vendor integration)", rc);
-      } else {
-        LOGI("RDMA copy completed (scaffold)");
+    auto rdma_open = boot.add("rdma_open", [&] {
+      rdma_ok = rdma.open();
+      if (cpu) return 0; // CpuCopier takes the copies RDMA cannot
+      if (!rdma_ok) {
+        LOGW("RDMA device not available; skipping copy");
+      } else if (!rdma.has_channel()) {
+        // CpuCopier cannot stand in: secure buffers are not CPU-mappable.
+        LOGW("RDMA device has no DMA channel; skipping copy");
+        rdma_ok = false;
+      }
+      return 0;
+    });
+    boot.add("dst_pool", [&] {
+      if (!rdma_ok && !cpu) return 0;
+      dst_pool = std::make_unique<SecureBufferPool>(CreateSvpAllocator(svp_fd.get()), pool_cfg);
+      dst_pool->set_free_hook([this, &cpu](int fd) {
+        renderer_.forget_dmabuf(fd);
+        if (cpu) cpu->forget_buffer(fd);
+      });
+      if (!dst_pool->init()) {
+        LOGE("SVP pool allocation failed (heap '%s')", heap.empty() ? "default" : heap.c_str());
+        return -7;
       }
+      return 0;
+    }, { session, rdma_open });
+  }
+  // EGL/GBM bring-up is the longest step; its context moves to the present
+  // thread afterwards.
+  boot.add("renderer", [&] {
+    if (!renderer_.init(card)) {
+      LOGE("renderer init failed");
+      return -8;
     }
+    renderer_.release_current();
+    return 0;
+  });
+
+  int rc = boot.run();
+  if (rc != 0) {
+    boot.print_breakdown();
+    if (renderer_.initialized() && renderer_.make_current()) renderer_.shutdown();
+    if (sess_open) (void)::ioctl(svp_fd.get(), SVP_IOC_CLOSE_SESSION, &sess);
+    if (tee) tee_svp_close(tee);
+    return rc;
   }
 
-  // Renderer (GBM + DRM/KMS + EGL): render a test pattern.
-  if (!renderer_.init(card)) {
-    tee_svp_close(tee);
-    return -8;
-  }
-  LOGI("Rendering test pattern for %d frames", frames);
-  renderer_.render_test_pattern(frames);
-  renderer_.shutdown();
+  // Staged playback: feed -> secure copy -> present, one thread each,
+  // connected by SPSC rings.
+  std::unique_ptr<ICopyEngine> copy;
+  if (dst_pool)
+    copy = CreateAutoCopyEngine(rdma_ok ? &rdma : nullptr, cpu.get(), pool_cfg.desc.flags);
+  // Secure buffers are CPU-inaccessible: the (secure) decoder fills them.
+  std::unique_ptr<IFrameSource> null_source = CreateNullSource();
+  IFrameSource* source = file ? file.get() : null_source.get();
+  std::unique_ptr<IFrameSink> sink = CreateRendererSink(&renderer_, card, pool_cfg.desc);
+  StagedPipeline sp(src_pool.get(), dst_pool.get(), source, copy.get(), sink.get());
+
+  LOGI("Running %d frames (source=%s copy=%s)", frames, source->name(),
+       copy ? copy->name() : "none");
+  rc = sp.run(sp_cfg);
+  boot.print_breakdown(sp.stats().first_frame_ns);
+  sp.stats().print();
+  // The stage tells display failures from copy ones: both can be -ENODEV.
+  bool display_failed = rc != 0 && sp.stats().failed_stage == PipelineStage::kPresent;
+  if (display_failed) LOGE("presentation failed: %d", rc);
+  else if (rc != 0) LOGW("pipeline stopped rc=%d (secure DMA may require vendor integration)", rc);
 
   // Close SVP session (optional)
   (void)::ioctl(svp_fd.get(), SVP_IOC_CLOSE_SESSION, &sess);
 
   tee_svp_close(tee);
-  return 0;
+  if (display_failed) return -8;
+  return rc != 0 ? -9 : 0;
 }
@@ -1,16 +1,33 @@
 #pragma once
 #include <string>
+#include "file_source.h"
 #include "../renderer/gbm_kms_renderer.h"
 
 class SecurePipeline {
 public:
-  // Runs a demo: TEE import, SVP alloc, optional RDMA copy, then render test pattern.
+  // Runs a demo: concurrent start-up (StartupGraph: CDM, TEE import, SVP
+  // session, pools, renderer), then `frames` frames through a
+  // StagedPipeline (feed -> optional RDMA copy -> present via dma-buf import,
+  // test pattern if the GPU cannot import the secure heap). Pool buffers
+  // come from the DMA-HEAP `heap`, or from svp.ko's svp_heap_name if empty.
   int run_demo(const std::string& card,
-               const std::string& heap_hint,
+               const std::string& heap,
                int width, int height,
                bool do_rdma_copy,
                int frames);
 
+  // Scan frames out on a KMS plane instead of composing them with GL.
+  void set_plane_scanout(bool enable) { renderer_.set_plane_scanout(enable); }
+
+  // Feed frames from a raw/Y4M file (CreateFileSource) instead of leaving
+  // them to the secure decoder. The file's geometry and format replace
+  // run_demo's, and pool buffers are allocated CPU-mappable from `heap`.
+  void set_input(const FileSourceConfig& cfg) { input_ = cfg; }
+
+  // Presentation timing of the last run_demo (see GbmKmsRenderer).
+  FrameTiming& frame_timing() { return renderer_.frame_timing(); }
+
 private:
   GbmKmsRenderer renderer_;
+  FileSourceConfig input_;
 };
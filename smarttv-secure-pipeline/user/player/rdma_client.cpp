@@ -1,11 +1,20 @@
 #include "rdma_client.h"
+#include "../common/log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <unistd.h>
 
 extern "C" {
 #include "../../kernel/rdma_stub/rdma_stub_uapi.h"
 }
 
-int rdma_copy(int rdma_dev_fd, const RdmaCopyReq& r)
+static rdma_copy_req to_uapi(const RdmaCopyReq& r)
 {
   rdma_copy_req req{};
   req.src_dmabuf_fd = r.src_fd;
@@ -14,5 +23,170 @@ int rdma_copy(int rdma_dev_fd, const RdmaCopyReq& r)
   req.dst_offset = r.dst_off;
   req.size = r.size;
   req.flags = r.flags;
+  return req;
+}
+
+int rdma_copy(int rdma_dev_fd, const RdmaCopyReq& r)
+{
+  rdma_copy_req req = to_uapi(r);
   return ioctl(rdma_dev_fd, RDMA_IOC_COPY, &req);
 }
+
+int rdma_copy_batch(int rdma_dev_fd, const RdmaCopyReq* reqs, size_t count, int* statuses)
+{
+  rdma_copy_req v[RDMA_MAX_VEC];
+  __s32 st[RDMA_MAX_VEC];
+  int rc = 0;
+
+  for (size_t base = 0; base < count; base += RDMA_MAX_VEC) {
+    size_t n = std::min(count - base, (size_t)RDMA_MAX_VEC);
+    for (size_t i = 0; i < n; ++i) v[i] = to_uapi(reqs[base + i]);
+
+    rdma_copy_vec vec{};
+    vec.reqs_ptr = (__u64)(uintptr_t)v;
+    vec.status_ptr = (__u64)(uintptr_t)st;
+    vec.count = (__u32)n;
+    int r = ioctl(rdma_dev_fd, RDMA_IOC_COPY_V, &vec);
+    // EIO means per-entry statuses were written; anything else means none were.
+    int err = (r == 0) ? 0 : -errno;
+    if (err && err != -EIO) {
+      for (size_t i = 0; i < n; ++i) st[i] = err;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      if (statuses) statuses[base + i] = st[i];
+      if (st[i] != 0 && rc == 0) rc = st[i];
+    }
+  }
+  return rc;
+}
+
+bool RdmaClient::open(const char* path) {
+  fd_.reset(::open(path, O_RDWR | O_CLOEXEC | O_NONBLOCK));
+  if (!fd_) {
+    LOGE("open(%s) failed", path);
+    return false;
+  }
+  // Modules without RDMA_IOC_GET_STATS are assumed to have a channel; their
+  // copies fail with -ENODEV otherwise.
+  rdma_stats st{};
+  int rc = get_stats(&st);
+  has_channel_ = rc == 0 ? st.num_channels > 0 : rc == -ENOTTY;
+  if (rc != 0 && rc != -ENOTTY) LOGW("RDMA_IOC_GET_STATS failed rc=%d; assuming no channel", rc);
+  return true;
+}
+
+int RdmaClient::register_buffer(int dmabuf_fd) {
+  rdma_register_req req{};
+  req.dmabuf_fd = dmabuf_fd;
+  if (::ioctl(fd_.get(), RDMA_IOC_REGISTER_BUF, &req) != 0) return -errno;
+  return (int)req.out_handle;
+}
+
+int RdmaClient::unregister_buffer(int handle) {
+  __u32 h = (__u32)handle;
+  return ::ioctl(fd_.get(), RDMA_IOC_UNREGISTER_BUF, &h) == 0 ? 0 : -errno;
+}
+
+int RdmaClient::copy(const RdmaCopyReq& r) {
+  return rdma_copy(fd_.get(), r) == 0 ? 0 : -errno;
+}
+
+int RdmaClient::copy_batch(const RdmaCopyReq* reqs, size_t count, int* statuses) {
+  return rdma_copy_batch(fd_.get(), reqs, count, statuses);
+}
+
+int RdmaClient::copy_fenced(const RdmaCopyReq& r, int in_fence, UniqueFd* out_fence) {
+  rdma_fence_req req{};
+  req.copy = to_uapi(r);
+  req.in_fence_fd = in_fence;
+  req.out_fence_fd = -1;
+  if (::ioctl(fd_.get(), RDMA_IOC_COPY_FENCED, &req) != 0) return -errno;
+  out_fence->reset(req.out_fence_fd);
+  return 0;
+}
+
+int RdmaClient::submit_once(const RdmaCopyReq& r, uint64_t* cookie) {
+  rdma_submit_req req{};
+  req.copy = to_uapi(r);
+  if (::ioctl(fd_.get(), RDMA_IOC_SUBMIT, &req) != 0) return -errno;
+  *cookie = req.out_cookie;
+  return 0;
+}
+
+int RdmaClient::submit(const RdmaCopyReq& r, Callback cb, uint64_t* out_cookie) {
+  uint64_t cookie = 0;
+  // Hold the lock across the ioctl so a fast completion cannot be reaped
+  // before its callback is registered.
+  std::unique_lock<std::mutex> lk(mu_);
+  int rc = submit_once(r, &cookie);
+  if (rc == -EBUSY) {
+    lk.unlock();
+    poll_completions(0);
+    lk.lock();
+    rc = submit_once(r, &cookie);
+  }
+  if (rc != 0) return rc;
+  pending_.emplace(cookie, std::move(cb));
+  if (out_cookie) *out_cookie = cookie;
+  return 0;
+}
+
+std::future<int> RdmaClient::submit_async(const RdmaCopyReq& r) {
+  auto done = std::make_shared<std::promise<int>>();
+  std::future<int> f = done->get_future();
+  int rc = submit(r, [done](int status) { done->set_value(status); });
+  if (rc != 0) done->set_value(rc);
+  return f;
+}
+
+int RdmaClient::poll_completions(int timeout_ms) {
+  pollfd pfd{fd_.get(), POLLIN, 0};
+  int pr = ::poll(&pfd, 1, timeout_ms);
+  if (pr < 0) return -errno;
+  if (pr == 0) return 0;
+
+  rdma_completion comps[16];
+  int ran = 0;
+  for (;;) {
+    ssize_t n = ::read(fd_.get(), comps, sizeof(comps));
+    if (n < 0) {
+      if (errno == EAGAIN) break;
+      return ran ? ran : -errno;
+    }
+    for (size_t i = 0; i < (size_t)n / sizeof(comps[0]); ++i) {
+      Callback cb;
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = pending_.find(comps[i].cookie);
+        if (it == pending_.end()) continue;
+        cb = std::move(it->second);
+        pending_.erase(it);
+      }
+      if (cb) cb(comps[i].status);
+      ++ran;
+    }
+    if ((size_t)n < sizeof(comps)) break;
+  }
+  return ran;
+}
+
+int RdmaClient::wait_all(int timeout_ms) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (inflight() > 0) {
+    int left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (timeout_ms >= 0 && left <= 0) return -ETIMEDOUT;
+    int rc = poll_completions(timeout_ms < 0 ? -1 : left);
+    if (rc < 0 && rc != -EINTR) return rc;
+  }
+  return 0;
+}
+
+size_t RdmaClient::inflight() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return pending_.size();
+}
+
+int RdmaClient::get_stats(rdma_stats* out) {
+  return ::ioctl(fd_.get(), RDMA_IOC_GET_STATS, out) == 0 ? 0 : -errno;
+}
@@ -1,5 +1,19 @@
 #pragma once
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include "../common/fd.h"
+
+// Mirrors rdma_copy_flags in rdma_stub_uapi.h.
+enum RdmaCopyFlags : uint32_t {
+  kRdmaCopySecure    = 1u << 0, // secure-policy hint
+  kRdmaCopySrcHandle = 1u << 1, // src_fd is a RdmaClient::register_buffer() handle
+  kRdmaCopyDstHandle = 1u << 2, // dst_fd is a RdmaClient::register_buffer() handle
+};
+
+struct rdma_stats;
 
 struct RdmaCopyReq {
   int src_fd;
@@ -7,7 +21,78 @@ struct RdmaCopyReq {
   uint32_t src_off;
   uint32_t dst_off;
   uint32_t size;
-  uint32_t flags; // bit0 secure-policy
+  uint32_t flags; // RdmaCopyFlags
 };
 
 int rdma_copy(int rdma_dev_fd, const RdmaCopyReq& r);
+
+// Runs `count` copies with RDMA_IOC_COPY_V, one DMA chain per RDMA_MAX_VEC
+// entries. statuses (optional, `count` entries) receives 0 or a negative
+// errno per copy. Returns 0 if every copy succeeded, else a negative errno.
+int rdma_copy_batch(int rdma_dev_fd, const RdmaCopyReq* reqs, size_t count, int* statuses);
+
+// Owns an open /dev/rdma_stub0 and tracks asynchronous copies on it.
+// submit() may be called from one thread while another reaps completions;
+// callbacks run on the thread that calls poll_completions()/wait_all().
+class RdmaClient {
+public:
+  using Callback = std::function<void(int status)>;
+
+  bool open(const char* path = "/dev/rdma_stub0");
+  int fd() const { return fd_.get(); } // pollable: readable when copies finished
+  // False when the driver found no DMA_MEMCPY channel and every copy would
+  // fail with -ENODEV (num_channels of RDMA_IOC_GET_STATS, read by open());
+  // see CpuCopier.
+  bool has_channel() const { return has_channel_; }
+
+  // Keeps dmabuf_fd mapped in the driver for this client. Returns a
+  // positive handle for RdmaCopyReq with kRdmaCopy{Src,Dst}Handle, or a
+  // negative errno. Pool buffers should be registered once, not per copy.
+  int register_buffer(int dmabuf_fd);
+  int unregister_buffer(int handle);
+
+  // Blocking copy. Returns 0 or a negative errno.
+  int copy(const RdmaCopyReq& r);
+
+  // Blocking vectored copy; see rdma_copy_batch().
+  int copy_batch(const RdmaCopyReq* reqs, size_t count, int* statuses = nullptr);
+
+  // Explicit-sync copy (RDMA_IOC_COPY_FENCED): queued without blocking,
+  // starts once in_fence (a sync_file, -1 for none; not consumed) has
+  // signalled. *out_fence receives a sync_file that signals when the copy
+  // is done; a failed copy shows as a negative sync_file_status(). No
+  // callback and nothing for poll_completions(). Returns 0 or a negative
+  // errno, -ENOTTY from modules without fences.
+  int copy_fenced(const RdmaCopyReq& r, int in_fence, UniqueFd* out_fence);
+
+  // Queues a copy; cb(status) runs when it completes. Returns 0, or a
+  // negative errno (-EBUSY when the driver's in-flight queue is full even
+  // after reaping whatever had already finished).
+  int submit(const RdmaCopyReq& r, Callback cb, uint64_t* out_cookie = nullptr);
+
+  // Future-based variant of submit(); the future becomes ready once a
+  // poll_completions()/wait_all() call reaps the copy.
+  std::future<int> submit_async(const RdmaCopyReq& r);
+
+  // Reaps finished copies and runs their callbacks, waiting up to
+  // timeout_ms (-1 = forever) for the first one. Returns callbacks run,
+  // or a negative errno.
+  int poll_completions(int timeout_ms);
+
+  // Reaps until nothing is in flight. Returns 0 or -ETIMEDOUT.
+  int wait_all(int timeout_ms);
+
+  size_t inflight() const;
+
+  // Per-channel counters of the module (RDMA_IOC_GET_STATS). Returns 0 or a
+  // negative errno.
+  int get_stats(rdma_stats* out);
+
+private:
+  int submit_once(const RdmaCopyReq& r, uint64_t* cookie);
+
+  UniqueFd fd_;
+  bool has_channel_ = false;
+  mutable std::mutex mu_;
+  std::unordered_map<uint64_t, Callback> pending_;
+};
@@ -0,0 +1,229 @@
+#include "secure_buffer_pool.h"
+#include "../common/log.h"
+#include "../common/sync_file.h"
+
+#include <algorithm>
+
+void SecureBufferPool::Handle::reset() {
+  if (!pool_) return;
+  pool_->release(slot_, std::move(fence_));
+  pool_ = nullptr;
+  fd_ = -1;
+  layout_ = BufferLayout{};
+}
+
+SecureBufferPool::SecureBufferPool(std::unique_ptr<IBufferAllocator> alloc,
+                                   const BufferPoolConfig& cfg)
+  : alloc_(std::move(alloc)), cfg_(cfg)
+{
+  if (cfg_.max_buffers == 0) cfg_.max_buffers = 1;
+  if (cfg_.high_watermark < cfg_.low_watermark) cfg_.high_watermark = cfg_.low_watermark;
+}
+
+SecureBufferPool::~SecureBufferPool() {
+  std::lock_guard<std::mutex> lk(mu_);
+  size_t busy = 0;
+  for (Slot& s : slots_) {
+    busy += s.in_use ? 1 : 0;
+    if (!s.fd) continue;
+    if (free_hook_) free_hook_(s.fd.get());
+    alloc_->release(cfg_.desc, s.fd.get());
+  }
+  if (busy) LOGW("SecureBufferPool destroyed with %zu buffers still acquired", busy);
+}
+
+bool SecureBufferPool::init() {
+  size_t want;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    want = std::min(cfg_.initial, cfg_.max_buffers - std::min(cfg_.max_buffers, live_));
+    live_ += want;
+  }
+
+  // One batched call so a decoder's reference set costs a single ioctl.
+  std::vector<UniqueFd> fds;
+  BufferLayout layout{};
+  int rc = want ? alloc_->allocate_batch(cfg_.desc, want, &fds, &layout) : 0;
+
+  size_t n = 0;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    live_ -= want;
+    if (rc == 0) {
+      live_ += fds.size();
+      for (UniqueFd& fd : fds) {
+        insert_locked(std::move(fd), layout, false);
+        stats_.allocated++;
+        ++n;
+      }
+    } else {
+      LOGW("SecureBufferPool[%s]: batch allocation failed rc=%d; allocating singly",
+           alloc_->name(), rc);
+    }
+  }
+  for (; n < want; ++n) {
+    if (!grow_one(false, nullptr)) break;
+  }
+
+  LOGI("SecureBufferPool[%s]: %zu/%zu buffers pre-allocated (%ux%u)",
+       alloc_->name(), n, cfg_.initial, cfg_.desc.width, cfg_.desc.height);
+  return n > 0 || cfg_.initial == 0;
+}
+
+SecureBufferPool::Handle SecureBufferPool::acquire() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!idle_.empty()) {
+      // Most recent unfenced buffer; else the oldest, likeliest to signal.
+      size_t pick = 0;
+      for (size_t i = idle_.size(); i-- > 0;) {
+        Slot& c = slots_[idle_[i]];
+        if (c.fence && sync_file_wait(c.fence.get(), 0) != 0) continue;
+        c.fence.reset();
+        pick = i;
+        break;
+      }
+      uint32_t s = idle_[pick];
+      idle_.erase(idle_.begin() + (std::ptrdiff_t)pick);
+      slots_[s].in_use = true;
+      stats_.hits++;
+      Handle h(this, s, slots_[s].fd.get(), slots_[s].layout);
+      h.set_fence(std::move(slots_[s].fence));
+      return h;
+    }
+    stats_.misses++;
+  }
+
+  uint32_t s = 0;
+  if (!grow_one(true, &s)) {
+    std::lock_guard<std::mutex> lk(mu_);
+    stats_.exhausted++;
+    return Handle();
+  }
+  std::lock_guard<std::mutex> lk(mu_);
+  return Handle(this, s, slots_[s].fd.get(), slots_[s].layout);
+}
+
+SecureBufferPool::Handle SecureBufferPool::acquire_wait(const std::function<bool()>& stop) {
+  for (;;) {
+    uint64_t seen;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      seen = releases_;
+    }
+    Handle h = acquire();
+    if (h || stop()) return h;
+    // A release between acquire() and here bumped releases_: no lost wake-up.
+    std::unique_lock<std::mutex> lk(mu_);
+    released_cv_.wait(lk, [&] { return releases_ != seen || stop(); });
+  }
+}
+
+void SecureBufferPool::wake_waiters() {
+  // Taking mu_ orders this after a waiter's stop() check.
+  { std::lock_guard<std::mutex> lk(mu_); }
+  released_cv_.notify_all();
+}
+
+size_t SecureBufferPool::replenish() {
+  size_t added = 0;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (idle_.size() >= cfg_.low_watermark) break;
+    }
+    if (!grow_one(false, nullptr)) break;
+    ++added;
+  }
+  return added;
+}
+
+size_t SecureBufferPool::trim(size_t keep) {
+  std::lock_guard<std::mutex> lk(mu_);
+  size_t freed = 0;
+  while (idle_.size() > keep) {
+    // Drop the coldest idle buffer first.
+    uint32_t s = idle_.front();
+    idle_.erase(idle_.begin());
+    free_slot_locked(s);
+    ++freed;
+  }
+  return freed;
+}
+
+void SecureBufferPool::set_free_hook(std::function<void(int fd)> hook) {
+  std::lock_guard<std::mutex> lk(mu_);
+  free_hook_ = std::move(hook);
+}
+
+BufferPoolStats SecureBufferPool::stats() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  BufferPoolStats st = stats_;
+  st.live = live_;
+  st.idle = idle_.size();
+  return st;
+}
+
+void SecureBufferPool::release(uint32_t slot, UniqueFd fence) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    slots_[slot].in_use = false;
+    slots_[slot].fence = std::move(fence);
+    ++releases_;
+    if (idle_.size() >= cfg_.high_watermark) free_slot_locked(slot);
+    else idle_.push_back(slot);
+  }
+  released_cv_.notify_all();
+}
+
+bool SecureBufferPool::grow_one(bool in_use, uint32_t* out_slot) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (live_ >= cfg_.max_buffers) return false;
+    ++live_; // reserve before dropping the lock for the slow allocation
+  }
+
+  UniqueFd fd;
+  BufferLayout layout{};
+  int rc = alloc_->allocate(cfg_.desc, &fd, &layout);
+
+  std::lock_guard<std::mutex> lk(mu_);
+  if (rc != 0) {
+    --live_;
+    LOGE("SecureBufferPool[%s]: allocation failed rc=%d", alloc_->name(), rc);
+    return false;
+  }
+  uint32_t s = insert_locked(std::move(fd), layout, in_use);
+  stats_.allocated++;
+  if (out_slot) *out_slot = s;
+  return true;
+}
+
+uint32_t SecureBufferPool::insert_locked(UniqueFd fd, const BufferLayout& layout, bool in_use) {
+  uint32_t s;
+  if (!vacant_.empty()) {
+    s = vacant_.back();
+    vacant_.pop_back();
+  } else {
+    s = (uint32_t)slots_.size();
+    slots_.emplace_back();
+  }
+  slots_[s].fd = std::move(fd);
+  slots_[s].layout = layout;
+  slots_[s].in_use = in_use;
+  if (!in_use) idle_.push_back(s);
+  return s;
+}
+
+// A still-fenced buffer is freed anyway: the dma-buf stays alive for as
+// long as the device holding the fence has it attached.
+void SecureBufferPool::free_slot_locked(uint32_t slot) {
+  slots_[slot].fence.reset();
+  if (free_hook_) free_hook_(slots_[slot].fd.get());
+  alloc_->release(cfg_.desc, slots_[slot].fd.get());
+  slots_[slot].fd.reset();
+  slots_[slot].layout = BufferLayout{};
+  vacant_.push_back(slot);
+  --live_;
+  stats_.freed++;
+}
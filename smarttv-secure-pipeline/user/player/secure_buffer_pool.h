@@ -0,0 +1,152 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "buffer_allocator.h"
+#include "../common/fd.h"
+
+struct BufferPoolConfig {
+  BufferDesc desc;
+  size_t initial = 4;        // pre-allocated by init()
+  size_t low_watermark = 2;  // replenish() tops idle buffers up to this
+  size_t high_watermark = 8; // idle buffers beyond this are freed on release
+  size_t max_buffers = 16;   // hard cap on live buffers
+};
+
+struct BufferPoolStats {
+  uint64_t hits = 0;       // acquire() served from the idle list
+  uint64_t misses = 0;     // acquire() had to allocate
+  uint64_t exhausted = 0;  // acquire() failed (cap reached or alloc error)
+  uint64_t allocated = 0;
+  uint64_t freed = 0;
+  size_t live = 0;         // buffers owned by the pool (idle + in use)
+  size_t idle = 0;
+};
+
+// Long-lived pool of equally sized video buffers. Buffers are handed out
+// as RAII handles and go back to the idle list when the handle dies, so
+// the secure-heap allocator stays out of the per-frame path.
+// Thread-safe; the pool must outlive every handle it hands out.
+class SecureBufferPool {
+public:
+  class Handle {
+  public:
+    Handle() = default;
+    ~Handle() { reset(); }
+
+    Handle(const Handle&) = delete;
+    Handle& operator=(const Handle&) = delete;
+
+    Handle(Handle&& o) noexcept { *this = std::move(o); }
+    Handle& operator=(Handle&& o) noexcept {
+      if (this != &o) {
+        reset();
+        pool_ = o.pool_; slot_ = o.slot_; fd_ = o.fd_; layout_ = o.layout_;
+        fence_ = std::move(o.fence_);
+        o.pool_ = nullptr; o.fd_ = -1;
+      }
+      return *this;
+    }
+
+    int fd() const { return fd_; }        // borrowed; owned by the pool
+    size_t size() const { return (size_t)layout_.size; }
+    // Plane pitches/offsets the buffer was allocated with; import with these.
+    const BufferLayout& layout() const { return layout_; }
+    uint32_t slot() const { return slot_; }
+    explicit operator bool() const { return pool_ != nullptr; }
+
+    // Explicit sync: a sync_file that must signal before the buffer is
+    // next accessed (-1: none pending). Set by whoever last queued work on
+    // the buffer without waiting for it, e.g. a fenced copy writing it or a
+    // display still scanning it out; the fence travels with the handle and
+    // stays with the buffer while it is idle in the pool.
+    int fence() const { return fence_.get(); }
+    void set_fence(UniqueFd f) { fence_ = std::move(f); }
+    UniqueFd take_fence() { return std::move(fence_); }
+
+    // Returns the buffer to the pool early.
+    void reset();
+
+  private:
+    friend class SecureBufferPool;
+    Handle(SecureBufferPool* p, uint32_t slot, int fd, const BufferLayout& layout)
+      : pool_(p), slot_(slot), fd_(fd), layout_(layout) {}
+
+    SecureBufferPool* pool_ = nullptr;
+    uint32_t slot_ = 0;
+    int fd_ = -1;
+    BufferLayout layout_{};
+    UniqueFd fence_;
+  };
+
+  SecureBufferPool(std::unique_ptr<IBufferAllocator> alloc, const BufferPoolConfig& cfg);
+  ~SecureBufferPool();
+
+  SecureBufferPool(const SecureBufferPool&) = delete;
+  SecureBufferPool& operator=(const SecureBufferPool&) = delete;
+
+  // Pre-allocates cfg.initial buffers. False if none could be allocated.
+  bool init();
+
+  // Idle buffer if one exists, otherwise allocates below max_buffers.
+  // Idle buffers whose fence has signalled go first; if every one is still
+  // fenced the oldest is returned, with its fence (Handle::fence()).
+  // Returns an empty handle when the pool is exhausted.
+  Handle acquire();
+
+  // acquire() that sleeps while the pool is exhausted, until a handle is
+  // released or stop() holds; stop() is checked again on wake_waiters().
+  // Returns an empty handle only once stop() holds.
+  Handle acquire_wait(const std::function<bool()>& stop);
+
+  // Wakes acquire_wait() callers to re-check their stop condition.
+  void wake_waiters();
+
+  // Allocates until low_watermark buffers are idle. Meant to run off the
+  // frame path (e.g. between segments). Returns buffers added.
+  size_t replenish();
+
+  // Frees idle buffers until at most `keep` remain idle. Returns buffers freed.
+  size_t trim(size_t keep);
+
+  // Called with a buffer's fd right before the pool frees it (trim, high
+  // watermark, destruction), so importers such as GbmKmsRenderer can drop
+  // what they cached for it. Runs under the pool lock; must not call back
+  // into the pool.
+  void set_free_hook(std::function<void(int fd)> hook);
+
+  BufferPoolStats stats() const;
+  const BufferPoolConfig& config() const { return cfg_; }
+  const char* backend() const { return alloc_->name(); }
+
+private:
+  struct Slot {
+    UniqueFd fd;
+    BufferLayout layout{};
+    UniqueFd fence; // while idle
+    bool in_use = false;
+  };
+
+  void release(uint32_t slot, UniqueFd fence);
+  bool grow_one(bool in_use, uint32_t* out_slot);
+  uint32_t insert_locked(UniqueFd fd, const BufferLayout& layout, bool in_use);
+  void free_slot_locked(uint32_t slot);
+
+  std::unique_ptr<IBufferAllocator> alloc_;
+  BufferPoolConfig cfg_;
+  std::function<void(int fd)> free_hook_;
+
+  mutable std::mutex mu_;
+  std::condition_variable released_cv_;
+  uint64_t releases_ = 0;         // bumped per release(), for acquire_wait()
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> idle_;    // LIFO: most recently used first
+  std::vector<uint32_t> vacant_;  // reusable entries in slots_
+  size_t live_ = 0;               // includes allocations in progress
+  BufferPoolStats stats_;
+};
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../common/fd.h"
+
+// Bounded single-producer/single-consumer ring for passing move-only
+// buffer handles between pipeline stage threads.
+//
+// try_push()/try_pop() are lock-free and syscall-free. The blocking
+// push()/pop() try the fast path first and only sleep (on an eventfd)
+// when the ring is full/empty; the other side pays a write() only
+// if a sleeper announced itself, so a stream that keeps both sides busy
+// costs no syscalls. Indices live on separate cache lines, each side keeps
+// a private copy of the other's index to avoid bouncing the shared one.
+template <typename T>
+class SpscRing {
+public:
+  explicit SpscRing(size_t capacity)
+    : not_empty_(::eventfd(0, EFD_CLOEXEC)), not_full_(::eventfd(0, EFD_CLOEXEC))
+  {
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+    slots_.resize(cap);
+    mask_ = cap - 1;
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  size_t capacity() const { return mask_ + 1; }
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  // Producer side. Moves from v only on success.
+  bool try_push(T& v) {
+    size_t t = tail_.load(std::memory_order_relaxed);
+    if (t - head_cache_ == capacity()) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (t - head_cache_ == capacity()) return false;
+    }
+    slots_[t & mask_] = std::move(v);
+    tail_.store(t + 1, std::memory_order_release);
+    wake(consumer_waiting_, not_empty_);
+    return true;
+  }
+
+  // Consumer side.
+  bool try_pop(T* out) {
+    size_t h = head_.load(std::memory_order_relaxed);
+    if (h == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (h == tail_cache_) return false;
+    }
+    *out = std::move(slots_[h & mask_]);
+    slots_[h & mask_] = T();
+    head_.store(h + 1, std::memory_order_release);
+    wake(producer_waiting_, not_full_);
+    return true;
+  }
+
+  // Blocks while full. False (and v is dropped) once the ring is closed.
+  bool push(T v) {
+    for (;;) {
+      if (closed_.load(std::memory_order_acquire)) return false;
+      if (try_push(v)) return true;
+      producer_waiting_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (try_push(v)) {
+        producer_waiting_.store(false, std::memory_order_relaxed);
+        return true;
+      }
+      if (!closed_.load(std::memory_order_acquire)) sleep_on(not_full_);
+      producer_waiting_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  // Blocks while empty. False once the ring is closed and drained.
+  bool pop(T* out) {
+    for (;;) {
+      if (try_pop(out)) return true;
+      if (closed_.load(std::memory_order_acquire)) return try_pop(out);
+      consumer_waiting_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (try_pop(out)) {
+        consumer_waiting_.store(false, std::memory_order_relaxed);
+        return true;
+      }
+      if (!closed_.load(std::memory_order_acquire)) sleep_on(not_empty_);
+      consumer_waiting_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  // End of stream (producer) or abort (either side); wakes both sides.
+  void close() {
+    closed_.store(true, std::memory_order_release);
+    signal(not_empty_);
+    signal(not_full_);
+  }
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+private:
+  static constexpr size_t kCacheLine = 64;
+
+  // Pairs with the fence a sleeper issues after raising its flag.
+  static void wake(std::atomic<bool>& waiting, const UniqueFd& efd) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed)) signal(efd);
+  }
+  static void signal(const UniqueFd& efd) {
+    uint64_t one = 1;
+    (void)!::write(efd.get(), &one, sizeof(one));
+  }
+  static void sleep_on(const UniqueFd& efd) {
+    uint64_t v;
+    (void)!::read(efd.get(), &v, sizeof(v));
+  }
+
+  alignas(kCacheLine) std::atomic<size_t> head_{0}; // written by the consumer
+  size_t tail_cache_ = 0;                           // consumer's view of tail_
+
+  alignas(kCacheLine) std::atomic<size_t> tail_{0}; // written by the producer
+  size_t head_cache_ = 0;                           // producer's view of head_
+
+  // Read on every push/pop, written only around sleeps: kept off the
+  // index lines so the fast path does not bounce them.
+  alignas(kCacheLine) std::atomic<bool> consumer_waiting_{false};
+  std::atomic<bool> producer_waiting_{false};
+  std::atomic<bool> closed_{false};
+  UniqueFd not_empty_;
+  UniqueFd not_full_;
+  std::vector<T> slots_;
+  size_t mask_ = 0;
+};
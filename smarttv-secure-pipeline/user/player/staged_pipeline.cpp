@@ -0,0 +1,441 @@
+#include "staged_pipeline.h"
+#include "cpu_copy.h"
+#include "rdma_client.h"
+#include "spsc_ring.h"
+#include "../common/log.h"
+#include "../common/sync_file.h"
+#include "../renderer/gbm_kms_renderer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <poll.h>
+#include <sys/mman.h>
+#include <thread>
+#include <time.h>
+
+extern "C" {
+#include "../../kernel/secure_video/svp_uapi.h"
+}
+
+static uint64_t now_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+namespace {
+
+struct Mapping {
+  void* p = MAP_FAILED;
+  size_t size = 0;
+  Mapping(int fd, size_t sz, int prot) : size(sz) {
+    p = ::mmap(nullptr, sz, prot, MAP_SHARED, fd, 0);
+  }
+  ~Mapping() { if (p != MAP_FAILED) ::munmap(p, size); }
+  bool ok() const { return p != MAP_FAILED; }
+};
+
+class PatternSource final : public IFrameSource {
+public:
+  const char* name() const override { return "pattern"; }
+  int fill(int fd, const BufferLayout& layout, uint64_t seq) override {
+    Mapping m(fd, (size_t)layout.size, PROT_WRITE);
+    if (!m.ok()) return -errno;
+    std::memset(m.p, (int)(seq & 0xff), (size_t)layout.size);
+    return 0;
+  }
+};
+
+class NullSource final : public IFrameSource {
+public:
+  const char* name() const override { return "null"; }
+  int fill(int, const BufferLayout&, uint64_t) override { return 0; }
+};
+
+// Fenced RDMA copy, or the CPU-wait default once the module has shown it
+// has no RDMA_IOC_COPY_FENCED.
+int rdma_copy_fenced(RdmaClient* rdma, const RdmaCopyReq& r, int in_fence, UniqueFd* out_fence,
+                     bool* fenced) {
+  if (*fenced) {
+    int rc = rdma->copy_fenced(r, in_fence, out_fence);
+    if (rc != -ENOTTY) return rc;
+    LOGW("rdma_stub has no fenced copies; waiting on the CPU");
+    *fenced = false;
+  }
+  int rc = sync_file_wait(in_fence, 1000);
+  return rc != 0 ? rc : rdma->copy(r);
+}
+
+class RdmaCopyEngine final : public ICopyEngine {
+public:
+  RdmaCopyEngine(RdmaClient* rdma, uint32_t flags) : rdma_(rdma), flags_(flags) {}
+  const char* name() const override { return "rdma"; }
+  int copy(int src_fd, int dst_fd, size_t size) override { return rdma_->copy(req(src_fd, dst_fd, size)); }
+  int copy_fenced(int src_fd, int dst_fd, size_t size, int in_fence,
+                  UniqueFd* out_fence) override {
+    return rdma_copy_fenced(rdma_, req(src_fd, dst_fd, size), in_fence, out_fence, &fenced_);
+  }
+
+private:
+  RdmaCopyReq req(int src_fd, int dst_fd, size_t size) const {
+    RdmaCopyReq r{};
+    r.src_fd = src_fd;
+    r.dst_fd = dst_fd;
+    r.size = (uint32_t)size;
+    r.flags = flags_;
+    return r;
+  }
+
+  RdmaClient* rdma_;
+  uint32_t flags_;
+  bool fenced_ = true;
+};
+
+class MemcpyCopyEngine final : public ICopyEngine {
+public:
+  const char* name() const override { return "memcpy"; }
+  int copy(int src_fd, int dst_fd, size_t size) override {
+    Mapping s(src_fd, size, PROT_READ), d(dst_fd, size, PROT_WRITE);
+    if (!s.ok() || !d.ok()) return -errno;
+    std::memcpy(d.p, s.p, size);
+    return 0;
+  }
+};
+
+class AutoCopyEngine final : public ICopyEngine {
+public:
+  AutoCopyEngine(RdmaClient* rdma, CpuCopier* cpu, uint32_t buf_flags, size_t cpu_max_bytes)
+    : cpu_max_bytes_(cpu_max_bytes) {
+    bool cpu_ok = !(buf_flags & (SVP_BUF_SECURE | SVP_BUF_CPU_NOACCESS));
+    rdma_ = rdma && rdma->has_channel() ? rdma : nullptr;
+    cpu_ = cpu_ok ? cpu : nullptr;
+    rdma_flags_ = (buf_flags & SVP_BUF_SECURE) ? (uint32_t)kRdmaCopySecure : 0u;
+    if (!rdma_) cpu_max_bytes_ = SIZE_MAX;
+    name_ = rdma_ && cpu_ ? "cpu+rdma" : rdma_ ? "rdma" : cpu_ ? "cpu" : "none";
+  }
+  const char* name() const override { return name_; }
+  int copy(int src_fd, int dst_fd, size_t size) override {
+    RdmaCopyReq r = req(src_fd, dst_fd, size);
+    if (cpu_ && size <= cpu_max_bytes_) return cpu_->copy(r);
+    return rdma_ ? rdma_->copy(r) : -ENODEV;
+  }
+  int copy_fenced(int src_fd, int dst_fd, size_t size, int in_fence,
+                  UniqueFd* out_fence) override {
+    if ((cpu_ && size <= cpu_max_bytes_) || !rdma_)
+      return ICopyEngine::copy_fenced(src_fd, dst_fd, size, in_fence, out_fence);
+    return rdma_copy_fenced(rdma_, req(src_fd, dst_fd, size), in_fence, out_fence, &fenced_);
+  }
+
+private:
+  RdmaCopyReq req(int src_fd, int dst_fd, size_t size) const {
+    RdmaCopyReq r{};
+    r.src_fd = src_fd;
+    r.dst_fd = dst_fd;
+    r.size = (uint32_t)size;
+    r.flags = rdma_flags_;
+    return r;
+  }
+
+  RdmaClient* rdma_;
+  CpuCopier* cpu_;
+  uint32_t rdma_flags_;
+  size_t cpu_max_bytes_;
+  const char* name_;
+  bool fenced_ = true;
+};
+
+class RendererSink final : public IFrameSink {
+public:
+  RendererSink(GbmKmsRenderer* r, const std::string& card, const BufferDesc& desc)
+    : r_(r), card_(card), desc_(desc) {}
+  const char* name() const override { return "renderer"; }
+
+  bool start() override { return r_->initialized() ? r_->make_current() : r_->init(card_); }
+
+  int present(SecureBufferPool::Handle frame, uint64_t seq) override {
+    (void)seq;
+    // Do not run ahead of the display: wait for a free flip slot.
+    while (r_->present_queue_full()) {
+      pollfd pfd{r_->display_fd(), POLLIN, 0};
+      if (::poll(&pfd, 1, 1000) <= 0) return -ETIMEDOUT;
+      r_->dispatch_events();
+    }
+
+    // A frame whose copy failed holds garbage: fail it, do not show it.
+    int rc = std::min(sync_file_status(frame.fence()), 0);
+    if (rc != 0) return rc;
+
+    bool ok = false;
+    if (import_ok_) {
+      const BufferLayout& l = frame.layout();
+      ok = r_->present_dmabuf_frame(frame.fd(), desc_.width, desc_.height, desc_.fourcc,
+                                    l.pitches, l.offsets, frame.fence());
+      // The copy may have failed while the renderer waited for it.
+      rc = std::min(sync_file_status(frame.fence()), 0);
+      if (!ok && rc != 0) return rc;
+      if (!ok) {
+        LOGW("dma-buf import not supported here; presenting the test pattern instead");
+        import_ok_ = false;
+      }
+    }
+    if (!ok && !r_->render_test_pattern(1)) return -EIO;
+
+    // Frames the renderer has a release fence for go back to the pool now,
+    // fenced. Without fences: screen + pending flip + queued, older frames
+    // are no longer read.
+    held_.push_back(std::move(frame));
+    for (auto it = held_.begin(); it != held_.end();) {
+      UniqueFd release = r_->take_release_fence(it->fd());
+      if (!release) {
+        ++it;
+        continue;
+      }
+      it->set_fence(std::move(release));
+      it = held_.erase(it);
+    }
+    while (held_.size() > 3) held_.pop_front();
+    return 0;
+  }
+
+  void stop() override {
+    r_->shutdown();
+    held_.clear();
+  }
+
+private:
+  GbmKmsRenderer* r_;
+  std::string card_;
+  BufferDesc desc_;
+  bool import_ok_ = true;
+  std::deque<SecureBufferPool::Handle> held_;
+};
+
+class NullSink final : public IFrameSink {
+public:
+  explicit NullSink(uint32_t interval_us) : interval_ns_((uint64_t)interval_us * 1000) {}
+  const char* name() const override { return "null"; }
+
+  int present(SecureBufferPool::Handle frame, uint64_t seq) override {
+    (void)seq;
+    // Stands in for a display reading the frame: it has to be complete.
+    int rc = sync_file_wait(frame.fence(), 1000);
+    if (rc == 0) rc = std::min(sync_file_status(frame.fence()), 0);
+    if (rc != 0) return rc; // the copy that wrote it failed
+    if (!interval_ns_) return 0;
+    uint64_t now = now_ns();
+    next_ns_ = next_ns_ ? next_ns_ + interval_ns_ : now;
+    if (next_ns_ < now) next_ns_ = now; // late: do not try to catch up
+    timespec ts{ (time_t)(next_ns_ / 1000000000ull), (long)(next_ns_ % 1000000000ull) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    return 0;
+  }
+
+private:
+  uint64_t interval_ns_;
+  uint64_t next_ns_ = 0;
+};
+
+using FrameRing = SpscRing<SecureBufferPool::Handle>;
+
+// Sleeps on the pool while it is exhausted; fail() wakes it.
+SecureBufferPool::Handle acquire_wait(SecureBufferPool* pool, const std::atomic<int>& error) {
+  return pool->acquire_wait([&] { return error.load(std::memory_order_relaxed) != 0; });
+}
+
+struct Stages {
+  std::atomic<int>& error;
+  PipelineStage& failed_stage; // written by the fail() that sets error
+  FrameRing& fed;
+  FrameRing& copied;
+  SecureBufferPool* src_pool;
+  SecureBufferPool* dst_pool; // may be null
+};
+
+const char* stage_name(PipelineStage stage) {
+  switch (stage) {
+    case PipelineStage::kFeed: return "feed";
+    case PipelineStage::kCopy: return "copy";
+    case PipelineStage::kPresent: return "present";
+    default: return "none";
+  }
+}
+
+void fail(Stages& s, int rc, PipelineStage stage) {
+  int expected = 0;
+  if (s.error.compare_exchange_strong(expected, rc)) {
+    s.failed_stage = stage;
+    LOGE("pipeline %s stage failed: %d", stage_name(stage), rc);
+  }
+  s.fed.close();
+  s.copied.close();
+  s.src_pool->wake_waiters();
+  if (s.dst_pool) s.dst_pool->wake_waiters();
+}
+
+} // namespace
+
+int ICopyEngine::copy_fenced(int src_fd, int dst_fd, size_t size, int in_fence,
+                             UniqueFd* out_fence) {
+  out_fence->reset();
+  int rc = sync_file_wait(in_fence, 1000);
+  return rc != 0 ? rc : copy(src_fd, dst_fd, size);
+}
+
+std::unique_ptr<IFrameSource> CreatePatternSource() { return std::make_unique<PatternSource>(); }
+std::unique_ptr<IFrameSource> CreateNullSource() { return std::make_unique<NullSource>(); }
+
+std::unique_ptr<ICopyEngine> CreateRdmaCopyEngine(RdmaClient* rdma, uint32_t flags) {
+  return std::make_unique<RdmaCopyEngine>(rdma, flags);
+}
+std::unique_ptr<ICopyEngine> CreateMemcpyCopyEngine() { return std::make_unique<MemcpyCopyEngine>(); }
+std::unique_ptr<ICopyEngine> CreateAutoCopyEngine(RdmaClient* rdma, CpuCopier* cpu,
+                                                  uint32_t buf_flags, size_t cpu_max_bytes) {
+  return std::make_unique<AutoCopyEngine>(rdma, cpu, buf_flags, cpu_max_bytes);
+}
+
+std::unique_ptr<IFrameSink> CreateRendererSink(GbmKmsRenderer* renderer, const std::string& card,
+                                               const BufferDesc& desc) {
+  return std::make_unique<RendererSink>(renderer, card, desc);
+}
+std::unique_ptr<IFrameSink> CreateNullSink(uint32_t interval_us) {
+  return std::make_unique<NullSink>(interval_us);
+}
+
+void StagedPipelineStats::print() const {
+  LOGI("pipeline: %llu frames in %.2fs = %.1f fps", (unsigned long long)frames,
+       (double)elapsed_ns / 1e9, fps());
+  const struct { const char* name; const StageStats* s; } rows[] = {
+    { "feed", &feed }, { "copy", &copy }, { "present", &present },
+  };
+  for (const auto& row : rows) {
+    LOGI("  %-8s frames=%-6llu busy=%5.1f%% wait_in=%8.1fms wait_out=%8.1fms", row.name,
+         (unsigned long long)row.s->frames, row.s->occupancy() * 100.0,
+         (double)row.s->wait_in_ns / 1e6, (double)row.s->wait_out_ns / 1e6);
+  }
+}
+
+StagedPipeline::StagedPipeline(SecureBufferPool* src_pool, SecureBufferPool* dst_pool,
+                               IFrameSource* source, ICopyEngine* copy, IFrameSink* sink)
+  : src_pool_(src_pool), dst_pool_(dst_pool), source_(source), copy_(copy), sink_(sink) {}
+
+int StagedPipeline::run(const StagedPipelineConfig& cfg) {
+  stats_ = StagedPipelineStats{};
+  FrameRing fed(cfg.ring_depth), copied(cfg.ring_depth);
+  std::atomic<int> error{0};
+  Stages stages{ error, stats_.failed_stage, fed, copied, src_pool_, dst_pool_ };
+  uint64_t start = now_ns();
+
+  std::thread feeder([&] {
+    StageStats& st = stats_.feed;
+    for (uint64_t seq = 0; seq < cfg.frames; ++seq) {
+      uint64_t t0 = now_ns();
+      SecureBufferPool::Handle h = acquire_wait(src_pool_, error);
+      if (!h) break;
+      // Sources write on the CPU (or outside any fence): the last copy
+      // reading the buffer must be done first.
+      int rc = sync_file_wait(h.fence(), 1000);
+      if (rc != 0) { fail(stages, rc, PipelineStage::kFeed); break; }
+      h.take_fence();
+      uint64_t t1 = now_ns();
+      rc = source_->fill(h.fd(), h.layout(), seq);
+      uint64_t t2 = now_ns();
+      if (rc == -ENODATA) break; // end of stream: drain what is queued
+      if (rc != 0) { fail(stages, rc, PipelineStage::kFeed); break; }
+      if (!fed.push(std::move(h))) break;
+      uint64_t t3 = now_ns();
+      st.wait_in_ns += t1 - t0;
+      st.busy_ns += t2 - t1;
+      st.wait_out_ns += t3 - t2;
+      st.frames++;
+    }
+    fed.close();
+  });
+
+  std::thread copier([&] {
+    StageStats& st = stats_.copy;
+    // Out-fences of copies not yet known to have succeeded, oldest first.
+    // Retired in order as they signal; a copy still running keeps its place
+    // rather than being dropped when the next one is queued.
+    std::deque<UniqueFd> unretired;
+    auto retire = [&](int timeout_ms) {
+      while (!unretired.empty()) {
+        int rc = sync_file_wait(unretired.front().get(), timeout_ms);
+        if (rc == -ETIME && timeout_ms == 0) return 0;
+        if (rc == 0) rc = std::min(sync_file_status(unretired.front().get()), 0);
+        unretired.pop_front();
+        if (rc != 0) return rc;
+      }
+      return 0;
+    };
+    for (;;) {
+      uint64_t t0 = now_ns();
+      SecureBufferPool::Handle src;
+      if (!fed.pop(&src)) break;
+      SecureBufferPool::Handle out;
+      if (copy_ && dst_pool_) {
+        out = acquire_wait(dst_pool_, error);
+        if (!out) break;
+      }
+      uint64_t t1 = now_ns();
+      if (out) {
+        // Queued behind whatever still reads `out` (its release fence); the
+        // frame carries the copy's fence to the sink, and the source keeps
+        // one so the feeder does not overwrite it mid-copy.
+        UniqueFd done;
+        int rc = retire(unretired.size() >= 16 ? 1000 : 0);
+        if (rc == 0)
+          rc = copy_->copy_fenced(src.fd(), out.fd(), std::min(src.size(), out.size()),
+                                  out.fence(), &done);
+        if (rc != 0) { fail(stages, rc, PipelineStage::kCopy); break; }
+        src.set_fence(sync_file_dup(done.get()));
+        if (done) unretired.push_back(sync_file_dup(done.get()));
+        out.set_fence(std::move(done));
+        src.reset(); // back to the feeder right away
+      } else {
+        out = std::move(src);
+      }
+      uint64_t t2 = now_ns();
+      if (!copied.push(std::move(out))) break;
+      uint64_t t3 = now_ns();
+      st.wait_in_ns += t1 - t0;
+      st.busy_ns += t2 - t1;
+      st.wait_out_ns += t3 - t2;
+      st.frames++;
+    }
+    int rc = retire(1000);
+    if (rc != 0) fail(stages, rc, PipelineStage::kCopy);
+    copied.close();
+  });
+
+  std::thread presenter([&] {
+    StageStats& st = stats_.present;
+    if (!sink_->start()) {
+      fail(stages, -ENODEV, PipelineStage::kPresent);
+      return;
+    }
+    for (uint64_t seq = 0;; ++seq) {
+      uint64_t t0 = now_ns();
+      SecureBufferPool::Handle h;
+      if (!copied.pop(&h)) break;
+      uint64_t t1 = now_ns();
+      int rc = sink_->present(std::move(h), seq);
+      uint64_t t2 = now_ns();
+      if (rc != 0) { fail(stages, rc, PipelineStage::kPresent); break; }
+      if (seq == 0) stats_.first_frame_ns = t2;
+      st.wait_in_ns += t1 - t0;
+      st.busy_ns += t2 - t1;
+      st.frames++;
+    }
+    sink_->stop();
+  });
+
+  feeder.join();
+  copier.join();
+  presenter.join();
+
+  stats_.frames = stats_.present.frames;
+  stats_.elapsed_ns = now_ns() - start;
+  return error.load();
+}
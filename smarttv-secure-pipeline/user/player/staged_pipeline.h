@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "secure_buffer_pool.h"
+
+class CpuCopier;
+class GbmKmsRenderer;
+class RdmaClient;
+
+// Stage backends. Each one is driven from its own stage thread only.
+
+// Feeder: produces frame data into a pool buffer (demuxer/decoder output).
+class IFrameSource {
+public:
+  virtual ~IFrameSource() = default;
+  virtual const char* name() const = 0;
+  // Writes frame `seq` into the buffer, laid out as `layout`. Returns 0,
+  // -ENODATA at the end of the stream, or another negative errno.
+  virtual int fill(int fd, const BufferLayout& layout, uint64_t seq) = 0;
+};
+
+// Secure copy: moves a frame between buffers (RDMA engine or CPU).
+class ICopyEngine {
+public:
+  virtual ~ICopyEngine() = default;
+  virtual const char* name() const = 0;
+  // Returns 0, or a negative errno.
+  virtual int copy(int src_fd, int dst_fd, size_t size) = 0;
+  // Explicit sync: the copy must not start before in_fence (a sync_file,
+  // -1 for none) has signalled, and may still be running on return; then
+  // *out_fence signals when it is done. Left empty when the copy already
+  // finished. The default waits for in_fence on the CPU and calls copy().
+  virtual int copy_fenced(int src_fd, int dst_fd, size_t size, int in_fence,
+                          UniqueFd* out_fence);
+};
+
+// Render/present: takes ownership of the frame and keeps it for as long as
+// it may still be read (e.g. until it has left the screen), or hands it back
+// early with a release fence set (Handle::set_fence()). The frame's own
+// fence, if any, must signal before its contents are read.
+class IFrameSink {
+public:
+  virtual ~IFrameSink() = default;
+  virtual const char* name() const = 0;
+  // Runs on the present thread before the first frame (EGL is per thread).
+  virtual bool start() { return true; }
+  // Returns 0, or a negative errno.
+  virtual int present(SecureBufferPool::Handle frame, uint64_t seq) = 0;
+  // Runs on the present thread after the last frame.
+  virtual void stop() {}
+};
+
+// CPU pattern fill through mmap; memfd/udmabuf buffers only. Raw and Y4M
+// files are read by CreateFileSource() (file_source.h).
+std::unique_ptr<IFrameSource> CreatePatternSource();
+// Buffers are written outside the CPU (decoder, TEE); nothing to do here.
+std::unique_ptr<IFrameSource> CreateNullSource();
+
+// RdmaClient::copy() with the given RdmaCopyFlags (client is borrowed);
+// copy_fenced() uses RdmaClient::copy_fenced() unless the module lacks it.
+std::unique_ptr<ICopyEngine> CreateRdmaCopyEngine(RdmaClient* rdma, uint32_t flags);
+// CPU memcpy through mmap; memfd/udmabuf buffers only.
+std::unique_ptr<ICopyEngine> CreateMemcpyCopyEngine();
+// Picks an engine per copy (both borrowed, either may be null). Buffers the
+// CPU may map (buf_flags without SVP_BUF_SECURE / SVP_BUF_CPU_NOACCESS) go
+// to `cpu` up to cpu_max_bytes, or at any size when rdma is missing or has
+// no DMA channel; everything else goes to RDMA, secure buffers with
+// kRdmaCopySecure.
+std::unique_ptr<ICopyEngine> CreateAutoCopyEngine(RdmaClient* rdma, CpuCopier* cpu,
+                                                  uint32_t buf_flags,
+                                                  size_t cpu_max_bytes = 256u << 10);
+
+// GbmKmsRenderer on `card`, initialised on the present thread unless the
+// caller already did (and released its context, see make_current()). Frames
+// the renderer cannot import fall back to the test pattern.
+std::unique_ptr<IFrameSink> CreateRendererSink(GbmKmsRenderer* renderer, const std::string& card,
+                                               const BufferDesc& desc);
+// Display stand-in: accepts one frame per interval_us (0: as fast as possible).
+std::unique_ptr<IFrameSink> CreateNullSink(uint32_t interval_us);
+
+struct StageStats {
+  uint64_t frames = 0;
+  uint64_t busy_ns = 0;     // inside the backend
+  uint64_t wait_in_ns = 0;  // input ring empty / pool exhausted
+  uint64_t wait_out_ns = 0; // output ring full
+
+  double occupancy() const {
+    uint64_t total = busy_ns + wait_in_ns + wait_out_ns;
+    return total ? (double)busy_ns / (double)total : 0.0;
+  }
+};
+
+enum class PipelineStage { kNone, kFeed, kCopy, kPresent };
+
+struct StagedPipelineStats {
+  uint64_t frames = 0;
+  uint64_t elapsed_ns = 0;
+  uint64_t first_frame_ns = 0; // CLOCK_MONOTONIC when the first frame was presented
+  PipelineStage failed_stage = PipelineStage::kNone; // the one whose error run() returned
+  StageStats feed, copy, present;
+
+  double fps() const { return elapsed_ns ? (double)frames * 1e9 / (double)elapsed_ns : 0.0; }
+  void print() const;
+};
+
+struct StagedPipelineConfig {
+  uint64_t frames = 120;
+  size_t ring_depth = 4; // frames queued between two stages
+};
+
+// Three stage threads, feed -> secure copy -> present, connected by
+// SpscRing<SecureBufferPool::Handle>. The feeder draws from src_pool; the
+// copy stage copies into a dst_pool buffer and recycles the source, or
+// forwards the source unchanged when there is no copy engine. Stages are
+// joined by buffer fences rather than waits where the backends allow it:
+// the copy is queued behind the destination's release fence and its
+// out-fence travels with the frame to the sink. Pools should
+// allow about 2 * ring_depth + 4 buffers so rings, not pool exhaustion,
+// provide the back-pressure.
+class StagedPipeline {
+public:
+  StagedPipeline(SecureBufferPool* src_pool, SecureBufferPool* dst_pool,
+                 IFrameSource* source, ICopyEngine* copy, IFrameSink* sink);
+
+  // Blocks until cfg.frames were presented, the source ran out of frames
+  // (stats().frames tells how many were shown) or a stage failed. Returns 0 or
+  // the first stage error (negative errno).
+  int run(const StagedPipelineConfig& cfg);
+  const StagedPipelineStats& stats() const { return stats_; }
+
+private:
+  SecureBufferPool* src_pool_;
+  SecureBufferPool* dst_pool_;
+  IFrameSource* source_;
+  ICopyEngine* copy_;
+  IFrameSink* sink_;
+  StagedPipelineStats stats_;
+};
@@ -0,0 +1,106 @@
+#include "startup_graph.h"
+#include "../common/log.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <time.h>
+
+uint64_t StartupGraph::now_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+StartupGraph::Step StartupGraph::add(const std::string& name, StepFn fn,
+                                     std::initializer_list<Step> deps) {
+  Node n;
+  n.name = name;
+  n.fn = std::move(fn);
+  for (Step d : deps) {
+    if (d >= nodes_.size()) {
+      LOGE("startup: %s depends on an unknown step", name.c_str());
+      continue;
+    }
+    n.deps.push_back(d);
+  }
+  nodes_.push_back(std::move(n));
+  return nodes_.size() - 1;
+}
+
+int StartupGraph::run() {
+  std::mutex m;
+  std::condition_variable cv;
+  std::vector<std::thread> threads;
+  size_t remaining = nodes_.size();
+  run_start_ns_ = now_ns();
+
+  std::unique_lock<std::mutex> lk(m);
+  for (;;) {
+    // Dependencies point backwards, so one pass in order settles every
+    // step that can be decided now.
+    for (Node& n : nodes_) {
+      if (n.state != State::kPending) continue;
+      bool ready = true;
+      const Node* failed = nullptr;
+      for (Step d : n.deps) {
+        State s = nodes_[d].state;
+        if (s == State::kFailed || s == State::kSkipped) failed = &nodes_[d];
+        else if (s != State::kDone) ready = false;
+      }
+      if (failed) {
+        LOGW("startup: %s skipped (%s did not complete)", n.name.c_str(), failed->name.c_str());
+        n.state = State::kSkipped;
+        remaining--;
+      } else if (ready) {
+        n.state = State::kRunning;
+        n.start_ns = now_ns();
+        threads.emplace_back([&, node = &n] {
+          int rc = node->fn();
+          std::lock_guard<std::mutex> g(m);
+          node->end_ns = now_ns();
+          node->rc = rc;
+          node->state = rc == 0 ? State::kDone : State::kFailed;
+          remaining--;
+          cv.notify_one();
+        });
+      }
+    }
+    if (remaining == 0) break;
+    cv.wait(lk);
+  }
+  lk.unlock();
+  for (std::thread& t : threads) t.join();
+  run_end_ns_ = now_ns();
+
+  for (const Node& n : nodes_) {
+    if (n.state == State::kFailed) return n.rc;
+  }
+  return 0;
+}
+
+void StartupGraph::print_breakdown(uint64_t first_frame_ns) const {
+  auto ms = [this](uint64_t t) { return t ? (double)(t - run_start_ns_) / 1e6 : 0.0; };
+  uint64_t serial_ns = 0;
+
+  LOGI("startup breakdown (ms from start):");
+  LOGI("  %-16s %8s %8s %8s  %s", "step", "start", "end", "took", "status");
+  for (const Node& n : nodes_) {
+    const char* status = "ok";
+    if (n.state == State::kFailed) status = "FAILED";
+    else if (n.state == State::kSkipped) status = "skipped";
+    if (n.state == State::kSkipped) {
+      LOGI("  %-16s %8s %8s %8s  %s", n.name.c_str(), "-", "-", "-", status);
+      continue;
+    }
+    serial_ns += n.end_ns - n.start_ns;
+    LOGI("  %-16s %8.1f %8.1f %8.1f  %s%s", n.name.c_str(), ms(n.start_ns), ms(n.end_ns),
+         (double)(n.end_ns - n.start_ns) / 1e6, status,
+         n.state == State::kFailed ? (" rc=" + std::to_string(n.rc)).c_str() : "");
+  }
+  LOGI("  init %.1f ms wall, %.1f ms summed over steps", ms(run_end_ns_), (double)serial_ns / 1e6);
+  if (first_frame_ns > run_end_ns_) {
+    LOGI("  first frame %.1f ms after init, time to first frame %.1f ms",
+         (double)(first_frame_ns - run_end_ns_) / 1e6, ms(first_frame_ns));
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Cold-start steps with dependencies. run() starts every step whose
+// dependencies have finished on its own thread, so independent steps (TEE
+// session, EGL/GBM bring-up, secure allocations...) overlap; steps that
+// depend on a failed step are skipped. Each step records when it started and
+// finished for the time-to-first-frame breakdown.
+class StartupGraph {
+public:
+  using Step = size_t;
+  // Returns 0, or a non-zero error code that run() passes on.
+  using StepFn = std::function<int()>;
+
+  // Dependencies must be steps added earlier.
+  Step add(const std::string& name, StepFn fn, std::initializer_list<Step> deps = {});
+
+  // Blocks until every step finished or was skipped. Returns 0, or the code
+  // of the first failed step in add() order (the step a serial run would
+  // have stopped at).
+  int run();
+
+  // Per-step start/duration relative to run(); first_frame_ns (CLOCK_MONOTONIC,
+  // 0 if none) closes the breakdown with the time to first frame.
+  void print_breakdown(uint64_t first_frame_ns = 0) const;
+
+  static uint64_t now_ns();
+
+private:
+  enum class State { kPending, kRunning, kDone, kFailed, kSkipped };
+
+  struct Node {
+    std::string name;
+    StepFn fn;
+    std::vector<Step> deps;
+    State state = State::kPending;
+    int rc = 0;
+    uint64_t start_ns = 0;
+    uint64_t end_ns = 0;
+  };
+
+  std::vector<Node> nodes_;
+  uint64_t run_start_ns_ = 0;
+  uint64_t run_end_ns_ = 0;
+};
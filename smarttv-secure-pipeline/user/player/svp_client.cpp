@@ -0,0 +1,140 @@
+#include "svp_client.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/ioctl.h>
+
+extern "C" {
+#include "../../kernel/secure_video/svp_uapi.h"
+}
+
+// Requests without a heap are sent at the size they had before heap_name,
+// so they still work with modules that report layouts but predate
+// per-request heaps. Older modules are handled by fits_v1() below.
+static uint32_t req_size(const BufferDesc& d) {
+  return d.heap.empty() ? SVP_ALLOC_REQ_SIZE_V2 : (uint32_t)sizeof(svp_alloc_req);
+}
+
+// Modules from before the batch ioctl only know the original 24-byte
+// request, which carries no alignment, heap or layout.
+static bool fits_v1(const BufferDesc& d) {
+  return d.heap.empty() && d.pitch_align == 0 && d.height_align == 0;
+}
+
+static int alloc_ioctl(int svp_fd, svp_alloc_req* a, uint32_t size) {
+  unsigned long cmd = _IOC(_IOC_READ | _IOC_WRITE, SVP_IOC_MAGIC, _IOC_NR(SVP_IOC_ALLOC_BUF), size);
+  return ::ioctl(svp_fd, cmd, a) == 0 ? 0 : -errno;
+}
+
+static svp_alloc_req to_req(const BufferDesc& d) {
+  svp_alloc_req a{};
+  a.width = d.width;
+  a.height = d.height;
+  a.fourcc = d.fourcc;
+  a.flags = d.flags;
+  a.out_dmabuf_fd = -1;
+  a.pitch_align = d.pitch_align;
+  a.height_align = d.height_align;
+  a.session = d.session;
+  std::memcpy(a.heap_name, d.heap.data(), d.heap.size()); // length checked by callers
+  return a;
+}
+
+int svp_alloc(int svp_fd, const BufferDesc& d, UniqueFd* out, BufferLayout* layout) {
+  if (d.heap.size() >= SVP_HEAP_NAME_LEN) return -EINVAL;
+  svp_alloc_req a = to_req(d);
+  int rc = alloc_ioctl(svp_fd, &a, req_size(d));
+  if (rc == -ENOTTY && fits_v1(d)) {
+    a = to_req(d);
+    rc = alloc_ioctl(svp_fd, &a, SVP_ALLOC_REQ_SIZE_V1);
+    if (rc == 0) a.out_layout = svp_layout{}; // not reported by the module
+  }
+  if (rc != 0) return rc;
+  out->reset(a.out_dmabuf_fd);
+  if (layout) *layout = a.out_layout;
+  return 0;
+}
+
+int svp_release(int svp_fd, uint32_t session, int dmabuf_fd) {
+  svp_release_req r{};
+  r.session = session;
+  r.dmabuf_fd = dmabuf_fd;
+  return ::ioctl(svp_fd, SVP_IOC_RELEASE_BUF, &r) == 0 ? 0 : -errno;
+}
+
+// Buffers stay pinned by the driver until released, not just until closed.
+static void release_all(int svp_fd, uint32_t session, const std::vector<UniqueFd>& fds) {
+  for (const UniqueFd& fd : fds) svp_release(svp_fd, session, fd.get());
+}
+
+int svp_alloc_batch(int svp_fd, const BufferDesc& d, size_t count, std::vector<UniqueFd>* out,
+                    BufferLayout* layout) {
+  if (d.heap.size() >= SVP_HEAP_NAME_LEN) return -EINVAL;
+  std::vector<UniqueFd> fds;
+  fds.reserve(count);
+
+  svp_alloc_req reqs[SVP_MAX_BATCH];
+  bool batch_supported = true;
+
+  while (fds.size() < count) {
+    size_t n = count - fds.size();
+    if (n > SVP_MAX_BATCH) n = SVP_MAX_BATCH;
+
+    if (batch_supported) {
+      for (size_t i = 0; i < n; ++i) reqs[i] = to_req(d);
+      svp_alloc_batch_req b{};
+      b.count = (__u32)n;
+      b.entry_size = req_size(d);
+      b.reqs_ptr = (__u64)(uintptr_t)reqs;
+      if (::ioctl(svp_fd, SVP_IOC_ALLOC_BUF_BATCH, &b) == 0) {
+        for (size_t i = 0; i < n; ++i) fds.emplace_back(reqs[i].out_dmabuf_fd);
+        if (layout) *layout = reqs[0].out_layout;
+        continue;
+      }
+      if (errno != ENOTTY) {
+        int rc = -errno;
+        release_all(svp_fd, d.session, fds);
+        return rc;
+      }
+      batch_supported = false;
+    }
+
+    UniqueFd fd;
+    int rc = svp_alloc(svp_fd, d, &fd, layout);
+    if (rc != 0) {
+      release_all(svp_fd, d.session, fds);
+      return rc;
+    }
+    fds.push_back(std::move(fd));
+  }
+
+  *out = std::move(fds);
+  return 0;
+}
+
+int svp_get_stats(int svp_fd, svp_stats* out, std::vector<svp_session_stats>* sessions) {
+  std::vector<svp_session_stats> ss(sessions ? 8 : 0);
+  for (;;) {
+    svp_stats_req r{};
+    r.sessions_ptr = (__u64)(uintptr_t)ss.data();
+    r.max_sessions = (__u32)ss.size();
+    if (::ioctl(svp_fd, SVP_IOC_GET_STATS, &r) != 0) return -errno;
+    *out = r.stats;
+    if (!sessions) return 0;
+    // Sessions may be opened concurrently: retry until the buffer was large enough.
+    if (r.num_sessions <= ss.size() || ss.size() >= SVP_STATS_MAX_SESSIONS) {
+      ss.resize(std::min<size_t>(r.num_sessions, ss.size()));
+      *sessions = std::move(ss);
+      return 0;
+    }
+    ss.resize(std::min<size_t>(r.num_sessions, SVP_STATS_MAX_SESSIONS));
+  }
+}
+
+int svp_get_heap_stats(int svp_fd, std::vector<svp_heap_stats>* out) {
+  svp_heap_stats_req r{};
+  if (::ioctl(svp_fd, SVP_IOC_GET_HEAP_STATS, &r) != 0) return -errno;
+  out->assign(r.heaps, r.heaps + std::min<uint32_t>(r.num_heaps, SVP_STATS_MAX_HEAPS));
+  return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "buffer_allocator.h"
+#include "../common/fd.h"
+
+// Thin wrappers over the /dev/svp0 allocation ioctls.
+// Return 0 on success or a negative errno.
+
+struct svp_heap_stats;
+struct svp_stats;
+struct svp_session_stats;
+
+// Allocates in d.session from d.heap, or from the module's svp_heap_name
+// heap if empty.
+// Fills *layout (if non-null) with the layout the driver allocated.
+// Modules that predate the batch ioctl take only requests without a heap or
+// alignment and report no layout: *layout is then zeroed (num_planes 0).
+int svp_alloc(int svp_fd, const BufferDesc& d, UniqueFd* out, BufferLayout* layout = nullptr);
+
+// Drops the driver's reference on a buffer allocated in `session` (as in
+// BufferDesc::session) before its fd is closed, so the secure memory is
+// freed with the last fd instead of at session close.
+int svp_release(int svp_fd, uint32_t session, int dmabuf_fd);
+
+// Allocates `count` identical buffers with SVP_IOC_ALLOC_BUF_BATCH, chunked
+// by SVP_MAX_BATCH. Falls back to looped svp_alloc() on modules that
+// predate the batch ioctl, with its limits. All-or-nothing: on failure `out` is left empty.
+// Every buffer shares one layout, returned in *layout if non-null.
+int svp_alloc_batch(int svp_fd, const BufferDesc& d, size_t count, std::vector<UniqueFd>* out,
+                    BufferLayout* layout = nullptr);
+
+// Module-wide allocation counters (SVP_IOC_GET_STATS). With `sessions`, also
+// the held-buffer counters of every session opened on svp_fd.
+int svp_get_stats(int svp_fd, svp_stats* out, std::vector<svp_session_stats>* sessions = nullptr);
+
+// Per-heap allocation counters (SVP_IOC_GET_HEAP_STATS), one entry per heap
+// the module has allocated from. -ENOTTY on modules without per-heap stats.
+int svp_get_heap_stats(int svp_fd, std::vector<svp_heap_stats>* out);
@@ -0,0 +1,43 @@
+#include "udmabuf.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+#include <linux/udmabuf.h>
+
+static const char* kUdmabufDev = "/dev/udmabuf";
+
+bool udmabuf_available() {
+  return ::access(kUdmabufDev, R_OK | W_OK) == 0;
+}
+
+int udmabuf_alloc(size_t size, UdmaBuffer* out) {
+  size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+  size = (size + page - 1) & ~(page - 1);
+  if (size == 0) return -EINVAL;
+
+  UniqueFd dev(::open(kUdmabufDev, O_RDWR | O_CLOEXEC));
+  if (!dev) return -errno;
+
+  UniqueFd memfd(::memfd_create("udmabuf", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+  if (!memfd) return -errno;
+  if (::ftruncate(memfd.get(), (off_t)size) != 0) return -errno;
+  // udmabuf requires the backing memfd to be unable to shrink.
+  if (::fcntl(memfd.get(), F_ADD_SEALS, F_SEAL_SHRINK) != 0) return -errno;
+
+  struct udmabuf_create req{};
+  req.memfd = (__u32)memfd.get();
+  req.flags = UDMABUF_FLAGS_CLOEXEC;
+  req.offset = 0;
+  req.size = size;
+  int fd = ::ioctl(dev.get(), UDMABUF_CREATE, &req);
+  if (fd < 0) return -errno;
+
+  out->dmabuf.reset(fd);
+  out->memfd = std::move(memfd);
+  out->size = size;
+  return 0;
+}
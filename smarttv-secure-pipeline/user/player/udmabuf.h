@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include "../common/fd.h"
+
+// Real dma-buf backed by ordinary pages, via /dev/udmabuf (CONFIG_UDMABUF).
+// Lets the DMA-engine, EGL and KMS import paths be exercised on hosts
+// without a secure heap. The memfd stays CPU-mappable for filling/checking.
+struct UdmaBuffer {
+  UniqueFd dmabuf;
+  UniqueFd memfd;
+  size_t size = 0;
+};
+
+bool udmabuf_available();
+
+// size is rounded up to the page size. Returns 0 or a negative errno.
+int udmabuf_alloc(size_t size, UdmaBuffer* out);
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sys/stat.h>
+
+// Identity of a dma-buf independent of the fd number: every fd for the same
+// buffer (dup'ed, passed between processes) shares one inode.
+struct DmabufKey {
+  uint64_t dev = 0;
+  uint64_t ino = 0;
+  bool operator==(const DmabufKey& o) const { return dev == o.dev && ino == o.ino; }
+};
+
+struct DmabufKeyHash {
+  size_t operator()(const DmabufKey& k) const {
+    return std::hash<uint64_t>()(k.ino * 0x9E3779B97F4A7C15ull ^ k.dev);
+  }
+};
+
+inline bool dmabuf_key(int fd, DmabufKey* out) {
+  struct stat st;
+  if (::fstat(fd, &st) != 0) return false;
+  out->dev = (uint64_t)st.st_dev;
+  out->ino = (uint64_t)st.st_ino;
+  return true;
+}
@@ -0,0 +1,90 @@
+#include "frame_timing.h"
+#include "../common/log.h"
+
+#include <algorithm>
+#include <cstdio>
+
+void LatencyHistogram::add(uint64_t ns) {
+  size_t b = (size_t)std::min<uint64_t>(ns / kBucketNs, kBuckets);
+  buckets_[b]++;
+  count_++;
+  max_ns_ = std::max(max_ns_, ns);
+}
+
+uint64_t LatencyHistogram::percentile_ns(double p) const {
+  if (count_ == 0) return 0;
+  if (p >= 100.0) return max_ns_;
+  uint64_t rank = (uint64_t)(p / 100.0 * (double)count_ + 0.5);
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (size_t b = 0; b <= kBuckets; ++b) {
+    seen += buckets_[b];
+    if (seen >= rank) return std::min(max_ns_, (uint64_t)(b + 1) * kBucketNs);
+  }
+  return max_ns_;
+}
+
+void FrameTiming::add(const FrameRecord& r) {
+  if (trace_.size() < trace_cap_) trace_.push_back(r);
+
+  if (r.dropped) {
+    dropped_++;
+    return;
+  }
+  frames_++;
+
+  if (r.submit_ns && r.flip_ns >= r.submit_ns) submit_to_flip_.add(r.flip_ns - r.submit_ns);
+  if (r.submit_ns && r.gpu_done_ns >= r.submit_ns) submit_to_gpu_.add(r.gpu_done_ns - r.submit_ns);
+
+  if (r.vblank && last_vblank_ && r.vblank > last_vblank_) {
+    uint32_t gap = r.vblank - last_vblank_ - 1;
+    if (gap) {
+      if (r.submit_ns <= last_flip_ns_) missed_ += gap;
+      else repeated_ += gap;
+    }
+  }
+  if (r.flip_ns && last_flip_ns_ && r.flip_ns > last_flip_ns_)
+    flip_interval_.add(r.flip_ns - last_flip_ns_);
+
+  last_vblank_ = r.vblank;
+  if (r.flip_ns) last_flip_ns_ = r.flip_ns;
+}
+
+void FrameTiming::enable_trace(size_t max_frames) {
+  trace_.clear();
+  trace_.reserve(max_frames);
+  trace_cap_ = max_frames;
+}
+
+bool FrameTiming::write_csv(const std::string& path) const {
+  FILE* f = std::fopen(path.c_str(), "w");
+  if (!f) {
+    LOGE("cannot write %s", path.c_str());
+    return false;
+  }
+  std::fprintf(f, "frame,vblank,submit_ns,gpu_done_ns,flip_ns,submit_to_flip_us,dropped\n");
+  for (const FrameRecord& r : trace_) {
+    double lat = (r.flip_ns && r.submit_ns) ? (double)(r.flip_ns - r.submit_ns) / 1e3 : 0.0;
+    std::fprintf(f, "%llu,%u,%llu,%llu,%llu,%.1f,%d\n",
+                 (unsigned long long)r.frame, r.vblank, (unsigned long long)r.submit_ns,
+                 (unsigned long long)r.gpu_done_ns, (unsigned long long)r.flip_ns, lat,
+                 r.dropped ? 1 : 0);
+  }
+  return std::fclose(f) == 0;
+}
+
+static void print_hist(const char* label, const LatencyHistogram& h) {
+  if (h.count() == 0) return;
+  LOGI("%-16s n=%llu p50=%.2fms p95=%.2fms p99=%.2fms max=%.2fms", label,
+       (unsigned long long)h.count(), h.percentile_ns(50) / 1e6, h.percentile_ns(95) / 1e6,
+       h.percentile_ns(99) / 1e6, h.max_ns() / 1e6);
+}
+
+void FrameTiming::print_summary() const {
+  LOGI("frames=%llu dropped=%llu missed_vblanks=%llu repeated_vblanks=%llu",
+       (unsigned long long)frames_, (unsigned long long)dropped_,
+       (unsigned long long)missed_, (unsigned long long)repeated_);
+  print_hist("submit->flip", submit_to_flip_);
+  print_hist("submit->gpu", submit_to_gpu_);
+  print_hist("flip interval", flip_interval_);
+}
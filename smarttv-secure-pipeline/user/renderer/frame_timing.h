@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Fixed-bucket latency histogram: 50 us buckets up to 200 ms plus an
+// overflow bucket. add() never allocates.
+class LatencyHistogram {
+public:
+  static constexpr uint64_t kBucketNs = 50000;
+  static constexpr size_t kBuckets = 4000;
+
+  void add(uint64_t ns);
+  uint64_t count() const { return count_; }
+  uint64_t max_ns() const { return max_ns_; }
+  // Upper edge of the bucket holding the p-th percentile (exact max for 100).
+  uint64_t percentile_ns(double p) const;
+
+private:
+  std::array<uint32_t, kBuckets + 1> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t max_ns_ = 0;
+};
+
+// One presented (or dropped) frame. Times are CLOCK_MONOTONIC ns, 0 if unknown.
+struct FrameRecord {
+  uint64_t frame = 0;
+  uint32_t vblank = 0;       // page-flip event sequence, 0 if none
+  uint64_t submit_ns = 0;    // handed to KMS / swapped
+  uint64_t gpu_done_ns = 0;  // EGL fence signalled (GL path only)
+  uint64_t flip_ns = 0;      // page-flip event tv_sec/tv_usec
+  bool dropped = false;      // replaced before reaching the screen
+};
+
+// Aggregates frame records from GbmKmsRenderer into histograms and jank
+// counters. Vblanks between two flips are "missed" when the later frame was
+// already submitted at the earlier flip (display path too slow) and
+// "repeated" when it was not (producer too slow).
+class FrameTiming {
+public:
+  void add(const FrameRecord& r);
+
+  // Keeps up to max_frames records for write_csv(); storage is reserved here.
+  void enable_trace(size_t max_frames);
+  bool write_csv(const std::string& path) const;
+
+  void print_summary() const;
+
+  const LatencyHistogram& submit_to_flip() const { return submit_to_flip_; }
+  const LatencyHistogram& submit_to_gpu_done() const { return submit_to_gpu_; }
+  const LatencyHistogram& flip_interval() const { return flip_interval_; }
+  uint64_t frames() const { return frames_; }
+  uint64_t dropped() const { return dropped_; }
+  uint64_t missed_vblanks() const { return missed_; }
+  uint64_t repeated_vblanks() const { return repeated_; }
+
+private:
+  LatencyHistogram submit_to_flip_;
+  LatencyHistogram submit_to_gpu_;
+  LatencyHistogram flip_interval_;
+  uint64_t frames_ = 0;
+  uint64_t dropped_ = 0;
+  uint64_t missed_ = 0;
+  uint64_t repeated_ = 0;
+  uint32_t last_vblank_ = 0;
+  uint64_t last_flip_ns_ = 0;
+
+  std::vector<FrameRecord> trace_;
+  size_t trace_cap_ = 0;
+};
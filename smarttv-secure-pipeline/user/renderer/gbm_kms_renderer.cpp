@@ -1,19 +1,53 @@
 #include "gbm_kms_renderer.h"
 #include "../common/log.h"
 #include "../common/fd.h"
+#include "../common/sync_file.h"
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
+#include <linux/sync_file.h>
 #include <cstring>
+#include <algorithm>
+#include <cerrno>
 #include <stdexcept>
+#include <vector>
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <gbm.h>
 
+#include <drm_fourcc.h>
+
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+// Per cache (EGLImages, KMS FBs): entries beyond this are evicted
+// least-recently-used first.
+static constexpr size_t kMaxImports = 32;
+
+static uint64_t monotonic_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Signal time of a signalled sync_file, 0 if pending or unknown.
+static uint64_t sync_file_signal_ns(int fd) {
+  sync_fence_info fences[4] = {};
+  sync_file_info info{};
+  info.num_fences = 4;
+  info.sync_fence_info = (uint64_t)(uintptr_t)fences;
+  if (::ioctl(fd, SYNC_IOC_FILE_INFO, &info) != 0 || info.status != 1) return 0;
+  uint64_t t = 0;
+  for (uint32_t i = 0; i < info.num_fences && i < 4; ++i)
+    t = std::max<uint64_t>(t, fences[i].timestamp_ns);
+  return t;
+}
 
 static drmModeConnector* find_connected_connector(int fd, drmModeRes* res, uint32_t* out_conn_id) {
   for (int i = 0; i < res->count_connectors; ++i) {
@@ -68,6 +102,9 @@ bool GbmKmsRenderer::init(const std::string& card_path) {
 
   uint32_t crtc_id = find_crtc_for_connector(drm_fd_, res, conn);
   drmModeFreeConnector(conn);
+  for (int i = 0; i < res->count_crtcs; ++i) {
+    if (res->crtcs[i] == crtc_id) crtc_index_ = (unsigned int)i;
+  }
   drmModeFreeResources(res);
 
   if (!crtc_id) {
@@ -75,6 +112,12 @@ bool GbmKmsRenderer::init(const std::string& card_path) {
     return false;
   }
 
+  mode_ = new drmModeModeInfo(mode);
+
+  // MODE_ID for atomic plane scanout; harmless if that mode is never used.
+  if (drmModeCreatePropertyBlob(drm_fd_, &mode, sizeof(mode), &mode_blob_id_) != 0)
+    mode_blob_id_ = 0;
+
   conn_id_ = conn_id;
   crtc_id_ = crtc_id;
 
@@ -162,31 +205,1013 @@ bool GbmKmsRenderer::init(const std::string& card_path) {
   return true;
 }
 
-bool GbmKmsRenderer::render_test_pattern(int frames) {
-  if (!egl_display_ || !egl_surface_ || !egl_context_) return false;
+bool GbmKmsRenderer::init_headless(unsigned int width, unsigned int height) {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (!eglGetPlatformDisplayEXT) {
+    LOGE("eglGetPlatformDisplayEXT not available");
+    return false;
+  }
+
+  EGLDisplay dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, nullptr, nullptr)) {
+    LOGE("EGL surfaceless display unavailable (need EGL_MESA_platform_surfaceless)");
+    return false;
+  }
+  egl_display_ = (void*)dpy;
+
+  static const EGLint cfg_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_DONT_CARE,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+    EGL_NONE
+  };
+
+  EGLConfig cfg;
+  EGLint ncfg = 0;
+  if (!eglChooseConfig(dpy, cfg_attribs, &cfg, 1, &ncfg) || ncfg < 1) {
+    LOGE("eglChooseConfig failed");
+    return false;
+  }
+
+  static const EGLint ctx_attribs[] = {
+    EGL_CONTEXT_CLIENT_VERSION, 2,
+    EGL_NONE
+  };
+
+  eglBindAPI(EGL_OPENGL_ES_API);
+  EGLContext ctx = eglCreateContext(dpy, cfg, EGL_NO_CONTEXT, ctx_attribs);
+  if (ctx == EGL_NO_CONTEXT) {
+    LOGE("eglCreateContext failed");
+    return false;
+  }
+  egl_context_ = (void*)ctx;
+
+  if (!eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+    LOGE("eglMakeCurrent without surface failed (need EGL_KHR_surfaceless_context)");
+    return false;
+  }
+
+  width_ = width;
+  height_ = height;
+
+  GLuint tex = 0, fbo = 0;
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei)width, (GLsizei)height, 0,
+               GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+  offscreen_tex_ = tex;
+  offscreen_fbo_ = fbo;
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    LOGE("offscreen framebuffer incomplete");
+    return false;
+  }
+
+  headless_ = true;
+  LOGI("Renderer initialized headless: %ux%u (%s)", width_, height_,
+       (const char*)glGetString(GL_RENDERER));
+  return true;
+}
+
+bool GbmKmsRenderer::present() {
+  if (headless_) {
+    glFlush();
+    return true;
+  }
+  if (!eglSwapBuffers((EGLDisplay)egl_display_, (EGLSurface)egl_surface_)) {
+    LOGE("eglSwapBuffers failed");
+    return false;
+  }
+  return present_kms();
+}
+
+static void destroy_bo_fb(gbm_bo* bo, void* data) {
+  uint32_t fb = (uint32_t)(uintptr_t)data;
+  int fd = gbm_device_get_fd(gbm_bo_get_device(bo));
+  if (fb) drmModeRmFB(fd, fb);
+}
+
+// The FB of a surface BO lives as long as the BO (GBM recycles them).
+static uint32_t bo_fb(int drm_fd, gbm_bo* bo) {
+  uint32_t fb = (uint32_t)(uintptr_t)gbm_bo_get_user_data(bo);
+  if (fb) return fb;
+
+  uint32_t handles[4] = { gbm_bo_get_handle(bo).u32, 0, 0, 0 };
+  uint32_t pitches[4] = { gbm_bo_get_stride(bo), 0, 0, 0 };
+  uint32_t offsets[4] = { 0, 0, 0, 0 };
+  if (drmModeAddFB2(drm_fd, gbm_bo_get_width(bo), gbm_bo_get_height(bo), gbm_bo_get_format(bo),
+                    handles, pitches, offsets, &fb, 0) != 0) {
+    LOGE("drmModeAddFB2 for GBM BO failed: %s", strerror(errno));
+    return 0;
+  }
+  gbm_bo_set_user_data(bo, (void*)(uintptr_t)fb, destroy_bo_fb);
+  return fb;
+}
+
+bool GbmKmsRenderer::flip_to(void* bo) {
+  uint32_t fb = bo_fb(drm_fd_, (gbm_bo*)bo);
+  if (!fb) return false;
+
+  if (!crtc_set_) {
+    // First frame: modeset synchronously, later frames flip.
+    if (drmModeSetCrtc(drm_fd_, crtc_id_, fb, 0, 0, &conn_id_, 1, (drmModeModeInfo*)mode_) != 0) {
+      LOGE("drmModeSetCrtc failed: %s", strerror(errno));
+      return false;
+    }
+    crtc_set_ = true;
+    scan_bo_ = bo;
+    timing_complete(0, monotonic_ns()); // no flip event for a modeset
+    return true;
+  }
+
+  if (drmModePageFlip(drm_fd_, crtc_id_, fb, DRM_MODE_PAGE_FLIP_EVENT, this) != 0) {
+    LOGE_EVERY_MS(1000, "drmModePageFlip failed: %s", strerror(errno));
+    return false;
+  }
+  flip_bo_ = bo;
+  return true;
+}
+
+void GbmKmsRenderer::timing_submit(uint64_t submit_ns, bool gpu_fence) {
+  if (inflight_count_ == inflight_.size()) { // cannot happen with <= 3 BOs in flight
+    timing_release(inflight_[inflight_head_]);
+    inflight_head_ = (inflight_head_ + 1) % inflight_.size();
+    inflight_count_--;
+  }
+  InFlightFrame& f = inflight_[(inflight_head_ + inflight_count_) % inflight_.size()];
+  f = InFlightFrame{};
+  f.rec.frame = frame_counter_++;
+  f.rec.submit_ns = submit_ns;
+  inflight_count_++;
+  if (!gpu_fence) return;
 
   EGLDisplay dpy = (EGLDisplay)egl_display_;
-  EGLSurface surf = (EGLSurface)egl_surface_;
+  static PFNEGLCREATESYNCKHRPROC create_sync =
+      (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+  static PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_fence_fd =
+      (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)eglGetProcAddress("eglDupNativeFenceFDANDROID");
+  if (!create_sync) return;
+
+  if (native_fence_sync()) {
+    f.sync = (void*)create_sync(dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+    glFlush(); // the fd exists only once the fence is flushed
+    if (f.sync) f.sync_fd = dup_fence_fd(dpy, (EGLSyncKHR)f.sync);
+  } else {
+    f.sync = (void*)create_sync(dpy, EGL_SYNC_FENCE_KHR, nullptr);
+  }
+}
+
+bool GbmKmsRenderer::native_fence_sync() {
+  if (native_fence_ < 0) {
+    static PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_fence_fd =
+        (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)eglGetProcAddress("eglDupNativeFenceFDANDROID");
+    static PFNEGLWAITSYNCKHRPROC gpu_wait = (PFNEGLWAITSYNCKHRPROC)eglGetProcAddress("eglWaitSyncKHR");
+    const char* ext = eglQueryString((EGLDisplay)egl_display_, EGL_EXTENSIONS);
+    native_fence_ = (dup_fence_fd && ext && std::strstr(ext, "EGL_ANDROID_native_fence_sync")) ? 1 : 0;
+    wait_sync_ = native_fence_ && gpu_wait && std::strstr(ext, "EGL_KHR_wait_sync");
+  }
+  return native_fence_ == 1;
+}
+
+UniqueFd GbmKmsRenderer::gl_fence() {
+  static PFNEGLCREATESYNCKHRPROC create_sync =
+      (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+  static PFNEGLDESTROYSYNCKHRPROC destroy_sync =
+      (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+  static PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_fence_fd =
+      (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)eglGetProcAddress("eglDupNativeFenceFDANDROID");
+  if (!create_sync || !destroy_sync || !native_fence_sync()) return UniqueFd();
+
+  EGLDisplay dpy = (EGLDisplay)egl_display_;
+  EGLSyncKHR sync = create_sync(dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+  if (sync == EGL_NO_SYNC_KHR) return UniqueFd();
+  glFlush(); // the fd exists only once the fence is flushed
+  int fd = dup_fence_fd(dpy, sync);
+  destroy_sync(dpy, sync); // the sync_file outlives the EGLSync
+  return UniqueFd(fd >= 0 ? fd : -1);
+}
+
+// Queues a GPU-side wait for a sync_file before the commands that follow.
+bool GbmKmsRenderer::gl_wait_fence(int fence) {
+  static PFNEGLCREATESYNCKHRPROC create_sync =
+      (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+  static PFNEGLDESTROYSYNCKHRPROC destroy_sync =
+      (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+  static PFNEGLWAITSYNCKHRPROC gpu_wait = (PFNEGLWAITSYNCKHRPROC)eglGetProcAddress("eglWaitSyncKHR");
+  if (!create_sync || !destroy_sync || !native_fence_sync() || !wait_sync_) return false;
+
+  // EGL takes ownership of the fd, but only if the sync is created.
+  UniqueFd dup = sync_file_dup(fence);
+  if (!dup) return false;
+  const EGLint attrs[] = { EGL_SYNC_NATIVE_FENCE_FD_ANDROID, dup.get(), EGL_NONE };
+  EGLDisplay dpy = (EGLDisplay)egl_display_;
+  EGLSyncKHR sync = create_sync(dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, attrs);
+  if (sync == EGL_NO_SYNC_KHR) return false;
+  (void)dup.release();
+  bool ok = gpu_wait(dpy, sync, 0) == EGL_TRUE;
+  destroy_sync(dpy, sync);
+  return ok;
+}
+
+bool GbmKmsRenderer::wait_in_fence(int fence) {
+  int rc = sync_file_wait(fence, 1000);
+  if (rc != 0) LOGW_EVERY_MS(1000, "frame fence not signalled: %d; presenting anyway", rc);
+  return !in_fence_failed(fence);
+}
+
+// The writer of the frame (e.g. an RDMA copy) signalled an error: its
+// contents are not a valid frame and must not reach the screen.
+bool GbmKmsRenderer::in_fence_failed(int fence) {
+  int status = sync_file_status(fence);
+  if (status >= 0) return false;
+  LOGE_EVERY_MS(1000, "frame fence signalled an error: %d; frame dropped", status);
+  return true;
+}
+
+// Bounded: buffers whose fence is never taken (a sink that holds frames
+// regardless) must not pile up fds.
+void GbmKmsRenderer::add_release_fence(int buf_fd, UniqueFd fence) {
+  for (auto it = releases_.begin(); it != releases_.end(); ++it) {
+    if (it->buf_fd != buf_fd) continue;
+    releases_.erase(it);
+    break;
+  }
+  if (releases_.size() >= 16) releases_.erase(releases_.begin());
+  releases_.push_back(ReleaseFence{buf_fd, std::move(fence)});
+}
+
+UniqueFd GbmKmsRenderer::take_release_fence(int fd) {
+  for (auto it = releases_.begin(); it != releases_.end(); ++it) {
+    if (it->buf_fd != fd) continue;
+    UniqueFd f = std::move(it->fence);
+    releases_.erase(it);
+    return f;
+  }
+  return UniqueFd();
+}
+
+void GbmKmsRenderer::timing_release(InFlightFrame& f) {
+  static PFNEGLDESTROYSYNCKHRPROC destroy_sync =
+      (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+  if (f.sync && destroy_sync) destroy_sync((EGLDisplay)egl_display_, (EGLSyncKHR)f.sync);
+  if (f.sync_fd >= 0) ::close(f.sync_fd);
+  f.sync = nullptr;
+  f.sync_fd = -1;
+}
+
+// Stamps fences without a native fd when they are first seen signalled.
+void GbmKmsRenderer::timing_poll_fences() {
+  static PFNEGLCLIENTWAITSYNCKHRPROC wait_sync =
+      (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+  if (!wait_sync) return;
+  uint64_t now = 0;
+  for (size_t i = 0; i < inflight_count_; ++i) {
+    InFlightFrame& f = inflight_[(inflight_head_ + i) % inflight_.size()];
+    if (!f.sync || f.sync_fd >= 0 || f.rec.gpu_done_ns) continue;
+    if (wait_sync((EGLDisplay)egl_display_, (EGLSyncKHR)f.sync, 0, 0) == EGL_CONDITION_SATISFIED_KHR) {
+      if (!now) now = monotonic_ns();
+      f.rec.gpu_done_ns = now;
+    }
+  }
+}
+
+void GbmKmsRenderer::timing_drop_newest() {
+  if (inflight_count_ == 0) return;
+  inflight_count_--;
+  InFlightFrame& f = inflight_[(inflight_head_ + inflight_count_) % inflight_.size()];
+  f.rec.dropped = true;
+  timing_.add(f.rec);
+  timing_release(f);
+}
+
+void GbmKmsRenderer::timing_complete(uint32_t vblank, uint64_t flip_ns) {
+  if (inflight_count_ == 0) return;
+  timing_poll_fences();
+  InFlightFrame& f = inflight_[inflight_head_];
+  inflight_head_ = (inflight_head_ + 1) % inflight_.size();
+  inflight_count_--;
+
+  f.rec.vblank = vblank;
+  f.rec.flip_ns = flip_ns;
+  if (f.sync_fd >= 0) f.rec.gpu_done_ns = sync_file_signal_ns(f.sync_fd);
+  timing_.add(f.rec);
+  timing_release(f);
+}
+
+bool GbmKmsRenderer::present_kms() {
+  uint64_t submit_ns = monotonic_ns();
+  gbm_surface* surf = (gbm_surface*)gbm_surf_;
+  gbm_bo* bo = gbm_surface_lock_front_buffer(surf);
+  if (!bo) {
+    LOGE_EVERY_MS(1000, "gbm_surface_lock_front_buffer failed");
+    return false;
+  }
+  present_stats_.frames++;
+
+  dispatch_events();
+
+  if (flip_bo_) {
+    if (queued_bo_) {
+      gbm_surface_release_buffer(surf, (gbm_bo*)queued_bo_);
+      present_stats_.dropped++;
+      timing_drop_newest();
+    }
+    queued_bo_ = bo;
+    timing_submit(submit_ns, true);
+    return true;
+  }
+
+  timing_submit(submit_ns, true);
+  if (!flip_to(bo)) {
+    timing_drop_newest();
+    gbm_surface_release_buffer(surf, bo);
+    return false;
+  }
+  return true;
+}
+
+void GbmKmsRenderer::on_gl_flip() {
+  gbm_surface* surf = (gbm_surface*)gbm_surf_;
+  present_stats_.flips++;
+  if (scan_bo_) gbm_surface_release_buffer(surf, (gbm_bo*)scan_bo_);
+  scan_bo_ = flip_bo_;
+  flip_bo_ = nullptr;
+
+  if (queued_bo_) {
+    void* next = queued_bo_;
+    queued_bo_ = nullptr;
+    if (!flip_to(next)) {
+      gbm_surface_release_buffer(surf, (gbm_bo*)next);
+      timing_drop_newest();
+    }
+  }
+}
+
+void GbmKmsRenderer::release_gl_bos() {
+  gbm_surface* surf = (gbm_surface*)gbm_surf_;
+  if (queued_bo_) gbm_surface_release_buffer(surf, (gbm_bo*)queued_bo_);
+  queued_bo_ = nullptr;
+  if (flip_bo_) (void)wait_event(100);
+  if (flip_bo_) gbm_surface_release_buffer(surf, (gbm_bo*)flip_bo_);
+  if (scan_bo_) gbm_surface_release_buffer(surf, (gbm_bo*)scan_bo_);
+  scan_bo_ = flip_bo_ = nullptr;
+  crtc_set_ = false;
+}
+
+void GbmKmsRenderer::dispatch_events() {
+  if (drm_fd_ < 0) return;
+  timing_poll_fences();
+  for (;;) {
+    pollfd pfd{drm_fd_, POLLIN, 0};
+    if (::poll(&pfd, 1, 0) <= 0) return;
+    if (!wait_event(0)) return;
+  }
+}
+
+void GbmKmsRenderer::finish() {
+  if (egl_context_) glFinish();
+}
+
+bool GbmKmsRenderer::render_test_pattern(int frames) {
+  if (!egl_display_ || !egl_context_ || (!egl_surface_ && !headless_)) return false;
 
   for (int i = 0; i < frames; ++i) {
+    // Keep every frame: wait on the display fd while one is still queued.
+    while (!headless_ && present_queue_full()) {
+      if (!wait_event(1000)) return false;
+    }
+
     float t = (float)i / (float)frames;
     glViewport(0, 0, (GLint)width_, (GLint)height_);
     glClearColor(t, 0.2f, 1.0f - t, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    if (!eglSwapBuffers(dpy, surf)) {
-      LOGE("eglSwapBuffers failed");
+    if (!present()) return false;
+  }
+  return true;
+}
+
+static int fourcc_plane_count(uint32_t fourcc) {
+  switch (fourcc) {
+  case DRM_FORMAT_ARGB8888:
+  case DRM_FORMAT_XRGB8888:
+    return 1;
+  case DRM_FORMAT_NV12:
+  case DRM_FORMAT_NV21:
+  case DRM_FORMAT_P010:
+    return 2;
+  case DRM_FORMAT_YUV420:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+static GLuint compile_shader(GLenum type, const char* src) {
+  GLuint sh = glCreateShader(type);
+  glShaderSource(sh, 1, &src, nullptr);
+  glCompileShader(sh);
+  GLint ok = 0;
+  glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    char log[512] = {0};
+    glGetShaderInfoLog(sh, sizeof(log), nullptr, log);
+    LOGE("shader compile failed: %s", log);
+    glDeleteShader(sh);
+    return 0;
+  }
+  return sh;
+}
+
+bool GbmKmsRenderer::ensure_external_program() {
+  if (ext_program_) return true;
+
+  static const char* vs_src =
+      "attribute vec2 a_pos;\n"
+      "attribute vec2 a_uv;\n"
+      "varying vec2 v_uv;\n"
+      "void main() { v_uv = a_uv; gl_Position = vec4(a_pos, 0.0, 1.0); }\n";
+  static const char* fs_src =
+      "#extension GL_OES_EGL_image_external : require\n"
+      "precision mediump float;\n"
+      "uniform samplerExternalOES u_tex;\n"
+      "varying vec2 v_uv;\n"
+      "void main() { gl_FragColor = texture2D(u_tex, v_uv); }\n";
+
+  GLuint vs = compile_shader(GL_VERTEX_SHADER, vs_src);
+  GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fs_src);
+  if (!vs || !fs) {
+    if (vs) glDeleteShader(vs);
+    if (fs) glDeleteShader(fs);
+    return false;
+  }
+
+  GLuint prog = glCreateProgram();
+  glAttachShader(prog, vs);
+  glAttachShader(prog, fs);
+  glLinkProgram(prog);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+
+  GLint ok = 0;
+  glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    LOGE("external-image program link failed");
+    glDeleteProgram(prog);
+    return false;
+  }
+
+  ext_program_ = prog;
+  ext_attr_pos_ = glGetAttribLocation(prog, "a_pos");
+  ext_attr_uv_ = glGetAttribLocation(prog, "a_uv");
+  glUseProgram(prog);
+  glUniform1i(glGetUniformLocation(prog, "u_tex"), 0);
+  return true;
+}
+
+bool GbmKmsRenderer::make_layout(uint32_t width, uint32_t height, uint32_t fourcc,
+                                 const uint32_t* strides, const uint32_t* offsets,
+                                 FrameLayout* out)
+{
+  int planes = fourcc_plane_count(fourcc);
+  if (planes == 0) return false;
+  *out = FrameLayout{};
+  out->width = width;
+  out->height = height;
+  out->fourcc = fourcc;
+  for (int p = 0; p < planes; ++p) {
+    out->strides[p] = strides[p];
+    out->offsets[p] = offsets[p];
+  }
+  return true;
+}
+
+GbmKmsRenderer::ImportedImage* GbmKmsRenderer::import_dmabuf(int fd, const FrameLayout& layout) {
+  DmabufKey key;
+  if (!dmabuf_key(fd, &key)) {
+    LOGE_EVERY_MS(1000, "render_dmabuf_frame: fstat(%d) failed", fd);
+    return nullptr;
+  }
+
+  auto it = imports_.find(key);
+  if (it != imports_.end()) {
+    ImportedImage& img = it->second;
+    if (img.layout == layout) {
+      import_stats_.hits++;
+      img.last_use = ++frame_seq_;
+      return &img;
+    }
+    destroy_import(img); // same buffer, new layout
+    imports_.erase(it);
+  }
+
+  if (imports_.size() >= kMaxImports) {
+    auto lru = imports_.begin();
+    for (auto i = imports_.begin(); i != imports_.end(); ++i)
+      if (i->second.last_use < lru->second.last_use) lru = i;
+    destroy_import(lru->second);
+    imports_.erase(lru);
+  }
+
+  static PFNEGLCREATEIMAGEKHRPROC create_image =
+      (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+  static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture =
+      (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+  if (!create_image || !image_target_texture) {
+    LOGE_EVERY_MS(1000, "EGL_KHR_image_base / GL_OES_EGL_image not available");
+    return nullptr;
+  }
+
+  static const EGLint plane_attr[3][3] = {
+    { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT },
+    { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT },
+    { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT },
+  };
+
+  EGLint attrs[32];
+  int n = 0;
+  attrs[n++] = EGL_WIDTH;                     attrs[n++] = (EGLint)layout.width;
+  attrs[n++] = EGL_HEIGHT;                    attrs[n++] = (EGLint)layout.height;
+  attrs[n++] = EGL_LINUX_DRM_FOURCC_EXT;      attrs[n++] = (EGLint)layout.fourcc;
+  int planes = fourcc_plane_count(layout.fourcc);
+  for (int p = 0; p < planes; ++p) {
+    attrs[n++] = plane_attr[p][0]; attrs[n++] = fd;
+    attrs[n++] = plane_attr[p][1]; attrs[n++] = (EGLint)layout.offsets[p];
+    attrs[n++] = plane_attr[p][2]; attrs[n++] = (EGLint)layout.strides[p];
+  }
+  if (planes > 1) {
+    attrs[n++] = EGL_YUV_COLOR_SPACE_HINT_EXT; attrs[n++] = EGL_ITU_REC709_EXT;
+    attrs[n++] = EGL_SAMPLE_RANGE_HINT_EXT;    attrs[n++] = EGL_YUV_NARROW_RANGE_EXT;
+  }
+  attrs[n++] = EGL_NONE;
+
+  EGLImageKHR image = create_image((EGLDisplay)egl_display_, EGL_NO_CONTEXT,
+                                   EGL_LINUX_DMA_BUF_EXT, nullptr, attrs);
+  if (image == EGL_NO_IMAGE_KHR) {
+    LOGE_EVERY_MS(1000, "eglCreateImageKHR(dma-buf fd=%d fourcc=0x%08x) failed: 0x%x", fd,
+                  layout.fourcc, eglGetError());
+    return nullptr;
+  }
+
+  GLuint tex = 0;
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, tex);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  image_target_texture(GL_TEXTURE_EXTERNAL_OES, (GLeglImageOES)image);
+
+  ImportedImage& img = imports_[key];
+  img.image = (void*)image;
+  img.tex = tex;
+  img.layout = layout;
+  img.last_use = ++frame_seq_;
+  import_stats_.imports++;
+  return &img;
+}
+
+void GbmKmsRenderer::destroy_import(ImportedImage& img) {
+  static PFNEGLDESTROYIMAGEKHRPROC destroy_image =
+      (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+  if (img.tex) glDeleteTextures(1, &img.tex);
+  if (img.image && destroy_image) destroy_image((EGLDisplay)egl_display_, (EGLImageKHR)img.image);
+  img.tex = 0;
+  img.image = nullptr;
+}
+
+void GbmKmsRenderer::forget_dmabuf(int fd) {
+  (void)take_release_fence(fd);
+  if (plane_buf_fd_ == fd) plane_buf_fd_ = -1;
+  DmabufKey key;
+  if (!dmabuf_key(fd, &key)) return;
+  auto it = imports_.find(key);
+  if (it != imports_.end()) {
+    destroy_import(it->second);
+    imports_.erase(it);
+  }
+  auto fit = fbs_.find(key);
+  if (fit != fbs_.end()) {
+    release_fb(fit->second, true);
+    fbs_.erase(fit);
+    fb_stats_.invalidations++;
+  }
+}
+
+bool GbmKmsRenderer::render_dmabuf_frame(int fd, uint32_t width, uint32_t height, uint32_t fourcc,
+                                         const uint32_t* strides, const uint32_t* offsets,
+                                         int in_fence)
+{
+  if (!egl_context_ || !ensure_external_program()) return false;
+  if (in_fence_failed(in_fence)) return false;
+
+  FrameLayout layout;
+  if (!make_layout(width, height, fourcc, strides, offsets, &layout)) {
+    LOGE_EVERY_MS(1000, "render_dmabuf_frame: unsupported fourcc 0x%08x", fourcc);
+    return false;
+  }
+  ImportedImage* img = import_dmabuf(fd, layout);
+  if (!img) return false;
+  if (in_fence >= 0 && !gl_wait_fence(in_fence) && !wait_in_fence(in_fence)) return false;
+
+  static const GLfloat pos[] = { -1.f, -1.f,  1.f, -1.f,  -1.f, 1.f,  1.f, 1.f };
+  static const GLfloat uv[]  = {  0.f,  1.f,  1.f,  1.f,   0.f, 0.f,  1.f, 0.f };
+
+  glViewport(0, 0, (GLint)width_, (GLint)height_);
+  glUseProgram(ext_program_);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, img->tex);
+  glVertexAttribPointer((GLuint)ext_attr_pos_, 2, GL_FLOAT, GL_FALSE, 0, pos);
+  glVertexAttribPointer((GLuint)ext_attr_uv_, 2, GL_FLOAT, GL_FALSE, 0, uv);
+  glEnableVertexAttribArray((GLuint)ext_attr_pos_);
+  glEnableVertexAttribArray((GLuint)ext_attr_uv_);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  // The texture is done with once this draw is: that is the buffer's release.
+  UniqueFd release = gl_fence();
+  if (release) add_release_fence(fd, std::move(release));
+  return present();
+}
+
+static uint32_t find_prop(int fd, uint32_t obj, uint32_t type, const char* name,
+                          uint64_t* value = nullptr) {
+  drmModeObjectProperties* props = drmModeObjectGetProperties(fd, obj, type);
+  if (!props) return 0;
+  uint32_t id = 0;
+  for (uint32_t i = 0; i < props->count_props && !id; ++i) {
+    drmModePropertyRes* p = drmModeGetProperty(fd, props->props[i]);
+    if (!p) continue;
+    if (std::strcmp(p->name, name) == 0) {
+      id = p->prop_id;
+      if (value) *value = props->prop_values[i];
+    }
+    drmModeFreeProperty(p);
+  }
+  drmModeFreeObjectProperties(props);
+  return id;
+}
+
+bool GbmKmsRenderer::init_atomic() {
+  if (atomic_ready_) return true;
+  if (drmSetClientCap(drm_fd_, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) != 0 ||
+      drmSetClientCap(drm_fd_, DRM_CLIENT_CAP_ATOMIC, 1) != 0) {
+    LOGW("KMS driver has no atomic modesetting");
+    return false;
+  }
+
+  crtc_prop_mode_id_ = find_prop(drm_fd_, crtc_id_, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+  crtc_prop_active_ = find_prop(drm_fd_, crtc_id_, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+  conn_prop_crtc_id_ = find_prop(drm_fd_, conn_id_, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+  crtc_prop_out_fence_ = find_prop(drm_fd_, crtc_id_, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR");
+  if (!crtc_prop_mode_id_ || !crtc_prop_active_ || !conn_prop_crtc_id_ || !mode_blob_id_) {
+    LOGW("CRTC/connector atomic properties missing");
+    return false;
+  }
+  atomic_ready_ = true;
+  return true;
+}
+
+static void close_gem(int drm_fd, uint32_t handle) {
+  struct drm_gem_close gc{};
+  gc.handle = handle;
+  (void)drmIoctl(drm_fd, DRM_IOCTL_GEM_CLOSE, &gc);
+}
+
+// FBs that are on screen (or about to be) cannot be removed without
+// blanking the plane; those wait in retired_fbs_ for the next flip.
+void GbmKmsRenderer::release_fb(const ScanoutFb& sfb, bool close_handle) {
+  ScanoutFb r = sfb;
+  if (!close_handle) r.gem = 0;
+  if (r.fb == fb_id_ || r.fb == pending_fb_id_) {
+    retired_fbs_.push_back(r);
+    return;
+  }
+  drmModeRmFB(drm_fd_, r.fb);
+  if (r.gem) close_gem(drm_fd_, r.gem);
+}
+
+void GbmKmsRenderer::drop_retired_fbs() {
+  size_t keep = 0;
+  for (size_t i = 0; i < retired_fbs_.size(); ++i) {
+    const ScanoutFb& r = retired_fbs_[i];
+    if (r.fb == fb_id_ || r.fb == pending_fb_id_) {
+      retired_fbs_[keep++] = r;
+      continue;
+    }
+    drmModeRmFB(drm_fd_, r.fb);
+    if (r.gem) close_gem(drm_fd_, r.gem);
+  }
+  retired_fbs_.resize(keep);
+}
+
+uint32_t GbmKmsRenderer::scanout_fb(int fd, const FrameLayout& layout) {
+  DmabufKey key;
+  if (!dmabuf_key(fd, &key)) return 0;
+
+  uint32_t gem = 0;
+  auto it = fbs_.find(key);
+  if (it != fbs_.end()) {
+    if (it->second.layout == layout) {
+      fb_stats_.hits++;
+      it->second.last_use = ++frame_seq_;
+      return it->second.fb;
+    }
+    // Same buffer, new layout: PRIME import would hand back the same GEM
+    // handle, so keep it and only replace the FB.
+    gem = it->second.gem;
+    release_fb(it->second, false);
+    fbs_.erase(it);
+    fb_stats_.invalidations++;
+  }
+
+  if (fbs_.size() >= kMaxImports) {
+    auto lru = fbs_.end();
+    for (auto i = fbs_.begin(); i != fbs_.end(); ++i) {
+      if (i->second.fb == fb_id_ || i->second.fb == pending_fb_id_) continue;
+      if (lru == fbs_.end() || i->second.last_use < lru->second.last_use) lru = i;
+    }
+    if (lru != fbs_.end()) {
+      release_fb(lru->second, true);
+      fbs_.erase(lru);
+      fb_stats_.evictions++;
+    }
+  }
+
+  if (!gem && drmPrimeFDToHandle(drm_fd_, fd, &gem) != 0) {
+    LOGW_EVERY_MS(1000, "drmPrimeFDToHandle(%d) failed: %s", fd, strerror(errno));
+    return 0;
+  }
+
+  uint32_t handles[4] = {0}, pitches[4] = {0}, offs[4] = {0};
+  for (int p = 0; p < fourcc_plane_count(layout.fourcc); ++p) {
+    handles[p] = gem;
+    pitches[p] = layout.strides[p];
+    offs[p] = layout.offsets[p];
+  }
+
+  uint32_t fb = 0;
+  if (drmModeAddFB2(drm_fd_, layout.width, layout.height, layout.fourcc,
+                    handles, pitches, offs, &fb, 0) != 0) {
+    LOGW_EVERY_MS(1000, "drmModeAddFB2(%ux%u fourcc=0x%08x) failed: %s",
+                  layout.width, layout.height, layout.fourcc, strerror(errno));
+    close_gem(drm_fd_, gem);
+    return 0;
+  }
+
+  ScanoutFb& sfb = fbs_[key];
+  sfb.fb = fb;
+  sfb.gem = gem;
+  sfb.layout = layout;
+  sfb.last_use = ++frame_seq_;
+  fb_stats_.creates++;
+  return fb;
+}
+
+// in_fence: the display waits for it before scanning the FB out. out_fence
+// (set to -1 by the caller): receives a sync_file that signals once this
+// commit is on screen, i.e. the FB it replaces is released.
+int GbmKmsRenderer::commit_plane(uint32_t plane_id, const PlaneProps& props, const Rect& dst,
+                                 uint32_t fb, uint32_t flags, int in_fence, int* out_fence)
+{
+  drmModeAtomicReq* req = drmModeAtomicAlloc();
+  if (!req) return -ENOMEM;
+
+  if (!modeset_done_) {
+    drmModeAtomicAddProperty(req, crtc_id_, crtc_prop_mode_id_, mode_blob_id_);
+    drmModeAtomicAddProperty(req, crtc_id_, crtc_prop_active_, 1);
+    drmModeAtomicAddProperty(req, conn_id_, conn_prop_crtc_id_, crtc_id_);
+    flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+  }
+
+  // SRC_* are 16.16 fixed point.
+  drmModeAtomicAddProperty(req, plane_id, props.fb_id, fb);
+  drmModeAtomicAddProperty(req, plane_id, props.crtc_id, crtc_id_);
+  drmModeAtomicAddProperty(req, plane_id, props.src_x, 0);
+  drmModeAtomicAddProperty(req, plane_id, props.src_y, 0);
+  drmModeAtomicAddProperty(req, plane_id, props.src_w, (uint64_t)plane_src_w_ << 16);
+  drmModeAtomicAddProperty(req, plane_id, props.src_h, (uint64_t)plane_src_h_ << 16);
+  drmModeAtomicAddProperty(req, plane_id, props.crtc_x, (uint64_t)(int64_t)dst.x);
+  drmModeAtomicAddProperty(req, plane_id, props.crtc_y, (uint64_t)(int64_t)dst.y);
+  drmModeAtomicAddProperty(req, plane_id, props.crtc_w, dst.w);
+  drmModeAtomicAddProperty(req, plane_id, props.crtc_h, dst.h);
+  if (in_fence >= 0 && props.in_fence_fd)
+    drmModeAtomicAddProperty(req, plane_id, props.in_fence_fd, (uint64_t)in_fence);
+  if (out_fence && crtc_prop_out_fence_)
+    drmModeAtomicAddProperty(req, crtc_id_, crtc_prop_out_fence_, (uint64_t)(uintptr_t)out_fence);
+
+  int rc = drmModeAtomicCommit(drm_fd_, req, flags, this);
+  if (rc != 0) rc = -errno;
+  drmModeAtomicFree(req);
+  return rc;
+}
+
+bool GbmKmsRenderer::choose_plane(uint32_t fb, uint32_t width, uint32_t height, uint32_t fourcc) {
+  drmModePlaneRes* pres = drmModeGetPlaneResources(drm_fd_);
+  if (!pres) return false;
+
+  // Overlays first: they leave the primary plane to the UI. The primary
+  // plane is the last resort (it is all vkms offers for most formats).
+  std::vector<uint32_t> overlays, primaries;
+  for (uint32_t i = 0; i < pres->count_planes; ++i) {
+    drmModePlane* pl = drmModeGetPlane(drm_fd_, pres->planes[i]);
+    if (!pl) continue;
+    bool usable = (pl->possible_crtcs & (1u << crtc_index_)) != 0;
+    bool has_format = false;
+    for (uint32_t f = 0; f < pl->count_formats && !has_format; ++f)
+      has_format = pl->formats[f] == fourcc;
+    uint32_t id = pl->plane_id;
+    drmModeFreePlane(pl);
+    if (!usable || !has_format) continue;
+
+    uint64_t type = 0;
+    if (!find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "type", &type)) continue;
+    if (type == DRM_PLANE_TYPE_OVERLAY) overlays.push_back(id);
+    else if (type == DRM_PLANE_TYPE_PRIMARY) primaries.push_back(id);
+  }
+  drmModeFreePlaneResources(pres);
+  overlays.insert(overlays.end(), primaries.begin(), primaries.end());
+
+  // Full-screen (scaled) first; planes that cannot scale get 1:1, centered.
+  Rect geoms[2];
+  int ngeoms = 0;
+  geoms[ngeoms++] = Rect{0, 0, width_, height_};
+  if ((width != width_ || height != height_) && width <= width_ && height <= height_)
+    geoms[ngeoms++] = Rect{(int32_t)(width_ - width) / 2, (int32_t)(height_ - height) / 2, width, height};
+
+  plane_src_w_ = width;
+  plane_src_h_ = height;
+  for (uint32_t id : overlays) {
+    PlaneProps pp;
+    pp.fb_id = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+    pp.crtc_id = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+    pp.src_x = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "SRC_X");
+    pp.src_y = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+    pp.src_w = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "SRC_W");
+    pp.src_h = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "SRC_H");
+    pp.crtc_x = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+    pp.crtc_y = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+    pp.crtc_w = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+    pp.crtc_h = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+    pp.in_fence_fd = find_prop(drm_fd_, id, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD");
+    if (!pp.fb_id || !pp.crtc_id || !pp.src_w || !pp.crtc_w) continue;
+
+    for (int g = 0; g < ngeoms; ++g) {
+      if (commit_plane(id, pp, geoms[g], fb, DRM_MODE_ATOMIC_TEST_ONLY) != 0) continue;
+      plane_id_ = id;
+      plane_props_ = pp;
+      plane_dst_ = geoms[g];
+      plane_fourcc_ = fourcc;
+      LOGI("KMS plane %u scans out %ux%u fourcc=0x%08x at %d,%d %ux%u",
+           id, width, height, fourcc, geoms[g].x, geoms[g].y, geoms[g].w, geoms[g].h);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Completion of either an atomic plane commit or a GL page flip; the two
+// paths are never in flight together.
+void GbmKmsRenderer::on_flip(int fd, unsigned int seq, unsigned int sec, unsigned int usec, void* data) {
+  (void)fd;
+  GbmKmsRenderer* r = (GbmKmsRenderer*)data;
+  r->timing_complete(seq, (uint64_t)sec * 1000000000ull + (uint64_t)usec * 1000ull);
+  if (!r->flip_pending_) {
+    r->on_gl_flip();
+    return;
+  }
+  // The old FB stays cached; only invalidated ones are removed now.
+  r->fb_id_ = r->pending_fb_id_;
+  r->pending_fb_id_ = 0;
+  r->flip_pending_ = false;
+  r->drop_retired_fbs();
+}
+
+// Waits for the DRM fd to become readable and handles what is queued.
+bool GbmKmsRenderer::wait_event(int timeout_ms) {
+  drmEventContext ev{};
+  ev.version = 2;
+  ev.page_flip_handler = &GbmKmsRenderer::on_flip;
+
+  pollfd pfd{drm_fd_, POLLIN, 0};
+  int rc;
+  do {
+    rc = ::poll(&pfd, 1, timeout_ms);
+  } while (rc < 0 && errno == EINTR);
+  if (rc <= 0) return false;
+  return drmHandleEvent(drm_fd_, &ev) == 0;
+}
+
+bool GbmKmsRenderer::wait_flip(int timeout_ms) {
+  while (flip_pending_) {
+    if (!wait_event(timeout_ms)) {
+      LOGW_EVERY_MS(1000, "page flip did not complete within %d ms", timeout_ms);
       return false;
     }
   }
   return true;
 }
 
+bool GbmKmsRenderer::scanout_dmabuf(int fd, uint32_t width, uint32_t height, uint32_t fourcc,
+                                    const uint32_t* strides, const uint32_t* offsets, int in_fence)
+{
+  if (!init_atomic()) return false;
+
+  // One commit in flight: the FB it replaces is only free after the flip.
+  if (flip_pending_ && !wait_flip(1000)) return false;
+
+  FrameLayout layout;
+  if (!make_layout(width, height, fourcc, strides, offsets, &layout)) return false;
+  uint32_t fb = scanout_fb(fd, layout);
+  if (!fb) return false;
+
+  if (plane_id_ == 0 || plane_fourcc_ != fourcc ||
+      plane_src_w_ != width || plane_src_h_ != height) {
+    plane_id_ = 0;
+    if (!choose_plane(fb, width, height, fourcc)) return false;
+  }
+
+  if (in_fence >= 0 && !plane_props_.in_fence_fd && !wait_in_fence(in_fence)) return false;
+
+  uint64_t submit_ns = monotonic_ns();
+  int out_fence = -1;
+  int rc = commit_plane(plane_id_, plane_props_, plane_dst_, fb,
+                        DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, in_fence, &out_fence);
+  UniqueFd release(out_fence);
+  if (rc != 0) {
+    LOGW_EVERY_MS(1000, "atomic plane commit failed: %d", rc);
+    return false;
+  }
+  timing_submit(submit_ns, false);
+  // This commit's out-fence releases the buffer it takes off the plane.
+  if (plane_buf_fd_ >= 0 && plane_buf_fd_ != fd && release)
+    add_release_fence(plane_buf_fd_, std::move(release));
+  plane_buf_fd_ = fd;
+  modeset_done_ = true;
+  pending_fb_id_ = fb;
+  flip_pending_ = true;
+  return true;
+}
+
+bool GbmKmsRenderer::present_dmabuf_frame(int fd, uint32_t width, uint32_t height, uint32_t fourcc,
+                                          const uint32_t* strides, const uint32_t* offsets,
+                                          int in_fence)
+{
+  if (in_fence_failed(in_fence)) return false;
+  if (plane_scanout_ && !plane_failed_ && !headless_ && drm_fd_ >= 0) {
+    if (scanout_dmabuf(fd, width, height, fourcc, strides, offsets, in_fence)) return true;
+    if (in_fence_failed(in_fence)) return false; // the frame, not the plane
+    LOGW("no KMS plane takes %ux%u fourcc=0x%08x; falling back to GL composition",
+         width, height, fourcc);
+    plane_failed_ = true;
+    if (flip_pending_) (void)wait_flip(1000); // GL flips must not overlap it
+  }
+  return render_dmabuf_frame(fd, width, height, fourcc, strides, offsets, in_fence);
+}
+
+bool GbmKmsRenderer::make_current() {
+  EGLDisplay dpy = (EGLDisplay)egl_display_;
+  EGLSurface surf = egl_surface_ ? (EGLSurface)egl_surface_ : EGL_NO_SURFACE;
+  if (!dpy) return false;
+  if (!eglMakeCurrent(dpy, surf, surf, (EGLContext)egl_context_)) {
+    LOGE("eglMakeCurrent failed (0x%x)", eglGetError());
+    return false;
+  }
+  return true;
+}
+
+void GbmKmsRenderer::release_current() {
+  if (egl_display_)
+    eglMakeCurrent((EGLDisplay)egl_display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
 void GbmKmsRenderer::shutdown() {
   EGLDisplay dpy = (EGLDisplay)egl_display_;
   EGLContext ctx = (EGLContext)egl_context_;
   EGLSurface surf = (EGLSurface)egl_surface_;
 
+  // Locked BOs (and a pending GL flip that releases one) go back while the
+  // EGL surface behind gbm_surface_release_buffer() still exists.
+  if (gbm_surf_) release_gl_bos();
+
+  if (dpy && dpy != EGL_NO_DISPLAY && ctx && ctx != EGL_NO_CONTEXT) {
+    // GL objects go first, while the context is still current.
+    for (auto& kv : imports_) destroy_import(kv.second);
+    if (ext_program_) glDeleteProgram(ext_program_);
+    if (offscreen_fbo_) glDeleteFramebuffers(1, &offscreen_fbo_);
+    if (offscreen_tex_) glDeleteTextures(1, &offscreen_tex_);
+  }
+  // Frames still in flight are not recorded; only their fences go.
+  for (; inflight_count_ > 0; inflight_count_--)
+    timing_release(inflight_[(inflight_head_ + inflight_count_ - 1) % inflight_.size()]);
+  imports_.clear();
+  releases_.clear();
+  plane_buf_fd_ = -1;
+  native_fence_ = -1;
+  ext_program_ = offscreen_fbo_ = offscreen_tex_ = 0;
+  headless_ = false;
+
   if (dpy && dpy != EGL_NO_DISPLAY) {
     eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     if (surf && surf != EGL_NO_SURFACE) eglDestroySurface(dpy, surf);
@@ -205,7 +1230,20 @@ void GbmKmsRenderer::shutdown() {
     gbm_dev_ = nullptr;
   }
   if (drm_fd_ >= 0) {
+    if (flip_pending_) (void)wait_flip(100);
+    // Removing an FB that is still on a plane disables that plane.
+    fb_id_ = pending_fb_id_ = 0;
+    for (auto& kv : fbs_) release_fb(kv.second, true);
+    drop_retired_fbs();
+    if (mode_blob_id_) drmModeDestroyPropertyBlob(drm_fd_, mode_blob_id_);
     ::close(drm_fd_);
     drm_fd_ = -1;
   }
+  delete (drmModeModeInfo*)mode_;
+  mode_ = nullptr;
+  fbs_.clear();
+  retired_fbs_.clear();
+  fb_id_ = pending_fb_id_ = mode_blob_id_ = 0;
+  plane_id_ = 0;
+  plane_failed_ = atomic_ready_ = modeset_done_ = flip_pending_ = false;
 }
@@ -1,15 +1,201 @@
 #pragma once
+#include <array>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
+#include "dmabuf_key.h"
+#include "frame_timing.h"
+#include "../common/fd.h"
 
 class GbmKmsRenderer {
 public:
   bool init(const std::string& card_path);
+  // Offscreen rendering on an EGL surfaceless display (e.g. Mesa llvmpipe);
+  // needs no DRM device. Frames land in a width x height framebuffer object.
+  bool init_headless(unsigned int width, unsigned int height);
   void shutdown();
 
+  // EGL contexts are current per thread: init() leaves the context current
+  // on the calling thread. To initialise on one thread and render on another,
+  // call release_current() on the first and make_current() on the second.
+  bool initialized() const { return egl_display_ != nullptr; }
+  bool make_current();
+  void release_current();
+
   // Present a simple test pattern (no dmabuf sampling required to compile/run).
+  // Paced by page flips through the display fd rather than by swap blocking.
   bool render_test_pattern(int frames);
 
+  // GL frames in KMS mode are shown with drmModePageFlip: one BO on screen,
+  // one with a flip pending and one queued behind it. Presenting never
+  // waits for a flip; a frame finished while one is already queued replaces
+  // it (counted as dropped). Render loops that must not drop poll
+  // display_fd() for POLLIN and call dispatch_events() until
+  // present_queue_full() clears. display_fd() is -1 when headless.
+  int display_fd() const { return headless_ ? -1 : drm_fd_; }
+  void dispatch_events();
+  bool present_queue_full() const { return queued_bo_ != nullptr; }
+
+  struct PresentStats {
+    uint64_t frames = 0;  // presented by GL
+    uint64_t flips = 0;   // completed page flips
+    uint64_t dropped = 0; // queued frames replaced before reaching the screen
+  };
+  PresentStats present_stats() const { return present_stats_; }
+
+  // Per-frame submit / GPU-done / flip-complete timing of KMS presentation
+  // (GL and plane paths). GPU-done comes from an EGL fence: the sync_file
+  // signal timestamp with EGL_ANDROID_native_fence_sync, otherwise the time
+  // the fence was first seen signalled. Kept across shutdown().
+  FrameTiming& frame_timing() { return timing_; }
+  const FrameTiming& frame_timing() const { return timing_; }
+
+  // Draws a dma-buf frame full-screen without a CPU copy: the planes (all in
+  // one fd) are imported with EGL_EXT_image_dma_buf_import and sampled via
+  // GL_OES_EGL_image_external. fourcc is a DRM format (NV12, NV21, P010,
+  // YUV420, ARGB8888, XRGB8888); strides/offsets hold one entry per plane.
+  // The EGLImage and texture are cached per dma-buf, so pooled buffers are
+  // imported once and reused on every later frame.
+  // in_fence (a sync_file, -1 for none; the caller keeps it) must signal
+  // before the buffer is read, e.g. the out-fence of the copy that wrote
+  // it. The GPU waits for it (EGL_ANDROID_native_fence_sync with
+  // EGL_KHR_wait_sync); the CPU only when the EGL lacks those. A fence
+  // already signalled with an error drops the frame (returns false).
+  bool render_dmabuf_frame(int fd, uint32_t width, uint32_t height, uint32_t fourcc,
+                           const uint32_t* strides, const uint32_t* offsets,
+                           int in_fence = -1);
+
+  // Drops everything cached for a dma-buf (EGLImage, KMS FB, GEM handle).
+  // Cached entries keep the buffer alive, so call this before a pooled
+  // buffer is freed (SecureBufferPool::set_free_hook) or reallocated.
+  void forget_dmabuf(int fd);
+
+  // Blocks until queued GL work is done (headless benchmarking).
+  void finish();
+
+  // Atomic KMS scanout (KMS mode only). When enabled, present_dmabuf_frame()
+  // hands frames to a hardware plane instead of composing them with GL.
+  void set_plane_scanout(bool enable) { plane_scanout_ = enable; }
+  bool plane_active() const { return plane_id_ != 0 && !plane_failed_; }
+
+  // Shows a dma-buf frame. With plane scanout enabled the buffer becomes a
+  // KMS framebuffer on an overlay plane (the primary plane if no overlay
+  // accepts it) and is committed with DRM_MODE_ATOMIC_NONBLOCK. FBs are
+  // cached per dma-buf (fb_cache_stats()). Falls back to
+  // render_dmabuf_frame() for good when no plane takes the format/geometry.
+  // A plane commit hands in_fence to the display as the plane's IN_FENCE_FD.
+  bool present_dmabuf_frame(int fd, uint32_t width, uint32_t height, uint32_t fourcc,
+                            const uint32_t* strides, const uint32_t* offsets,
+                            int in_fence = -1);
+
+  // Release fence of a dma-buf presented earlier: a sync_file that signals
+  // once the renderer has stopped reading the buffer, so its producer may
+  // rewrite it without a CPU round trip. GL composition: the draw that
+  // sampled it is done (known as soon as it was presented). Plane scanout:
+  // a later commit has replaced it on screen (that commit's CRTC
+  // OUT_FENCE_PTR, known once it is made). Empty while not known yet, or
+  // when neither EGL nor KMS provides fences.
+  UniqueFd take_release_fence(int fd);
+
+  struct ImportStats {
+    uint64_t imports = 0; // EGLImage creations
+    uint64_t hits = 0;    // frames served from the cache
+  };
+  ImportStats import_stats() const { return import_stats_; }
+
+  // KMS framebuffers for plane scanout, cached per dma-buf like the imports.
+  // In steady state every frame is a hit and no KMS objects are created.
+  struct FbCacheStats {
+    uint64_t creates = 0;       // drmPrimeFDToHandle + drmModeAddFB2
+    uint64_t hits = 0;
+    uint64_t evictions = 0;     // LRU, cache full
+    uint64_t invalidations = 0; // forget_dmabuf() or layout change
+  };
+  FbCacheStats fb_cache_stats() const { return fb_stats_; }
+
 private:
+  // Geometry a cached dma-buf object was created with.
+  struct FrameLayout {
+    uint32_t width = 0, height = 0, fourcc = 0;
+    uint32_t strides[3] = {0, 0, 0};
+    uint32_t offsets[3] = {0, 0, 0};
+
+    bool operator==(const FrameLayout& o) const {
+      for (int p = 0; p < 3; ++p)
+        if (strides[p] != o.strides[p] || offsets[p] != o.offsets[p]) return false;
+      return width == o.width && height == o.height && fourcc == o.fourcc;
+    }
+  };
+  // Unused planes (per fourcc) are zeroed; false for unsupported formats.
+  static bool make_layout(uint32_t width, uint32_t height, uint32_t fourcc,
+                          const uint32_t* strides, const uint32_t* offsets, FrameLayout* out);
+
+  struct ImportedImage {
+    void* image = nullptr;   // EGLImageKHR
+    unsigned int tex = 0;    // GL_TEXTURE_EXTERNAL_OES
+    FrameLayout layout;
+    uint64_t last_use = 0;
+  };
+
+  struct ScanoutFb {
+    uint32_t fb = 0;
+    uint32_t gem = 0;
+    FrameLayout layout;
+    uint64_t last_use = 0;
+  };
+
+  bool ensure_external_program();
+  ImportedImage* import_dmabuf(int fd, const FrameLayout& layout);
+  void destroy_import(ImportedImage& img);
+  bool present();
+
+  // Property ids of the objects touched by plane commits.
+  struct PlaneProps {
+    uint32_t fb_id = 0, crtc_id = 0, in_fence_fd = 0;
+    uint32_t src_x = 0, src_y = 0, src_w = 0, src_h = 0;
+    uint32_t crtc_x = 0, crtc_y = 0, crtc_w = 0, crtc_h = 0;
+  };
+  struct Rect { int32_t x = 0, y = 0; uint32_t w = 0, h = 0; };
+
+  bool init_atomic();
+  uint32_t scanout_fb(int fd, const FrameLayout& layout);
+  void release_fb(const ScanoutFb& sfb, bool close_gem);
+  void drop_retired_fbs();
+  bool choose_plane(uint32_t fb, uint32_t width, uint32_t height, uint32_t fourcc);
+  int commit_plane(uint32_t plane_id, const PlaneProps& props, const Rect& dst,
+                   uint32_t fb, uint32_t flags, int in_fence = -1, int* out_fence = nullptr);
+  bool scanout_dmabuf(int fd, uint32_t width, uint32_t height, uint32_t fourcc,
+                      const uint32_t* strides, const uint32_t* offsets, int in_fence);
+  bool wait_flip(int timeout_ms);
+  bool wait_event(int timeout_ms);
+  static void on_flip(int fd, unsigned int seq, unsigned int sec, unsigned int usec, void* data);
+
+  // Frame between submission and its flip event.
+  struct InFlightFrame {
+    FrameRecord rec;
+    void* sync = nullptr; // EGLSyncKHR
+    int sync_fd = -1;     // native fence fd, if supported
+  };
+  void timing_submit(uint64_t submit_ns, bool gpu_fence);
+  void timing_drop_newest();
+  void timing_complete(uint32_t vblank, uint64_t flip_ns);
+  void timing_poll_fences();
+  void timing_release(InFlightFrame& f);
+
+  // Explicit sync (EGL_ANDROID_native_fence_sync, EGL_KHR_wait_sync).
+  bool native_fence_sync();
+  UniqueFd gl_fence();            // signals when the GL work issued so far is done
+  bool gl_wait_fence(int fence);  // false: the GPU cannot wait, nothing queued
+  bool wait_in_fence(int fence);  // CPU fallback; false: the fence failed
+  bool in_fence_failed(int fence); // signalled with an error status
+  void add_release_fence(int buf_fd, UniqueFd fence);
+
+  bool present_kms();
+  bool flip_to(void* bo);
+  void on_gl_flip();
+  void release_gl_bos();
+
   int drm_fd_ = -1;
   void* gbm_dev_ = nullptr;
   void* gbm_surf_ = nullptr;
@@ -18,9 +204,63 @@ private:
   void* egl_context_ = nullptr;
   void* egl_surface_ = nullptr;
 
+  bool headless_ = false;
+  unsigned int offscreen_fbo_ = 0;
+  unsigned int offscreen_tex_ = 0;
+
+  unsigned int ext_program_ = 0;
+  int ext_attr_pos_ = -1;
+  int ext_attr_uv_ = -1;
+
+  std::unordered_map<DmabufKey, ImportedImage, DmabufKeyHash> imports_;
+  uint64_t frame_seq_ = 0;
+  ImportStats import_stats_;
+
+  std::unordered_map<DmabufKey, ScanoutFb, DmabufKeyHash> fbs_;
+  std::vector<ScanoutFb> retired_fbs_; // invalidated while still on screen
+  FbCacheStats fb_stats_;
+
   unsigned int crtc_id_ = 0;
   unsigned int conn_id_ = 0;
-  unsigned int fb_id_ = 0;
+  unsigned int fb_id_ = 0;         // plane FB on screen
+  unsigned int pending_fb_id_ = 0; // plane FB committed, flip not yet done
+  unsigned int crtc_index_ = 0;
+  unsigned int mode_blob_id_ = 0;
+  void* mode_ = nullptr;       // drmModeModeInfo*, for drmModeSetCrtc
+
+  bool crtc_set_ = false;
+  void* scan_bo_ = nullptr;    // gbm_bo* on screen
+  void* flip_bo_ = nullptr;    // gbm_bo* with a page flip pending
+  void* queued_bo_ = nullptr;  // gbm_bo* waiting for flip_bo_ to land
+  PresentStats present_stats_;
+
+  std::array<InFlightFrame, 4> inflight_;
+  size_t inflight_head_ = 0;
+  size_t inflight_count_ = 0;
+  uint64_t frame_counter_ = 0;
+  int native_fence_ = -1; // -1 unknown, 0 no, 1 EGL_ANDROID_native_fence_sync
+  bool wait_sync_ = false; // EGL_KHR_wait_sync, valid once native_fence_ >= 0
+  FrameTiming timing_;
+
+  bool plane_scanout_ = false;
+  bool plane_failed_ = false;
+  bool atomic_ready_ = false;
+  bool modeset_done_ = false;
+  bool flip_pending_ = false;
+  uint32_t plane_id_ = 0;
+  uint32_t plane_fourcc_ = 0, plane_src_w_ = 0, plane_src_h_ = 0;
+  PlaneProps plane_props_;
+  Rect plane_dst_;
+  uint32_t crtc_prop_mode_id_ = 0, crtc_prop_active_ = 0, conn_prop_crtc_id_ = 0;
+  uint32_t crtc_prop_out_fence_ = 0; // OUT_FENCE_PTR, 0 if the driver has none
+  int plane_buf_fd_ = -1;            // dma-buf of the last plane commit
+
+  struct ReleaseFence {
+    int buf_fd;
+    UniqueFd fence;
+  };
+  std::vector<ReleaseFence> releases_; // not taken yet, oldest first
+
   unsigned int width_ = 0;
   unsigned int height_ = 0;
 };